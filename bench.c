@@ -0,0 +1,1229 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "olc.h"
+#include "olc_agg.h"
+#include "olc_column.h"
+#include "olc_geofence.h"
+#include "olc_index.h"
+#include "olc_locality.h"
+#include "olc_parallel.h"
+
+#define BENCH_POINTS 100000
+#define BENCH_STRIDE 24
+#define BENCH_RUNS 3
+#define BENCH_JSON "bench.json"
+
+// Default code length for the datasets; recovery removes up to 8 digits.
+#define BENCH_LENGTH 11
+
+// The expensive calls (coverings, rings, children) only run on every n-th
+// point.
+#define BENCH_SPARSE 16
+
+// Number of codes that share a reference location in the batch benchmarks.
+#define BENCH_BATCH 256
+
+// Code lengths of a multi-resolution tile index, for OLC_EncodeMulti.
+#define BENCH_MULTI 5
+static const size_t kMultiLengths[BENCH_MULTI] = { 4, 6, 8, 10, 11 };
+
+// Number of fixes, about a meter apart, tracked from each point.
+#define BENCH_FIXES 16
+
+// Number of localities for OLC_ShortenBest, taken from the cities dataset.
+#define BENCH_LOCALITIES 1024
+
+// Room for each line of the log-like text scanned for codes.
+#define BENCH_TEXT_LINE 96
+
+// Index file written for each dataset, removed again once it is mapped.
+#define BENCH_INDEX "bench.idx"
+
+// Geofences around every n-th point, about two kilometers across, with at
+// most BENCH_FENCE_CELLS cells each.
+#define BENCH_FENCE_EVERY 64
+#define BENCH_FENCE_VERTICES 16
+#define BENCH_FENCE_LENGTH 11
+#define BENCH_FENCE_CELLS 256
+#define BENCH_FENCE_IDS 64
+
+#define BENCH_MAX_CELLS 64
+#define BENCH_MAX_RESULTS 512
+
+// A set of points, with their codes (NUL-terminated, in fixed slots),
+// packed codes, a text with a line of log for each code, an index file
+// with a record for each code, the packed codes sorted and in blocks, and
+// geofences around some of the points.
+typedef struct Dataset {
+    const char* name;
+    size_t n;
+    double* lat;
+    double* lon;
+    int32_t* lat_e7;
+    int32_t* lon_e7;
+    OLC_LatLon* locations;
+    char* codes;
+    OLC_Packed* packed;
+    char* text;
+    size_t text_size;
+    OLC_Index* index;
+    OLC_Packed* sorted;
+    uint8_t* column;
+    size_t column_size;
+    OLC_Geofence* fences;
+} Dataset;
+
+typedef size_t (BenchFunc)(const Dataset* data, size_t arg);
+
+typedef struct Bench {
+    const char* name;
+    BenchFunc* func;
+    size_t arg;
+} Bench;
+
+typedef struct Result {
+    const char* bench;
+    const char* dataset;
+    size_t arg;
+    size_t ops;
+    double ns_per_op;
+    double ops_per_sec;
+    double cycles_per_op;
+} Result;
+
+// Output buffers shared by all benchmarks.
+typedef struct Scratch {
+    char* codes;
+    double* lo_lat;
+    double* lo_lon;
+    double* hi_lat;
+    double* hi_lon;
+    int32_t* corners_e7;   // lo_lat, lo_lon, hi_lat and hi_lon columns
+    uint8_t* column;
+    OLC_Packed* block;
+    uint8_t* len;
+    uint8_t* status;
+} Scratch;
+
+static Scratch scratch;
+
+static OLC_LocalityIndex* localities;
+
+// Every result is folded into this, so that no call can be optimized away.
+static volatile uint64_t sink;
+
+static double now(void);
+static uint64_t cycles(void);
+static double random_unit(unsigned long long* state);
+static int make_dataset(Dataset* data, const char* name, size_t n, unsigned long long seed);
+static int make_index(Dataset* data);
+static int make_column(Dataset* data);
+static int make_fences(Dataset* data, OLC_Geofence* fences);
+static void free_dataset(Dataset* data);
+static void run_bench(const Bench* bench, const Dataset* data, Result* result);
+static int write_json(const char* file, size_t n, const Result* results, size_t count);
+
+static size_t bench_get_center(const Dataset* data, size_t arg);
+static size_t bench_code_length(const Dataset* data, size_t arg);
+static size_t bench_is_valid(const Dataset* data, size_t arg);
+static size_t bench_is_short(const Dataset* data, size_t arg);
+static size_t bench_is_full(const Dataset* data, size_t arg);
+static size_t bench_validate_batch(const Dataset* data, size_t arg);
+static size_t bench_encode(const Dataset* data, size_t arg);
+static size_t bench_encode_default(const Dataset* data, size_t arg);
+static size_t bench_code_width(const Dataset* data, size_t arg);
+static size_t bench_encode_batch(const Dataset* data, size_t arg);
+static size_t bench_encode_batch_locations(const Dataset* data, size_t arg);
+static size_t bench_parallel_encode_batch(const Dataset* data, size_t arg);
+static size_t bench_encode_multi(const Dataset* data, size_t arg);
+static size_t bench_encode_multi_batch(const Dataset* data, size_t arg);
+static size_t bench_encode_e7(const Dataset* data, size_t arg);
+static size_t bench_tracker_update(const Dataset* data, size_t arg);
+static size_t bench_encode_fixes(const Dataset* data, size_t arg);
+static size_t bench_encode_batch_e7(const Dataset* data, size_t arg);
+static size_t bench_decode(const Dataset* data, size_t arg);
+static size_t bench_decode_e7(const Dataset* data, size_t arg);
+static size_t bench_decode_batch_e7(const Dataset* data, size_t arg);
+static size_t bench_decode_batch(const Dataset* data, size_t arg);
+static size_t bench_parallel_decode_batch(const Dataset* data, size_t arg);
+static size_t bench_pack(const Dataset* data, size_t arg);
+static size_t bench_unpack(const Dataset* data, size_t arg);
+static size_t bench_encode_packed(const Dataset* data, size_t arg);
+static size_t bench_decode_packed(const Dataset* data, size_t arg);
+static size_t bench_packed_length(const Dataset* data, size_t arg);
+static size_t bench_packed_last_descendant(const Dataset* data, size_t arg);
+static size_t bench_cover_bbox(const Dataset* data, size_t arg);
+static size_t bench_cover_circle(const Dataset* data, size_t arg);
+static size_t bench_neighbors(const Dataset* data, size_t arg);
+static size_t bench_kring(const Dataset* data, size_t arg);
+static size_t bench_parent(const Dataset* data, size_t arg);
+static size_t bench_children(const Dataset* data, size_t arg);
+static size_t bench_contains(const Dataset* data, size_t arg);
+static size_t bench_packed_parent(const Dataset* data, size_t arg);
+static size_t bench_packed_children(const Dataset* data, size_t arg);
+static size_t bench_packed_contains(const Dataset* data, size_t arg);
+static size_t bench_shorten(const Dataset* data, size_t arg);
+static size_t bench_recover_nearest(const Dataset* data, size_t arg);
+static size_t bench_shorten_batch(const Dataset* data, size_t arg);
+static size_t bench_shorten_best(const Dataset* data, size_t arg);
+static size_t bench_recover_nearest_batch(const Dataset* data, size_t arg);
+static size_t bench_scan_text(const Dataset* data, size_t arg);
+static size_t bench_index_find(const Dataset* data, size_t arg);
+static size_t bench_index_find_prefix(const Dataset* data, size_t arg);
+static size_t bench_index_find_bbox(const Dataset* data, size_t arg);
+static int index_found(void* data, size_t record);
+static size_t bench_column_encode(const Dataset* data, size_t arg);
+static size_t bench_column_decode(const Dataset* data, size_t arg);
+static size_t bench_encode_packed_multi(const Dataset* data, size_t arg);
+static size_t bench_aggregator_add(const Dataset* data, size_t arg);
+static size_t bench_geofence_set(const Dataset* data, size_t arg);
+static size_t bench_geofence_find(const Dataset* data, size_t arg);
+static size_t bench_traverse_polyline(const Dataset* data, size_t arg);
+static int traverse_cell(void* data, OLC_Packed cell, double enter, double exit);
+static int compare_packed(const void* a, const void* b);
+
+// Usage: bench [-n points] [-o file.json] [name]
+// Runs all benchmarks (or those whose name starts with the given one) on
+// every dataset, prints a table and writes all results as JSON.
+int main(int argc, char* argv[])
+{
+    size_t n = BENCH_POINTS;
+    const char* json = BENCH_JSON;
+    const char* filter = 0;
+    for (int j = 1; j < argc; ++j) {
+        if (strcmp(argv[j], "-n") == 0 && j + 1 < argc) {
+            n = strtoul(argv[++j], 0, 10);
+        } else if (strcmp(argv[j], "-o") == 0 && j + 1 < argc) {
+            json = argv[++j];
+        } else {
+            filter = argv[j];
+        }
+    }
+
+    Bench benches[128];
+    size_t bench_count = 0;
+    for (size_t length = 2; length <= OLC_MAX_DIGITS; ++length) {
+        benches[bench_count++] = (Bench) { "Encode", bench_encode, length };
+    }
+    const Bench others[] = {
+        { "EncodeDefault"        , bench_encode_default        , 0            },
+        { "CodeWidth"            , bench_code_width            , 0            },
+        { "EncodeBatch"          , bench_encode_batch          , BENCH_LENGTH },
+        { "EncodeBatchLocations" , bench_encode_batch_locations, BENCH_LENGTH },
+        { "ParallelEncodeBatch"  , bench_parallel_encode_batch , BENCH_LENGTH },
+        { "EncodeMulti"          , bench_encode_multi          , BENCH_MULTI  },
+        { "EncodeMultiBatch"     , bench_encode_multi_batch    , BENCH_MULTI  },
+        { "EncodeE7"             , bench_encode_e7             , BENCH_LENGTH },
+        { "EncodeBatchE7"        , bench_encode_batch_e7       , BENCH_LENGTH },
+        { "TrackerUpdate"        , bench_tracker_update        , 8            },
+        { "TrackerUpdate"        , bench_tracker_update        , BENCH_LENGTH },
+        { "EncodeFixes"          , bench_encode_fixes          , 8            },
+        { "EncodeFixes"          , bench_encode_fixes          , BENCH_LENGTH },
+        { "EncodePacked"         , bench_encode_packed         , BENCH_LENGTH },
+        { "EncodePackedMulti"    , bench_encode_packed_multi   , BENCH_MULTI  },
+        { "Decode"               , bench_decode                , 0            },
+        { "DecodeE7"             , bench_decode_e7             , 0            },
+        { "DecodeBatchE7"        , bench_decode_batch_e7       , 0            },
+        { "DecodeBatch"          , bench_decode_batch          , OLC_SIMD_NONE  },
+        { "DecodeBatch"          , bench_decode_batch          , OLC_SIMD_SSSE3 },
+        { "DecodeBatch"          , bench_decode_batch          , OLC_SIMD_AVX2  },
+        { "ParallelDecodeBatch"  , bench_parallel_decode_batch , 0            },
+        { "DecodePacked"         , bench_decode_packed         , 0            },
+        { "GetCenter"            , bench_get_center            , 0            },
+        { "CodeLength"           , bench_code_length           , 0            },
+        { "IsValid"              , bench_is_valid              , 0            },
+        { "IsShort"              , bench_is_short              , 0            },
+        { "IsFull"               , bench_is_full               , 0            },
+        { "ValidateBatch"        , bench_validate_batch        , OLC_SIMD_NONE  },
+        { "ValidateBatch"        , bench_validate_batch        , OLC_SIMD_SSSE3 },
+        { "ValidateBatch"        , bench_validate_batch        , OLC_SIMD_AVX2  },
+        { "Pack"                 , bench_pack                  , 0            },
+        { "Unpack"               , bench_unpack                , 0            },
+        { "PackedLength"         , bench_packed_length         , 0            },
+        { "PackedLastDescendant" , bench_packed_last_descendant, 0            },
+        { "Neighbors"            , bench_neighbors             , 0            },
+        { "KRing"                , bench_kring                 , 2            },
+        { "Parent"               , bench_parent                , 6            },
+        { "Children"             , bench_children              , 0            },
+        { "Contains"             , bench_contains              , 6            },
+        { "PackedParent"         , bench_packed_parent         , 6            },
+        { "PackedChildren"       , bench_packed_children       , 0            },
+        { "PackedContains"       , bench_packed_contains       , 6            },
+        { "CoverBBox"            , bench_cover_bbox            , 10           },
+        { "CoverCircle"          , bench_cover_circle          , 10           },
+        { "Shorten"              , bench_shorten               , 0            },
+        { "RecoverNearest"       , bench_recover_nearest       , 4            },
+        { "RecoverNearest"       , bench_recover_nearest       , 6            },
+        { "RecoverNearest"       , bench_recover_nearest       , 8            },
+        { "ShortenBatch"         , bench_shorten_batch         , 0            },
+        { "ShortenBest"          , bench_shorten_best          , 0            },
+        { "RecoverNearestBatch"  , bench_recover_nearest_batch , 4            },
+        { "RecoverNearestBatch"  , bench_recover_nearest_batch , 6            },
+        { "RecoverNearestBatch"  , bench_recover_nearest_batch , 8            },
+        { "ScanText"             , bench_scan_text             , OLC_SIMD_NONE  },
+        { "ScanText"             , bench_scan_text             , OLC_SIMD_SSSE3 },
+        { "ScanText"             , bench_scan_text             , OLC_SIMD_AVX2  },
+        { "IndexFind"            , bench_index_find            , 0            },
+        { "IndexFindPrefix"      , bench_index_find_prefix     , 6            },
+        { "IndexFindBBox"        , bench_index_find_bbox       , 0            },
+        { "ColumnEncode"         , bench_column_encode         , 0            },
+        { "ColumnDecode"         , bench_column_decode         , 0            },
+        { "AggregatorAdd"        , bench_aggregator_add        , 1            },
+        { "AggregatorAdd"        , bench_aggregator_add        , BENCH_MULTI  },
+        { "GeofenceSet"          , bench_geofence_set          , 64           },
+        { "GeofenceSet"          , bench_geofence_set          , BENCH_FENCE_CELLS },
+        { "GeofenceFind"         , bench_geofence_find         , 0            },
+        { "TraversePolyline"     , bench_traverse_polyline     , 10           },
+        { "TraversePolyline"     , bench_traverse_polyline     , BENCH_LENGTH },
+    };
+    for (int j = 0; j < sizeof(others) / sizeof(others[0]); ++j) {
+        benches[bench_count++] = others[j];
+    }
+
+    const char* names[] = { "uniform", "cities", "polar", "antimeridian", "mixed" };
+    int dataset_count = sizeof(names) / sizeof(names[0]);
+    Dataset datasets[sizeof(names) / sizeof(names[0])];
+    memset(datasets, 0, sizeof(datasets));
+    scratch.codes = malloc(n * BENCH_STRIDE);
+    scratch.lo_lat = malloc(n * sizeof(double));
+    scratch.lo_lon = malloc(n * sizeof(double));
+    scratch.hi_lat = malloc(n * sizeof(double));
+    scratch.hi_lon = malloc(n * sizeof(double));
+    scratch.corners_e7 = malloc(4 * n * sizeof(int32_t));
+    scratch.column = malloc(n * 10 + (n / OLC_COLUMN_BLOCK_CODES + 1) * OLC_COLUMN_HEADER_SIZE);
+    scratch.block = malloc(OLC_COLUMN_BLOCK_CODES * sizeof(OLC_Packed));
+    scratch.len = malloc(n);
+    scratch.status = malloc(n);
+    Result* results = malloc(BENCH_MAX_RESULTS * sizeof(Result));
+    int ok = scratch.codes && scratch.lo_lat && scratch.lo_lon &&
+             scratch.hi_lat && scratch.hi_lon && scratch.corners_e7 && scratch.column &&
+             scratch.block && scratch.len && scratch.status && results;
+    for (int k = 0; ok && k < dataset_count; ++k) {
+        // Fixed seeds, so that runs can be compared.
+        ok = make_dataset(&datasets[k], names[k], n, 0x2545F4914F6CDD1DULL + k) &&
+             make_index(&datasets[k]) && make_column(&datasets[k]);
+        datasets[k].fences = ok ? OLC_GeofenceCreate(BENCH_FENCE_LENGTH, BENCH_FENCE_CELLS) : 0;
+        ok = ok && make_fences(&datasets[k], datasets[k].fences);
+    }
+    if (ok) {
+        localities = OLC_LocalityIndexCreate(datasets[1].locations, 0,
+                                             n < BENCH_LOCALITIES ? n : BENCH_LOCALITIES);
+        ok = localities != 0;
+    }
+    if (!ok) {
+        printf("Could not allocate %lu points\n", (unsigned long) n);
+        return 1;
+    }
+
+    printf("%-22s %-13s %3s %12s %14s %12s\n",
+           "bench", "dataset", "arg", "ns/op", "ops/s", "cycles/op");
+    size_t result_count = 0;
+    for (size_t j = 0; j < bench_count; ++j) {
+        if (filter && strncmp(benches[j].name, filter, strlen(filter)) != 0) {
+            continue;
+        }
+        for (int k = 0; k < dataset_count && result_count < BENCH_MAX_RESULTS; ++k) {
+            Result* result = &results[result_count++];
+            run_bench(&benches[j], &datasets[k], result);
+            printf("%-22s %-13s %3lu %12.2f %14.0f %12.1f\n",
+                   result->bench, result->dataset, (unsigned long) result->arg,
+                   result->ns_per_op, result->ops_per_sec, result->cycles_per_op);
+        }
+    }
+
+    if (json && !write_json(json, n, results, result_count)) {
+        printf("Could not write [%s]\n", json);
+        ok = 0;
+    }
+
+    OLC_LocalityIndexDestroy(localities);
+    for (int k = 0; k < dataset_count; ++k) {
+        free_dataset(&datasets[k]);
+    }
+    free(results);
+    free(scratch.status);
+    free(scratch.len);
+    free(scratch.block);
+    free(scratch.column);
+    free(scratch.corners_e7);
+    free(scratch.hi_lon);
+    free(scratch.hi_lat);
+    free(scratch.lo_lon);
+    free(scratch.lo_lat);
+    free(scratch.codes);
+    return ok ? 0 : 1;
+}
+
+// Runs a benchmark a few times and keeps the fastest run.
+static void run_bench(const Bench* bench, const Dataset* data, Result* result)
+{
+    double best_time = 0;
+    uint64_t best_cycles = 0;
+    size_t ops = 0;
+    for (int run = 0; run < BENCH_RUNS; ++run) {
+        double t0 = now();
+        uint64_t c0 = cycles();
+        ops = bench->func(data, bench->arg);
+        uint64_t c1 = cycles();
+        double t1 = now();
+        if (run == 0 || t1 - t0 < best_time) {
+            best_time = t1 - t0;
+            best_cycles = c1 - c0;
+        }
+    }
+
+    result->bench = bench->name;
+    result->dataset = data->name;
+    result->arg = bench->arg;
+    result->ops = ops;
+    result->ns_per_op = ops ? best_time * 1e9 / ops : 0;
+    result->ops_per_sec = best_time > 0 ? ops / best_time : 0;
+    result->cycles_per_op = ops ? (double) best_cycles / ops : 0;
+}
+
+static int write_json(const char* file, size_t n, const Result* results, size_t count)
+{
+    FILE* fp = fopen(file, "w");
+    if (!fp) {
+        return 0;
+    }
+    fprintf(fp, "{\n  \"points\": %lu,\n  \"runs\": %d,\n  \"results\": [\n",
+            (unsigned long) n, BENCH_RUNS);
+    for (size_t j = 0; j < count; ++j) {
+        const Result* result = &results[j];
+        fprintf(fp, "    {\"bench\": \"%s\", \"dataset\": \"%s\", \"arg\": %lu, \"ops\": %lu, "
+                "\"ns_per_op\": %.3f, \"ops_per_sec\": %.0f, \"cycles_per_op\": %.2f}%s\n",
+                result->bench, result->dataset, (unsigned long) result->arg,
+                (unsigned long) result->ops, result->ns_per_op, result->ops_per_sec,
+                result->cycles_per_op, j + 1 < count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+    return fclose(fp) == 0;
+}
+
+// Creates the points of a dataset, encoded with BENCH_LENGTH, except for the
+// mixed dataset, which uses every valid code length.
+static int make_dataset(Dataset* data, const char* name, size_t n, unsigned long long seed)
+{
+    static const OLC_LatLon cities[] = {
+        {  40.7128,  -74.0060 }, {  51.5074,   -0.1278 }, {  35.6762,  139.6503 },
+        { -33.8688,  151.2093 }, {  19.4326,  -99.1332 }, { -23.5505,  -46.6333 },
+        {  28.6139,   77.2090 }, {  31.2304,  121.4737 }, {  55.7558,   37.6173 },
+        {  30.0444,   31.2357 }, {   6.5244,    3.3792 }, {  47.3769,    8.5417 },
+        {   1.3521,  103.8198 }, {  37.7749, -122.4194 }, { -34.6037,  -58.3816 },
+        {  64.1466,  -21.9426 },
+    };
+    static const size_t lengths[] = { 2, 4, 6, 8, 10, 11, 12, 13, 14, 15 };
+
+    data->name = name;
+    data->n = n;
+    data->lat = malloc(n * sizeof(double));
+    data->lon = malloc(n * sizeof(double));
+    data->lat_e7 = malloc(n * sizeof(int32_t));
+    data->lon_e7 = malloc(n * sizeof(int32_t));
+    data->locations = malloc(n * sizeof(OLC_LatLon));
+    data->codes = malloc(n * BENCH_STRIDE);
+    data->packed = malloc(n * sizeof(OLC_Packed));
+    data->text = malloc(n * BENCH_TEXT_LINE);
+    data->text_size = 0;
+    if (!data->lat || !data->lon || !data->lat_e7 || !data->lon_e7 || !data->locations ||
+        !data->codes || !data->packed || !data->text) {
+        return 0;
+    }
+
+    unsigned long long state = seed;
+    for (size_t j = 0; j < n; ++j) {
+        double lat = random_unit(&state) * 180 - 90;
+        double lon = random_unit(&state) * 360 - 180;
+        size_t length = BENCH_LENGTH;
+        if (strcmp(name, "cities") == 0) {
+            // Roughly normal offsets of a few km around a city.
+            const OLC_LatLon* city = &cities[(size_t) (random_unit(&state) * 16)];
+            double dlat = random_unit(&state) + random_unit(&state) + random_unit(&state) - 1.5;
+            double dlon = random_unit(&state) + random_unit(&state) + random_unit(&state) - 1.5;
+            lat = city->lat + dlat * 0.1;
+            lon = city->lon + dlon * 0.1;
+        } else if (strcmp(name, "polar") == 0) {
+            lat = (random_unit(&state) < 0.5 ? 90 : -90) * (1 - random_unit(&state) * 1e-4);
+        } else if (strcmp(name, "antimeridian") == 0) {
+            lat = lat * 2 / 3;
+            lon = 179.99 + random_unit(&state) * 0.02;
+            if (lon >= 180) {
+                lon -= 360;
+            }
+        } else if (strcmp(name, "mixed") == 0) {
+            length = lengths[(size_t) (random_unit(&state) * 10)];
+        }
+        data->lat[j] = lat;
+        data->lon[j] = lon;
+        data->lat_e7[j] = (int32_t) (lat * 1e7 + (lat < 0 ? -0.5 : 0.5));
+        data->lon_e7[j] = (int32_t) (lon * 1e7 + (lon < 0 ? -0.5 : 0.5));
+        data->locations[j].lat = lat;
+        data->locations[j].lon = lon;
+        OLC_Encode(&data->locations[j], length, data->codes + j * BENCH_STRIDE, BENCH_STRIDE);
+        OLC_EncodePacked(&data->locations[j], length, &data->packed[j]);
+        data->text_size += sprintf(data->text + data->text_size,
+                                   "GET /search?q=coffee+shop&near=%s HTTP/1.1 200 id=%lu\n",
+                                   data->codes + j * BENCH_STRIDE, (unsigned long) j);
+    }
+    return 1;
+}
+
+// Writes an index with the number of each code as its payload, and maps it.
+static int make_index(Dataset* data)
+{
+    char* text = malloc(data->n * (BENCH_STRIDE + 24) + 1);
+    if (!text) {
+        return 0;
+    }
+    size_t size = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        size += sprintf(text + size, "%s,%lu\n", data->codes + j * BENCH_STRIDE, (unsigned long) j);
+    }
+    if (OLC_IndexBuild(BENCH_INDEX, text, size, ',', 0, 0)) {
+        data->index = OLC_IndexOpen(BENCH_INDEX);
+    }
+    remove(BENCH_INDEX);
+    free(text);
+    return data->index != 0;
+}
+
+// Sorts the packed codes and encodes them into blocks.
+static int make_column(Dataset* data)
+{
+    data->sorted = malloc(data->n * sizeof(OLC_Packed) + 1);
+    data->column = malloc(data->n * 10 + (data->n / OLC_COLUMN_BLOCK_CODES + 1) * OLC_COLUMN_HEADER_SIZE);
+    if (!data->sorted || !data->column) {
+        return 0;
+    }
+    memcpy(data->sorted, data->packed, data->n * sizeof(OLC_Packed));
+    qsort(data->sorted, data->n, sizeof(OLC_Packed), compare_packed);
+    data->column_size = 0;
+    for (size_t j = 0; j < data->n; j += OLC_COLUMN_BLOCK_CODES) {
+        size_t count = data->n - j < OLC_COLUMN_BLOCK_CODES ? data->n - j : OLC_COLUMN_BLOCK_CODES;
+        data->column_size += OLC_ColumnEncodeBlock(data->sorted + j, count,
+                                                   data->column + data->column_size);
+    }
+    return 1;
+}
+
+// Adds a fence around every BENCH_FENCE_EVERY-th point, a polygon with
+// jagged edges, cut off at the poles and the antimeridian.  Returns the
+// number of fences, or 0 on failure.
+static int make_fences(Dataset* data, OLC_Geofence* fences)
+{
+    int count = 0;
+    for (size_t j = 0; fences && j < data->n; j += BENCH_FENCE_EVERY) {
+        OLC_LatLon vertices[BENCH_FENCE_VERTICES];
+        for (int k = 0; k < BENCH_FENCE_VERTICES; ++k) {
+            double angle = 8 * atan(1) * k / BENCH_FENCE_VERTICES;
+            double radius = k % 2 ? 0.01 : 0.006;
+            double lat = data->lat[j] + radius * sin(angle);
+            double lon = data->lon[j] + radius * cos(angle);
+            vertices[k].lat = lat < -90 ? -90 : lat > 90 ? 90 : lat;
+            vertices[k].lon = lon < -180 ? -180 : lon > 180 ? 180 : lon;
+        }
+        if (!OLC_GeofenceSet(fences, count++, vertices, BENCH_FENCE_VERTICES)) {
+            return 0;
+        }
+    }
+    return count;
+}
+
+static void free_dataset(Dataset* data)
+{
+    OLC_GeofenceDestroy(data->fences);
+    free(data->column);
+    free(data->sorted);
+    OLC_IndexClose(data->index);
+    free(data->text);
+    free(data->packed);
+    free(data->codes);
+    free(data->locations);
+    free(data->lon_e7);
+    free(data->lat_e7);
+    free(data->lon);
+    free(data->lat);
+}
+
+static size_t bench_get_center(const Dataset* data, size_t arg)
+{
+    OLC_LatLon center;
+    double sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_CodeArea area = {
+            { data->lat[j], data->lon[j] },
+            { data->lat[j] + 0.000125, data->lon[j] + 0.000125 },
+            10,
+        };
+        OLC_GetCenter(&area, &center);
+        sum += center.lat;
+    }
+    sink ^= (uint64_t) sum;
+    return data->n;
+}
+
+static size_t bench_code_length(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_CodeLength(data->codes + j * BENCH_STRIDE, 0);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_is_valid(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_IsValid(data->codes + j * BENCH_STRIDE, 0);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_is_short(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_IsShort(data->codes + j * BENCH_STRIDE, 0);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_is_full(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_IsFull(data->codes + j * BENCH_STRIDE, 0);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+// The argument is the best instruction set to use.
+static size_t bench_validate_batch(const Dataset* data, size_t arg)
+{
+    OLC_SetSimd(arg);
+    sink ^= OLC_ValidateBatch(data->codes, BENCH_STRIDE, data->n, scratch.status);
+    OLC_SetSimd(OLC_SIMD_AVX2);
+    return data->n;
+}
+
+static size_t bench_encode(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_Encode(&data->locations[j], arg, scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+static size_t bench_encode_default(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_EncodeDefault(&data->locations[j], scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+static size_t bench_code_width(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_CodeWidth(j & 15);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_encode_batch(const Dataset* data, size_t arg)
+{
+    sink ^= OLC_EncodeBatch(data->lat, data->lon, data->n, arg, scratch.codes, BENCH_STRIDE);
+    return data->n;
+}
+
+static size_t bench_encode_batch_locations(const Dataset* data, size_t arg)
+{
+    sink ^= OLC_EncodeBatchLocations(data->locations, data->n, arg, scratch.codes, BENCH_STRIDE);
+    return data->n;
+}
+
+static size_t bench_parallel_encode_batch(const Dataset* data, size_t arg)
+{
+    sink ^= OLC_ParallelEncodeBatch(0, data->lat, data->lon, data->n, arg, scratch.codes, BENCH_STRIDE);
+    return data->n;
+}
+
+// Each point is encoded with all of kMultiLengths.
+static size_t bench_encode_multi(const Dataset* data, size_t arg)
+{
+    char codes[BENCH_MULTI * BENCH_STRIDE];
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_EncodeMulti(&data->locations[j], kMultiLengths, arg, codes, BENCH_STRIDE);
+        sum += codes[0];
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_encode_multi_batch(const Dataset* data, size_t arg)
+{
+    static char codes[BENCH_BATCH * BENCH_MULTI * BENCH_STRIDE];
+    for (size_t j = 0; j < data->n; j += BENCH_BATCH) {
+        size_t count = data->n - j < BENCH_BATCH ? data->n - j : BENCH_BATCH;
+        sink ^= OLC_EncodeMultiBatch(data->lat + j, data->lon + j, count,
+                                     kMultiLengths, arg, codes, BENCH_STRIDE);
+    }
+    return data->n;
+}
+
+static size_t bench_encode_e7(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_LatLonE7 location = { data->lat_e7[j], data->lon_e7[j] };
+        OLC_EncodeE7(&location, arg, scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+// A vehicle moving north east from each point, tracked with codes of the
+// given length.
+static size_t bench_tracker_update(const Dataset* data, size_t arg)
+{
+    OLC_Tracker tracker;
+    OLC_TrackerInit(&tracker, arg);
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_LatLon fix = data->locations[j];
+        for (int k = 0; k < BENCH_FIXES; ++k) {
+            fix.lat += 1e-5;
+            fix.lon += 1e-5;
+            sum += OLC_TrackerUpdate(&tracker, &fix);
+        }
+    }
+    sink ^= sum;
+    return data->n * BENCH_FIXES;
+}
+
+// The same fixes as bench_tracker_update, encoded one by one.
+static size_t bench_encode_fixes(const Dataset* data, size_t arg)
+{
+    char code[BENCH_STRIDE];
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_LatLon fix = data->locations[j];
+        for (int k = 0; k < BENCH_FIXES; ++k) {
+            fix.lat += 1e-5;
+            fix.lon += 1e-5;
+            sum += OLC_Encode(&fix, arg, code, sizeof(code));
+        }
+    }
+    sink ^= sum;
+    return data->n * BENCH_FIXES;
+}
+
+static size_t bench_encode_batch_e7(const Dataset* data, size_t arg)
+{
+    sink ^= OLC_EncodeBatchE7(data->lat_e7, data->lon_e7, data->n, arg, scratch.codes, BENCH_STRIDE);
+    return data->n;
+}
+
+static size_t bench_decode(const Dataset* data, size_t arg)
+{
+    OLC_CodeArea area;
+    for (size_t j = 0; j < data->n; ++j) {
+        scratch.len[j] = OLC_Decode(data->codes + j * BENCH_STRIDE, 0, &area);
+        scratch.lo_lat[j] = area.lo.lat;
+        scratch.lo_lon[j] = area.lo.lon;
+        scratch.hi_lat[j] = area.hi.lat;
+        scratch.hi_lon[j] = area.hi.lon;
+    }
+    return data->n;
+}
+
+static size_t bench_decode_e7(const Dataset* data, size_t arg)
+{
+    int32_t* corners = scratch.corners_e7;
+    size_t n = data->n;
+    OLC_CodeAreaE7 area;
+    for (size_t j = 0; j < n; ++j) {
+        scratch.len[j] = OLC_DecodeE7(data->codes + j * BENCH_STRIDE, 0, &area);
+        corners[j] = area.lo.lat;
+        corners[n + j] = area.lo.lon;
+        corners[2 * n + j] = area.hi.lat;
+        corners[3 * n + j] = area.hi.lon;
+    }
+    return data->n;
+}
+
+static size_t bench_decode_batch_e7(const Dataset* data, size_t arg)
+{
+    int32_t* corners = scratch.corners_e7;
+    size_t n = data->n;
+    sink ^= OLC_DecodeBatchE7(data->codes, BENCH_STRIDE, n,
+                              corners, corners + n, corners + 2 * n, corners + 3 * n,
+                              scratch.len, scratch.status);
+    return data->n;
+}
+
+// The argument is the best instruction set to use.
+static size_t bench_decode_batch(const Dataset* data, size_t arg)
+{
+    OLC_SetSimd(arg);
+    sink ^= OLC_DecodeBatch(data->codes, BENCH_STRIDE, data->n,
+                            scratch.lo_lat, scratch.lo_lon, scratch.hi_lat, scratch.hi_lon,
+                            scratch.len, scratch.status);
+    OLC_SetSimd(OLC_SIMD_AVX2);
+    return data->n;
+}
+
+static size_t bench_parallel_decode_batch(const Dataset* data, size_t arg)
+{
+    sink ^= OLC_ParallelDecodeBatch(0, data->codes, BENCH_STRIDE, data->n,
+                                    scratch.lo_lat, scratch.lo_lon, scratch.hi_lat, scratch.hi_lon,
+                                    scratch.len, scratch.status);
+    return data->n;
+}
+
+static size_t bench_pack(const Dataset* data, size_t arg)
+{
+    OLC_Packed sum = 0;
+    OLC_Packed packed;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_Pack(data->codes + j * BENCH_STRIDE, 0, &packed);
+        sum += packed;
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_unpack(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_Unpack(data->packed[j], scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+static size_t bench_encode_packed(const Dataset* data, size_t arg)
+{
+    OLC_Packed sum = 0;
+    OLC_Packed packed;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_EncodePacked(&data->locations[j], arg, &packed);
+        sum += packed;
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_decode_packed(const Dataset* data, size_t arg)
+{
+    OLC_CodeArea area;
+    double sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_DecodePacked(data->packed[j], &area);
+        sum += area.lo.lat;
+    }
+    sink ^= (uint64_t) sum;
+    return data->n;
+}
+
+static size_t bench_packed_length(const Dataset* data, size_t arg)
+{
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_PackedLength(data->packed[j]);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_packed_last_descendant(const Dataset* data, size_t arg)
+{
+    OLC_Packed sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_PackedLastDescendant(data->packed[j]);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+// A box of about 1 km around every n-th point.
+static size_t bench_cover_bbox(const Dataset* data, size_t arg)
+{
+    OLC_Packed cells[BENCH_MAX_CELLS];
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        OLC_LatLon lo = { data->lat[j] - 0.005, data->lon[j] - 0.005 };
+        OLC_LatLon hi = { data->lat[j] + 0.005, data->lon[j] + 0.005 };
+        sink ^= OLC_CoverBBox(&lo, &hi, 2, arg, BENCH_MAX_CELLS, cells);
+    }
+    return ops;
+}
+
+// A circle of 500 m around every n-th point.
+static size_t bench_cover_circle(const Dataset* data, size_t arg)
+{
+    OLC_Packed cells[BENCH_MAX_CELLS];
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        sink ^= OLC_CoverCircle(&data->locations[j], 500, 2, arg, BENCH_MAX_CELLS, cells);
+    }
+    return ops;
+}
+
+static size_t bench_neighbors(const Dataset* data, size_t arg)
+{
+    OLC_Packed neighbors[8];
+    OLC_Packed sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_Neighbors(data->packed[j], neighbors);
+        sum += neighbors[0];
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_kring(const Dataset* data, size_t arg)
+{
+    OLC_Packed cells[BENCH_MAX_CELLS];
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        sink ^= OLC_KRing(data->packed[j], arg, cells, BENCH_MAX_CELLS);
+    }
+    return ops;
+}
+
+static size_t bench_parent(const Dataset* data, size_t arg)
+{
+    char parent[BENCH_STRIDE];
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_Parent(data->codes + j * BENCH_STRIDE, 0, arg, parent, BENCH_STRIDE);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_children(const Dataset* data, size_t arg)
+{
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        sink ^= OLC_Children(data->codes + j * BENCH_STRIDE, 0, scratch.codes, BENCH_STRIDE);
+    }
+    return ops;
+}
+
+// Checks every code against the parent of the previous code (usually a
+// miss) and against its own parent (a hit).
+static size_t bench_contains(const Dataset* data, size_t arg)
+{
+    char parent[BENCH_STRIDE] = "";
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        const char* code = data->codes + j * BENCH_STRIDE;
+        sum += OLC_Contains(parent, 0, code, 0);
+        OLC_Parent(code, 0, arg, parent, BENCH_STRIDE);
+        sum += OLC_Contains(parent, 0, code, 0);
+    }
+    sink ^= sum;
+    return 2 * data->n;
+}
+
+static size_t bench_packed_parent(const Dataset* data, size_t arg)
+{
+    OLC_Packed sum = 0;
+    OLC_Packed parent;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_PackedParent(data->packed[j], arg, &parent);
+        sum += parent;
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+static size_t bench_packed_children(const Dataset* data, size_t arg)
+{
+    OLC_Packed children[400];
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        sink ^= OLC_PackedChildren(data->packed[j], children);
+    }
+    return ops;
+}
+
+static size_t bench_packed_contains(const Dataset* data, size_t arg)
+{
+    OLC_Packed parent = 0;
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_PackedContains(parent, data->packed[j]);
+        OLC_PackedParent(data->packed[j], arg, &parent);
+        sum += OLC_PackedContains(parent, data->packed[j]);
+    }
+    sink ^= sum;
+    return 2 * data->n;
+}
+
+// Shortens every code relative to its own location, which removes as many
+// digits as possible.
+static size_t bench_shorten(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_Shorten(data->codes + j * BENCH_STRIDE, 0, &data->locations[j],
+                    scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+// Recovers codes with arg leading digits removed, relative to their own
+// location.  Codes without digits after the separator are skipped.
+static size_t bench_recover_nearest(const Dataset* data, size_t arg)
+{
+    char code[BENCH_STRIDE];
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        const char* full = data->codes + j * BENCH_STRIDE;
+        if (full[arg - 1] == '0' || full[9] == '\0') {
+            continue;
+        }
+        OLC_RecoverNearest(full + arg, 0, &data->locations[j], code, BENCH_STRIDE);
+        sink ^= code[0];
+        ++ops;
+    }
+    return ops;
+}
+
+// Shortens the codes in blocks, each relative to the location of its first
+// code.
+static size_t bench_shorten_batch(const Dataset* data, size_t arg)
+{
+    uint8_t status[BENCH_BATCH];
+    for (size_t j = 0; j < data->n; j += BENCH_BATCH) {
+        size_t count = data->n - j < BENCH_BATCH ? data->n - j : BENCH_BATCH;
+        sink ^= OLC_ShortenBatch(data->codes + j * BENCH_STRIDE, BENCH_STRIDE, count,
+                                 &data->locations[j], scratch.codes + j * BENCH_STRIDE,
+                                 BENCH_STRIDE, status);
+    }
+    return data->n;
+}
+
+static size_t bench_shorten_best(const Dataset* data, size_t arg)
+{
+    size_t locality;
+    for (size_t j = 0; j < data->n; ++j) {
+        OLC_ShortenBest(data->codes + j * BENCH_STRIDE, 0, localities,
+                        scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE, &locality);
+    }
+    sink ^= scratch.codes[0];
+    return data->n;
+}
+
+// Recovers codes with arg leading digits removed, in blocks, each relative
+// to the location of its first code.  Removing the digits is part of the
+// measurement.
+static size_t bench_recover_nearest_batch(const Dataset* data, size_t arg)
+{
+    char shorts[BENCH_BATCH * BENCH_STRIDE];
+    uint8_t status[BENCH_BATCH];
+    for (size_t j = 0; j < data->n; j += BENCH_BATCH) {
+        size_t count = data->n - j < BENCH_BATCH ? data->n - j : BENCH_BATCH;
+        for (size_t k = 0; k < count; ++k) {
+            const char* full = data->codes + (j + k) * BENCH_STRIDE;
+            memcpy(shorts + k * BENCH_STRIDE, full + arg, BENCH_STRIDE - arg);
+        }
+        sink ^= OLC_RecoverNearestBatch(shorts, BENCH_STRIDE, count, &data->locations[j],
+                                        scratch.codes + j * BENCH_STRIDE, BENCH_STRIDE, status);
+    }
+    return data->n;
+}
+
+// Scans the log-like text of a dataset, one line per operation.  The
+// argument is the best instruction set to use.
+static size_t bench_scan_text(const Dataset* data, size_t arg)
+{
+    OLC_SetSimd(arg);
+    sink ^= OLC_ScanText(data->text, data->text_size, 0, 0);
+    OLC_SetSimd(OLC_SIMD_AVX2);
+    return data->n;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Time stamp counter, which counts reference cycles at a constant rate on
+// current x86 CPUs; 0 elsewhere.
+static uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// xorshift64*, returning a double in [0, 1).
+static double random_unit(unsigned long long* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+static size_t bench_index_find(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        size_t first;
+        sink ^= OLC_IndexFind(data->index, data->codes + j * BENCH_STRIDE, 0, &first) + first;
+    }
+    return data->n;
+}
+
+// All the records in the cell of arg digits around every point.
+static size_t bench_index_find_prefix(const Dataset* data, size_t arg)
+{
+    for (size_t j = 0; j < data->n; ++j) {
+        char parent[BENCH_STRIDE];
+        size_t first;
+        OLC_Parent(data->codes + j * BENCH_STRIDE, 0, arg, parent, sizeof(parent));
+        sink ^= OLC_IndexFindPrefix(data->index, parent, 0, &first) + first;
+    }
+    return data->n;
+}
+
+// A box of about 100 m around every n-th point.
+static size_t bench_index_find_bbox(const Dataset* data, size_t arg)
+{
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE, ++ops) {
+        OLC_LatLon lo = { data->lat[j] - 0.0005, data->lon[j] - 0.0005 };
+        OLC_LatLon hi = { data->lat[j] + 0.0005, data->lon[j] + 0.0005 };
+        sink ^= OLC_IndexFindBBox(data->index, &lo, &hi, index_found, 0);
+    }
+    return ops;
+}
+
+static int index_found(void* data, size_t record)
+{
+    sink ^= record;
+    return 0;
+}
+
+static size_t bench_column_encode(const Dataset* data, size_t arg)
+{
+    size_t size = 0;
+    for (size_t j = 0; j < data->n; j += OLC_COLUMN_BLOCK_CODES) {
+        size_t count = data->n - j < OLC_COLUMN_BLOCK_CODES ? data->n - j : OLC_COLUMN_BLOCK_CODES;
+        size += OLC_ColumnEncodeBlock(data->sorted + j, count, scratch.column + size);
+    }
+    sink ^= size;
+    return data->n;
+}
+
+static size_t bench_column_decode(const Dataset* data, size_t arg)
+{
+    size_t count = 0;
+    for (size_t pos = 0; pos < data->column_size; ) {
+        OLC_ColumnBlock info;
+        OLC_ColumnBlockInfo(data->column + pos, data->column_size - pos, &info);
+        count += OLC_ColumnDecodeBlock(data->column + pos, data->column_size - pos, scratch.block);
+        sink ^= scratch.block[0];
+        pos += info.size;
+    }
+    return count;
+}
+
+static size_t bench_encode_packed_multi(const Dataset* data, size_t arg)
+{
+    OLC_Packed packed[BENCH_MULTI];
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_EncodePackedMulti(&data->locations[j], kMultiLengths, arg, packed);
+        sum += packed[0];
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+// Every point counts in its cell of the last arg of kMultiLengths; the
+// longest is BENCH_LENGTH, so most of those cells hold a single point.
+static size_t bench_aggregator_add(const Dataset* data, size_t arg)
+{
+    OLC_Aggregator* agg = OLC_AggregatorCreate(kMultiLengths + BENCH_MULTI - arg, arg);
+    if (agg) {
+        OLC_AggregatorAdd(agg, data->lat, data->lon, 0, data->n);
+        sink ^= OLC_AggregatorSize(agg);
+    }
+    OLC_AggregatorDestroy(agg);
+    return data->n;
+}
+
+// Compiles the fences of a dataset with at most arg cells each.
+static size_t bench_geofence_set(const Dataset* data, size_t arg)
+{
+    OLC_Geofence* fences = OLC_GeofenceCreate(BENCH_FENCE_LENGTH, arg);
+    size_t count = make_fences((Dataset*) data, fences);
+    sink ^= fences ? OLC_GeofenceCells(fences, 0) : 0;
+    OLC_GeofenceDestroy(fences);
+    return count;
+}
+
+static size_t bench_geofence_find(const Dataset* data, size_t arg)
+{
+    size_t ids[BENCH_FENCE_IDS];
+    uint64_t sum = 0;
+    for (size_t j = 0; j < data->n; ++j) {
+        sum += OLC_GeofenceFind(data->fences, &data->locations[j], ids, BENCH_FENCE_IDS);
+    }
+    sink ^= sum;
+    return data->n;
+}
+
+// A route of three legs, a few hundred meters each, from every n-th point;
+// an op is a cell walked through.
+static size_t bench_traverse_polyline(const Dataset* data, size_t arg)
+{
+    size_t ops = 0;
+    for (size_t j = 0; j < data->n; j += BENCH_SPARSE) {
+        OLC_LatLon route[4] = {
+            { data->lat[j], data->lon[j] },
+            { data->lat[j] + 0.003, data->lon[j] + 0.001 },
+            { data->lat[j] + 0.004, data->lon[j] + 0.005 },
+            { data->lat[j] + 0.001, data->lon[j] + 0.006 },
+        };
+        ops += OLC_TraversePolyline(route, 4, arg, traverse_cell, 0);
+    }
+    return ops;
+}
+
+static int traverse_cell(void* data, OLC_Packed cell, double enter, double exit)
+{
+    sink ^= cell;
+    return 0;
+}
+
+static int compare_packed(const void* a, const void* b)
+{
+    OLC_Packed pa = *(const OLC_Packed*) a;
+    OLC_Packed pb = *(const OLC_Packed*) b;
+    return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
@@ -15,9 +15,10 @@ int main(int argc, char* argv[])
     // => "8FVC2222+22"
 
     // Encodes latitude and longitude into a Plus+Code with a preferred length.
+    // Codes have at most 15 digits, so this one gets truncated.
     len = OLC_Encode(&location, 16, code, 256);
     printf("%s (%d)\n", code, len);
-    // => "8FVC2222+22GCCCCC"
+    // => "8FVC2222+22GCCCC"
 
     // Decodes a Plus+Code back into coordinates.
     OLC_CodeArea code_area;
@@ -28,7 +29,7 @@ int main(int argc, char* argv[])
            code_area.hi.lat,
            code_area.hi.lon,
            code_area.len);
-    // => 47.000062496 8.00006250000001 47.000062504 8.0000625305176 16
+    // => 47.00006248 8.0000625 47.00006252 8.0000626220703 15
 
     int is_valid = OLC_IsValid(code, 0);
     printf("Is Valid: %d\n", is_valid);
@@ -0,0 +1,13 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "olc.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    char buf[256];
+    OLC_Packed packed;
+    if (OLC_Pack((const char*) Data, Size, &packed)) {
+        OLC_Unpack(packed, buf, 256);
+    }
+    return 0;
+}
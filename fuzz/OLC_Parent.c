@@ -0,0 +1,11 @@
+#include <stdint.h>
+#include <stddef.h>
+#include "olc.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    char buf[256];
+    OLC_Parent((const char*) Data, Size, 6, buf, 256);
+    OLC_Contains((const char*) Data, Size, (const char*) Data, Size);
+    return 0;
+}
@@ -0,0 +1,22 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "olc.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    const char* code = (const char*) Data;
+    OLC_Parsed parsed;
+    OLC_Parse(code, Size, &parsed);
+
+    // The parsed code must give the same answers as the string.
+    if (OLC_ParsedIsValid(&parsed) != OLC_IsValid(code, Size) ||
+        OLC_ParsedIsShort(&parsed) != OLC_IsShort(code, Size) ||
+        OLC_ParsedIsFull(&parsed) != OLC_IsFull(code, Size) ||
+        OLC_ParsedCodeLength(&parsed) != OLC_CodeLength(code, Size)) {
+        abort();
+    }
+    OLC_CodeArea area;
+    OLC_ParsedDecode(&parsed, &area);
+    return 0;
+}
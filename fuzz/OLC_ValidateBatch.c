@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "olc.h"
+
+#define MAX_CODES 64
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+    if (Size < 2) {
+        return 0;
+    }
+
+    // The first byte picks the width of the slots for the rest.
+    size_t stride = 1 + Data[0] % 40;
+    const char* codes = (const char*) Data + 1;
+    size_t n = (Size - 1) / stride;
+    if (n > MAX_CODES) {
+        n = MAX_CODES;
+    }
+
+    // Every instruction set must give the same statuses.
+    uint8_t expected[MAX_CODES];
+    uint8_t status[MAX_CODES];
+    OLC_SetSimd(OLC_SIMD_NONE);
+    size_t valid = OLC_ValidateBatch(codes, stride, n, expected);
+    for (int simd = OLC_SIMD_SSSE3; simd <= OLC_SIMD_AVX2; ++simd) {
+        OLC_SetSimd(simd);
+        if (OLC_ValidateBatch(codes, stride, n, status) != valid ||
+            memcmp(status, expected, n) != 0) {
+            abort();
+        }
+    }
+    return 0;
+}
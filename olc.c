@@ -1,13 +1,50 @@
-#include <ctype.h>
-#include <float.h>
+#if OLC_STATS
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <math.h>
 #include <memory.h>
 #include <stdlib.h>
 #include "olc.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define OLC_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if OLC_STATS
+#include <pthread.h>
+#include <time.h>
+
+// Statistics hooks; without OLC_STATS they expand to nothing.  REJECT is the
+// value analyse() returns for a code breaking a rule.
+#define STATS_START()         uint64_t stats_start = stats_ticks()
+#define STATS_END(api, items) stats_call((api), (items), stats_start)
+#define STATS_LENGTH(length)  stats_length(length)
+#define REJECT(rule)          (stats_reject(rule), 0)
+#else
+#define STATS_START()         do { } while (0)
+#define STATS_END(api, items) do { } while (0)
+#define STATS_LENGTH(length)  do { } while (0)
+#define REJECT(rule)          0
+#endif
+
 #define CORRECT_IF_SEPARATOR(var, info) \
     do { (var) += (info)->sep_first >= 0 ? 1 : 0; } while (0)
 
+// Number of locations normalised together by the batch encoder; the buffers
+// for a block live on the stack and should stay in L1.
+#define BATCH_BLOCK_SIZE 256
+
+// Number of codes analysed together by the batch decoder and friends.
+#define ANALYSE_BLOCK_SIZE 64
+
+// Classes of the characters in a code, as found in kCharClass: a digit has
+// its value plus one.
+#define CHAR_INVALID   0
+#define CHAR_PADDING   21
+#define CHAR_SEPARATOR 22
+
 static const char   kSeparator         = '+';
 static const size_t kSeparatorPosition = 8;
 static const size_t kMaximumDigitCount = 32;
@@ -15,9 +52,14 @@ static const char   kPaddingCharacter  = '0';
 static const char   kAlphabet[]        = "23456789CFGHJMPQRVWX";
 static const size_t kEncodingBase      = 20;
 static const size_t kPairCodeLength    = 10;
+static const size_t kGridCodeLength    = 5;
 static const size_t kGridCols          = 4;
 static const size_t kGridRows          = kEncodingBase / kGridCols;
 
+// Codes are encoded to, and decoded from, at most this many digits.  Longer
+// codes are valid, but their extra digits are ignored.
+static const size_t kMaxCodeLength     = OLC_MAX_DIGITS;
+
 // Latitude bounds are -kLatMaxDegrees degrees and +kLatMaxDegrees degrees
 // which we transpose to 0 and 180 degrees.
 static const double kLatMaxDegrees     = 90;
@@ -28,38 +70,265 @@ static const double kLatMaxDegreesT2   = 2 * kLatMaxDegrees;
 static const double kLonMaxDegrees     = 180;
 static const double kLonMaxDegreesT2   = 2 * kLonMaxDegrees;
 
-// These will be defined later, during runtime.
-static size_t kInitialExponent          = 0;
-static double kGridSizeDegrees          = 0.0;
-static double kInitialResolutionDegrees = 0.0;
-
-typedef struct CodeInfo {
-    const char* code;
-    int size;
-    int len;
-    int sep_first;
-    int sep_last;
-    int pad_first;
-    int pad_last;
-} CodeInfo;
+// Encoding and decoding work on integer steps of the finest resolution: one
+// pair cell of a full pair code (1/8000 degree), split by the five grid
+// levels into 5^5 latitude rows and 4^5 longitude columns.
+static const int64_t kGridLatSteps      = 3125;
+static const int64_t kGridLonBits       = 10;
+static const int64_t kGridLonSteps      = 1024;
+static const double  kLatStepsPerDegree = 25000000.0;
+static const double  kLonStepsPerDegree = 8192000.0;
+static const int64_t kLatSteps          = 4500000000LL;
+static const int64_t kLonSteps          = 2949120000LL;
+
+// E7 coordinates are in units of 1e-7 degree: a latitude step is 2/5 of a
+// unit and a longitude step 625/512 of one.
+static const int64_t kLatMaxE7          = 900000000;
+static const int64_t kLonMaxE7          = 1800000000;
+
+// Coordinates are rounded to this fraction of a step before truncating, so
+// that decimal values meant to be on a cell edge are not pushed into the cell
+// below by their binary representation.
+static const double  kStepRounding      = 1e6;
+
+// A location this many steps inside the cell of a tracker is in that cell,
+// whatever rounding latitude_to_steps() and longitude_to_steps() do, so that
+// it can be checked without them.
+static const double  kTrackerMargin     = 1e-3;
+
+// Mean radius of the Earth, used for distances.
+static const double  kEarthRadiusMeters = 6371008.8;
+static const double  kPi                = 3.14159265358979323846;
+
+// Height and width in degrees of the cells of codes of each length, up to
+// kMaxCodeLength.  Up to 10 digits, cells are as wide as they are high; each
+// grid digit after that splits a cell into 5 rows and 4 columns.
+static const double  kLatResolution[]   = {
+    400, 400, 20, 20, 1, 1, 1.0 / 20, 1.0 / 20, 1.0 / 400, 1.0 / 400, 1.0 / 8000,
+    1.0 / 40000, 1.0 / 200000, 1.0 / 1000000, 1.0 / 5000000, 1.0 / 25000000,
+};
+static const double  kLonResolution[]   = {
+    400, 400, 20, 20, 1, 1, 1.0 / 20, 1.0 / 20, 1.0 / 400, 1.0 / 400, 1.0 / 8000,
+    1.0 / 32000, 1.0 / 128000, 1.0 / 512000, 1.0 / 2048000, 1.0 / 8192000,
+};
+
+// Powers of the pair and grid row bases, indexed by exponent.
+static const int64_t kPairPowers[]      = { 1, 20, 400, 8000, 160000, 3200000 };
+static const int64_t kRowPowers[]       = { 1, 5, 25, 125, 625, 3125 };
+
+// A packed code is the rank of the code in a depth first walk over all full
+// codes, where a code comes right before the codes it contains and siblings
+// follow the alphabet order; so packed codes sort like the strings.  A code
+// is split into levels: the five pairs (the first one only has 9 x 18 legal
+// values) and then the five grid digits.  This is the number of codes in the
+// subtree of a code at each level, the code itself included.
+static const size_t   kPackedLevels     = 10;
+static const uint64_t kFirstLatValues   = 9;
+static const uint64_t kFirstLonValues   = 18;
+static const uint64_t kPackedSpan[]     = {
+    86231577664160401ULL, 215578944160401ULL, 538947360401ULL,
+    1347368401ULL, 3368421ULL, 168421ULL, 8421ULL, 421ULL, 21ULL, 1ULL,
+};
+
+// The class of each character, in both cases.  The SIMD code looks up the
+// classes of (case folded) characters in rows of 16 of this table.
+static const uint8_t  kCharClass[256]   = {
+    ['0'] = CHAR_PADDING, ['+'] = CHAR_SEPARATOR,
+    ['2'] =  1, ['3'] =  2, ['4'] =  3, ['5'] =  4, ['6'] =  5,
+    ['7'] =  6, ['8'] =  7, ['9'] =  8, ['C'] =  9, ['F'] = 10,
+    ['G'] = 11, ['H'] = 12, ['J'] = 13, ['M'] = 14, ['P'] = 15,
+    ['Q'] = 16, ['R'] = 17, ['V'] = 18, ['W'] = 19, ['X'] = 20,
+    ['c'] =  9, ['f'] = 10, ['g'] = 11, ['h'] = 12, ['j'] = 13,
+    ['m'] = 14, ['p'] = 15, ['q'] = 16, ['r'] = 17, ['v'] = 18,
+    ['w'] = 19, ['x'] = 20,
+};
+
+// The best instruction set the batch functions may use, see OLC_SetSimd().
+static int simd_limit = OLC_SIMD_AVX2;
+
+static const char* const kStatsApiNames[] = {
+    "CodeLength", "IsValid", "IsShort", "IsFull", "Parse", "Encode", "EncodeBatch",
+    "Decode", "DecodeBatch", "ValidateBatch", "Pack", "Unpack", "EncodePacked",
+    "DecodePacked", "Shorten", "ShortenBatch", "RecoverNearest",
+    "RecoverNearestBatch", "ScanText", "EncodeMulti", "EncodeMultiBatch",
+    "EncodeE7", "EncodeBatchE7", "DecodeE7", "DecodeBatchE7", "TrackerUpdate",
+    "EncodePackedMulti", "TraversePolyline",
+};
+static const char* const kStatsRejectNames[] = {
+    "null", "character", "empty", "no_separator", "separators", "separator_only",
+    "separator_position", "padding_first", "padding_position",
+    "padding_separator", "padding_gap", "single_digit", "too_long",
+    "too_long_after",
+};
+
+#if OLC_STATS
+// The counters of one thread.  Each thread only ever adds to its own
+// counters, with plain loads and stores that other threads may read at any
+// time; the counters of a thread that exits are added to stats_retired.
+typedef struct StatsBlock {
+    OLC_Stats stats;
+    struct StatsBlock* next;
+} StatsBlock;
+
+static pthread_once_t  stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t   stats_key;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static StatsBlock*     stats_threads;  // blocks of running threads
+static OLC_Stats       stats_retired;  // sum of the blocks of exited threads
+static OLC_Stats       stats_baseline; // sum of all blocks at the last reset
+static uint64_t        stats_origin_ticks;
+static uint64_t        stats_origin_ns;
+static __thread StatsBlock* stats_local;
+#endif
+
+// The structure of a code, as found by analyse(), along with its digits (up
+// to kMaxCodeLength of them); public as OLC_Parsed.
+typedef OLC_Parsed CodeInfo;
+
+// A cell as integer steps: its lower corner and its size.
+typedef struct CellSteps {
+    int64_t lat;
+    int64_t lon;
+    int64_t lat_size;
+    int64_t lon_size;
+} CellSteps;
+
+// A region to cover.  The bounding rectangle of its cells is in (inclusive)
+// steps; the longitude range goes past kLonSteps if it crosses the
+// antimeridian.  Circles also keep their center and radius.
+typedef struct Region {
+    int64_t lat_lo;
+    int64_t lat_hi;
+    int64_t lon_lo;
+    int64_t lon_hi;
+    int circle;
+    OLC_LatLon center;
+    double radius;
+} Region;
+
+// A reference location for shortening or recovering codes, prepared once for
+// any number of them: latitude clamped (but not yet adjusted for the length
+// of a code), longitude normalised, and the digits of its code.
+typedef struct Reference {
+    double lat;
+    double lon;
+    uint8_t digits[OLC_MAX_DIGITS];
+} Reference;
+
+// How a cell relates to a region.
+#define CELL_OUTSIDE 0
+#define CELL_PARTIAL 1
+#define CELL_INSIDE  2
 
 // Helper functions
 static int analyse(const char* code, size_t size, CodeInfo* info);
-static int is_short(CodeInfo* info);
-static int is_full(CodeInfo* info);
-static int decode(CodeInfo* info, OLC_CodeArea* decoded);
-static size_t code_length(CodeInfo* info);
-
-static void init_constants(void);
-static double pow_neg(double base, double exponent);
-static double compute_precision_for_length(int length);
-static int get_alphabet_position(char c);
+static size_t encode_batch(const double* lat, const double* lon, size_t n,
+                           size_t code_length, char* out, size_t stride);
+static size_t encode_batch_locations(const OLC_LatLon* locations, size_t n,
+                                     size_t code_length, char* out, size_t stride);
+static size_t encode_multi_batch(const double* lat, const double* lon, size_t n,
+                                 const size_t* lengths, size_t count,
+                                 char* out, size_t stride);
+static size_t decode_batch(const char* codes, size_t stride, size_t n,
+                           double* lo_lat, double* lo_lon,
+                           double* hi_lat, double* hi_lon,
+                           uint8_t* len, uint8_t* status);
+static size_t validate_batch(const char* codes, size_t stride, size_t n, uint8_t* status);
+static void encode_slots(const int64_t* lat, const int64_t* lon, size_t n,
+                         size_t code_length, char* out, size_t stride);
+static size_t encode_batch_e7(const int32_t* lat, const int32_t* lon, size_t n,
+                              size_t code_length, char* out, size_t stride);
+static size_t decode_batch_e7(const char* codes, size_t stride, size_t n,
+                              int32_t* lo_lat, int32_t* lo_lon,
+                              int32_t* hi_lat, int32_t* hi_lon,
+                              uint8_t* len, uint8_t* status);
+static int check_layout(CodeInfo* info);
+static void analyse_slot(const char* code, size_t stride, CodeInfo* info);
+static void analyse_batch(const char* codes, size_t stride, size_t n, CodeInfo* infos);
+#ifdef OLC_X86_SIMD
+static void analyse_masks(const char* code, size_t stride, const uint8_t* digits,
+                          unsigned nul, unsigned blank, unsigned bad,
+                          unsigned sep, unsigned pad, CodeInfo* info);
+static size_t analyse_ssse3(const char* codes, size_t stride, size_t n, CodeInfo* infos);
+static size_t analyse_avx2(const char* codes, size_t stride, size_t n, CodeInfo* infos);
+#endif
+static int simd_supported(void);
+static int is_word_char(char c);
+#if OLC_STATS
+static uint64_t stats_ticks(void);
+static uint64_t stats_ns(void);
+static void stats_init(void);
+static void stats_thread_exit(void* arg);
+static StatsBlock* stats_block(void);
+static void stats_add(uint64_t* counter, uint64_t value);
+static void stats_call(int api, uint64_t items, uint64_t start);
+static void stats_reject(int rule);
+static void stats_length(size_t length);
+static void stats_sum(OLC_Stats* sum);
+#endif
+static size_t find_separator(const char* text, size_t n, size_t pos);
+#ifdef OLC_X86_SIMD
+static size_t find_separator_sse2(const char* text, size_t n, size_t pos);
+static size_t find_separator_avx2(const char* text, size_t n, size_t pos);
+#endif
+static int is_short(const CodeInfo* info);
+static int is_full(const CodeInfo* info);
+static int decode(const CodeInfo* info, OLC_CodeArea* decoded);
+static size_t get_digits(const CodeInfo* info, uint8_t* digits);
+static void digits_to_steps(const uint8_t* digits, size_t count,
+                            CellSteps* cell);
+static void steps_to_area(const CellSteps* cell, size_t len,
+                          OLC_CodeArea* decoded);
+static size_t code_length(const CodeInfo* info);
+
 static double normalize_longitude(double lon_degrees);
 static double adjust_latitude(double lat_degrees, size_t length);
-static int encode_pairs(double lat, double lon, size_t length,
+static double degrees_to_steps(double degrees, double steps_per_degree);
+static int64_t latitude_to_steps(double lat_degrees);
+static int64_t longitude_to_steps(double lon_degrees);
+static int64_t latitude_e7_to_steps(int32_t lat_e7);
+static int64_t longitude_e7_to_steps(int32_t lon_e7);
+static void steps_to_area_e7(const CellSteps* cell, size_t len,
+                             OLC_CodeAreaE7* decoded);
+static size_t encoded_digits(size_t length);
+static int encode_steps(int64_t lat, int64_t lon, size_t length,
                         char* code, int maxlen);
-static int encode_grid(double lat, double lon, size_t length,
+static int encode_pairs(int64_t lat, int64_t lon, size_t length,
+                        char* code, int maxlen);
+static int encode_grid(int64_t lat, int64_t lon, size_t length,
                        char* code, int maxlen);
+static void steps_to_digits(int64_t lat, int64_t lon, uint8_t* digits);
+static int format_digits(const uint8_t* digits, size_t count,
+                         char* code, int maxlen);
+static size_t multi_width(const size_t* lengths, size_t count);
+static void tracker_digits(OLC_Tracker* tracker, int64_t lat, int64_t lon, size_t level);
+static void encode_multi(int64_t lat, int64_t lon, const size_t* lengths, size_t count,
+                         char* out, size_t stride, char fill);
+static int pack_digits(const uint8_t* digits, size_t count, OLC_Packed* packed);
+static size_t unpack_digits(OLC_Packed packed, uint8_t* digits);
+static size_t level_of_length(size_t length);
+static size_t length_of_level(size_t level);
+static void level_size(size_t level, int64_t* lat_size, int64_t* lon_size);
+static double distance_meters(double lat1, double lon1, double lat2, double lon2);
+static double cell_distance(double lat, double lon, double lat0, double lat1,
+                            double lon0, double lon1);
+static int classify(const Region* region, const CellSteps* cell);
+static size_t expand(const Region* region, OLC_Packed parent,
+                     const CellSteps* cell, size_t level, OLC_Packed* children);
+static size_t cover(const Region* region, size_t min_length, size_t max_length,
+                    size_t max_cells, OLC_Packed* cells);
+static int compare_packed(const void* a, const void* b);
+static double cell_offset(double steps, int64_t cell, int64_t size, int64_t around);
+static double next_crossing(double offset, double delta, int64_t step);
+static size_t ring(OLC_Packed code, size_t k, int skip_center,
+                   OLC_Packed* cells, size_t maxcount);
+static size_t get_full_digits(const char* code, size_t size, uint8_t* digits);
+static size_t slot_size(const char* code, size_t stride);
+static void make_reference(const OLC_LatLon* location, Reference* reference);
+static int shorten(const CodeInfo* info, const Reference* reference,
+                   char* shortened, int maxlen);
+static int recover(const CodeInfo* info, const Reference* reference,
+                   char* code, int maxlen);
 
 
 void OLC_GetCenter(const OLC_CodeArea* area, OLC_LatLon* center)
@@ -75,674 +344,2681 @@ void OLC_GetCenter(const OLC_CodeArea* area, OLC_LatLon* center)
     }
 }
 
-size_t OLC_CodeLength(const char* code, size_t size)
+int OLC_Parse(const char* code, size_t size, OLC_Parsed* parsed)
 {
-    CodeInfo info;
-    analyse(code, size, &info);
-    return code_length(&info);
+    STATS_START();
+    int valid = analyse(code, size, parsed) > 0;
+    STATS_END(OLC_API_PARSE, 1);
+    return valid;
 }
 
-int OLC_IsValid(const char* code, size_t size)
+size_t OLC_ParsedCodeLength(const OLC_Parsed* parsed)
 {
-    CodeInfo info;
-    return analyse(code, size, &info) > 0;
+    return code_length(parsed);
 }
 
-int OLC_IsShort(const char* code, size_t size)
+int OLC_ParsedIsValid(const OLC_Parsed* parsed)
 {
-    CodeInfo info;
-    if (analyse(code, size, &info) <= 0) {
-        return 0;
-    }
-    return is_short(&info);
+    return parsed->valid;
 }
 
-int OLC_IsFull(const char* code, size_t size)
+int OLC_ParsedIsShort(const OLC_Parsed* parsed)
 {
-    CodeInfo info;
-    if (analyse(code, size, &info) <= 0) {
-        return 0;
-    }
-    return is_full(&info);
+    return parsed->valid && is_short(parsed);
 }
 
-int OLC_Encode(const OLC_LatLon* location, size_t length,
-               char* code, int maxlen)
+int OLC_ParsedIsFull(const OLC_Parsed* parsed)
 {
-    int pos = 0;
-
-    // Limit the maximum number of digits in the code.
-    if (length > kMaximumDigitCount) {
-        length = kMaximumDigitCount;
-    }
-
-    // Adjust latitude and longitude so they fall into positive ranges.
-    double lat = adjust_latitude(location->lat, length) + kLatMaxDegrees;
-    double lon = normalize_longitude(location->lon) + kLonMaxDegrees;
-    size_t len = length;
-    if (len > kPairCodeLength) {
-        len = kPairCodeLength;
-    }
-    pos += encode_pairs(lat, lon, len, code + pos, maxlen - pos);
-    // If the requested length indicates we want grid refined codes.
-    if (length > kPairCodeLength) {
-        pos += encode_grid(lat, lon, length - kPairCodeLength, code + pos, maxlen - pos);
-    }
-    code[pos] = '\0';
-    return pos;
+    return parsed->valid && is_full(parsed);
 }
 
-int OLC_EncodeDefault(const OLC_LatLon* location,
-                      char* code, int maxlen)
+int OLC_ParsedDecode(const OLC_Parsed* parsed, OLC_CodeArea* decoded)
 {
-    return OLC_Encode(location, kPairCodeLength, code, maxlen);
+    if (!parsed->valid) {
+        return 0;
+    }
+    return decode(parsed, decoded);
 }
 
-int OLC_Decode(const char* code, size_t size, OLC_CodeArea* decoded)
+int OLC_ParsedShorten(const OLC_Parsed* parsed, const OLC_LatLon* reference,
+                      char* buf, int maxlen)
 {
-    CodeInfo info;
-    if (analyse(code, size, &info) <= 0) {
+    if (!parsed->valid) {
         return 0;
     }
-    return decode(&info, decoded);
+    Reference ref;
+    make_reference(reference, &ref);
+    return shorten(parsed, &ref, buf, maxlen);
 }
 
-int OLC_Shorten(const char* code, size_t size, const OLC_LatLon* reference,
-                char* shortened, int maxlen)
+int OLC_ParsedRecoverNearest(const OLC_Parsed* parsed, const OLC_LatLon* reference,
+                             char* code, int maxlen)
 {
-    CodeInfo info;
-    if (analyse(code, size, &info) <= 0) {
-        return 0;
-    }
-    if (info.pad_first > 0) {
-        return 0;
-    }
-    if (!is_full(&info)) {
+    if (!parsed->valid) {
         return 0;
     }
+    Reference ref;
+    make_reference(reference, &ref);
+    return recover(parsed, &ref, code, maxlen);
+}
 
-    OLC_CodeArea code_area;
-    decode(&info, &code_area);
-    OLC_LatLon center;
-    OLC_GetCenter(&code_area, &center);
+size_t OLC_CodeLength(const char* code, size_t size)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(code, size, &parsed);
+    size_t length = OLC_ParsedCodeLength(&parsed);
+    STATS_END(OLC_API_CODE_LENGTH, 1);
+    return length;
+}
 
-    // Ensure that latitude and longitude are valid.
-    double lat = adjust_latitude(reference->lat, info.len);
-    double lon = normalize_longitude(reference->lon);
+int OLC_IsValid(const char* code, size_t size)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    int valid = analyse(code, size, &parsed) > 0;
+    STATS_END(OLC_API_IS_VALID, 1);
+    return valid;
+}
 
-    // How close are the latitude and longitude to the code center.
-    double alat = fabs(center.lat - lat);
-    double alon = fabs(center.lon - lon);
-    double range = alat > alon ? alat : alon;
+int OLC_IsShort(const char* code, size_t size)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(code, size, &parsed);
+    int result = OLC_ParsedIsShort(&parsed);
+    STATS_END(OLC_API_IS_SHORT, 1);
+    return result;
+}
 
-    // Yes, magic numbers... sob.
-    int start = 0;
-    const double safety_factor = 0.3;
-    const int removal_lengths[3] = { 8, 6, 4 };
-    for (int j = 0; j < sizeof(removal_lengths) / sizeof(removal_lengths[0]); ++j) {
-        // Check if we're close enough to shorten. The range must be less than
-        // 1/2 the resolution to shorten at all, and we want to allow some
-        // safety, so use 0.3 instead of 0.5 as a multiplier.
-        int removal_length = removal_lengths[j];
-        double area_edge = compute_precision_for_length(removal_length) * safety_factor;
-        if (range < area_edge) {
-            start = removal_length;
-            break;
-        }
-    }
-    int pos = 0;
-    for (int j = start; j < info.size && code[j] != '\0'; ++j) {
-        shortened[pos++] = code[j];
-    }
-    shortened[pos] = '\0';
-    return pos;
+int OLC_IsFull(const char* code, size_t size)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(code, size, &parsed);
+    int result = OLC_ParsedIsFull(&parsed);
+    STATS_END(OLC_API_IS_FULL, 1);
+    return result;
 }
 
-int OLC_RecoverNearest(const char* short_code, size_t size, const OLC_LatLon* reference,
-                       char* code, int maxlen)
+int OLC_Encode(const OLC_LatLon* location, size_t length,
+               char* code, int maxlen)
 {
-    CodeInfo info;
-    if (analyse(short_code, size, &info) <= 0) {
-        return 0;
-    }
-    if (!is_short(&info)) {
-        return 0;
-    }
-    int len = code_length(&info);
+    STATS_START();
+    // Convert latitude and longitude into positive ranges of integer steps.
+    int64_t lat = latitude_to_steps(location->lat);
+    int64_t lon = longitude_to_steps(location->lon);
+    int len = encode_steps(lat, lon, length, code, maxlen);
+    STATS_END(OLC_API_ENCODE, 1);
+    return len;
+}
 
-    // Ensure that latitude and longitude are valid.
-    double lat = adjust_latitude(reference->lat, len);
-    double lon = normalize_longitude(reference->lon);
+int OLC_EncodeDefault(const OLC_LatLon* location,
+                      char* code, int maxlen)
+{
+    return OLC_Encode(location, kPairCodeLength, code, maxlen);
+}
 
-    // Compute the number of digits we need to recover.
-    size_t padding_length = kSeparatorPosition;
-    if (info.sep_first >= 0) {
-        padding_length -= info.sep_first;
+size_t OLC_CodeWidth(size_t code_length)
+{
+    size_t digits = encoded_digits(code_length);
+    if (digits < kSeparatorPosition) {
+        digits = kSeparatorPosition;
     }
+    return digits + 1;
+}
 
-    // The resolution (height and width) of the padded area in degrees.
-    double resolution = pow_neg(kEncodingBase, 2.0 - (padding_length / 2.0));
+size_t OLC_EncodedLength(size_t code_length)
+{
+    return encoded_digits(code_length);
+}
 
-    // Distance from the center to an edge (in degrees).
-    double half_res = resolution / 2.0;
+size_t OLC_EncodeBatch(const double* lat, const double* lon, size_t n,
+                       size_t code_length, char* out, size_t stride)
+{
+    STATS_START();
+    size_t width = encode_batch(lat, lon, n, code_length, out, stride);
+    STATS_END(OLC_API_ENCODE_BATCH, n);
+    return width;
+}
 
-    // Use the reference location to pad the supplied short code and decode it.
-    OLC_LatLon latlon = {lat, lon};
-    char encoded[256];
-    OLC_EncodeDefault(&latlon, encoded, 256);
+size_t OLC_EncodeBatchLocations(const OLC_LatLon* locations, size_t n,
+                                size_t code_length, char* out, size_t stride)
+{
+    STATS_START();
+    size_t width = encode_batch_locations(locations, n, code_length, out, stride);
+    STATS_END(OLC_API_ENCODE_BATCH, n);
+    return width;
+}
 
-    char new_code[256];
-    int pos = 0;
-    for (int j = 0; encoded[j] != '\0'; ++j) {
-        if (j >= padding_length) {
-            break;
-        }
-        new_code[pos++] = encoded[j];
-    }
-    for (int j = 0; j < info.size && short_code[j] != '\0'; ++j) {
-        new_code[pos++] = short_code[j];
-    }
-    new_code[pos] = '\0';
-    if (analyse(new_code, pos, &info) <= 0) {
-        return 0;
-    }
+int OLC_EncodeMulti(const OLC_LatLon* location, const size_t* lengths, size_t n,
+                    char* out, size_t stride)
+{
+    STATS_START();
+    int count = 0;
+    // Every slot needs room for the NUL too.
+    if (multi_width(lengths, n) < stride) {
+        encode_multi(latitude_to_steps(location->lat), longitude_to_steps(location->lon),
+                     lengths, n, out, stride, '\0');
+        count = n;
+    }
+    STATS_END(OLC_API_ENCODE_MULTI, 1);
+    return count;
+}
 
-    OLC_CodeArea code_area;
-    decode(&info, &code_area);
-    OLC_LatLon center;
-    OLC_GetCenter(&code_area, &center);
+size_t OLC_EncodeMultiBatch(const double* lat, const double* lon, size_t n,
+                            const size_t* lengths, size_t count,
+                            char* out, size_t stride)
+{
+    STATS_START();
+    size_t width = encode_multi_batch(lat, lon, n, lengths, count, out, stride);
+    STATS_END(OLC_API_ENCODE_MULTI_BATCH, n);
+    return width;
+}
 
-    // How many degrees latitude is the code from the reference?
-    if (lat + half_res < center.lat && center.lat - resolution > -kLatMaxDegrees) {
-        // If the proposed code is more than half a cell north of the reference
-        // location, it's too far, and the best match will be one cell south.
-        center.lat -= resolution;
-    } else if (lat - half_res > center.lat && center.lat + resolution < kLatMaxDegrees) {
-        // If the proposed code is more than half a cell south of the reference
-        // location, it's too far, and the best match will be one cell north.
-        center.lat += resolution;
-    }
+int OLC_Decode(const char* code, size_t size, OLC_CodeArea* decoded)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(code, size, &parsed);
+    int len = OLC_ParsedDecode(&parsed, decoded);
+    STATS_END(OLC_API_DECODE, 1);
+    return len;
+}
 
-    // How many degrees longitude is the code from the reference?
-    if (lon + half_res < center.lon) {
-        center.lon -= resolution;
-    } else if (lon - half_res > center.lon) {
-        center.lon += resolution;
-    }
+size_t OLC_DecodeBatch(const char* codes, size_t stride, size_t n,
+                       double* lo_lat, double* lo_lon,
+                       double* hi_lat, double* hi_lon,
+                       uint8_t* len, uint8_t* status)
+{
+    STATS_START();
+    size_t decoded = decode_batch(codes, stride, n, lo_lat, lo_lon, hi_lat, hi_lon,
+                                  len, status);
+    STATS_END(OLC_API_DECODE_BATCH, n);
+    return decoded;
+}
 
-    return OLC_Encode(&center, len + padding_length, code, maxlen);
+size_t OLC_ValidateBatch(const char* codes, size_t stride, size_t n, uint8_t* status)
+{
+    STATS_START();
+    size_t valid = validate_batch(codes, stride, n, status);
+    STATS_END(OLC_API_VALIDATE_BATCH, n);
+    return valid;
 }
 
+int OLC_EncodeE7(const OLC_LatLonE7* location, size_t code_length,
+                 char* code, int maxlen)
+{
+    STATS_START();
+    int len = encode_steps(latitude_e7_to_steps(location->lat),
+                           longitude_e7_to_steps(location->lon),
+                           code_length, code, maxlen);
+    STATS_END(OLC_API_ENCODE_E7, 1);
+    return len;
+}
 
-// private functions
+size_t OLC_EncodeBatchE7(const int32_t* lat, const int32_t* lon, size_t n,
+                         size_t code_length, char* out, size_t stride)
+{
+    STATS_START();
+    size_t width = encode_batch_e7(lat, lon, n, code_length, out, stride);
+    STATS_END(OLC_API_ENCODE_BATCH_E7, n);
+    return width;
+}
 
-static int analyse(const char* code, size_t size, CodeInfo* info)
+int OLC_DecodeE7(const char* code, size_t size, OLC_CodeAreaE7* decoded)
 {
-    memset(info, 0, sizeof(CodeInfo));
+    STATS_START();
+    CodeInfo info;
+    int len = 0;
+    if (analyse(code, size, &info) > 0) {
+        CellSteps cell;
+        digits_to_steps(info.digits, info.count, &cell);
+        steps_to_area_e7(&cell, info.count, decoded);
+        len = decoded->len;
+    }
+    STATS_END(OLC_API_DECODE_E7, 1);
+    return len;
+}
 
-    // null code is not valid
-    if (!code) {
+size_t OLC_DecodeBatchE7(const char* codes, size_t stride, size_t n,
+                         int32_t* lo_lat, int32_t* lo_lon,
+                         int32_t* hi_lat, int32_t* hi_lon,
+                         uint8_t* len, uint8_t* status)
+{
+    STATS_START();
+    size_t decoded = decode_batch_e7(codes, stride, n, lo_lat, lo_lon, hi_lat, hi_lon,
+                                     len, status);
+    STATS_END(OLC_API_DECODE_BATCH_E7, n);
+    return decoded;
+}
+
+void OLC_TrackerInit(OLC_Tracker* tracker, size_t code_length)
+{
+    memset(tracker, 0, sizeof(OLC_Tracker));
+    tracker->length = encoded_digits(code_length);
+}
+
+int OLC_TrackerUpdate(OLC_Tracker* tracker, const OLC_LatLon* location)
+{
+    STATS_START();
+    double lat_steps = (location->lat + kLatMaxDegrees) * kLatStepsPerDegree;
+    double lon_steps = (location->lon + kLonMaxDegrees) * kLonStepsPerDegree;
+    if (lat_steps >= tracker->inside[0] && lat_steps < tracker->inside[1] &&
+        lon_steps >= tracker->inside[2] && lon_steps < tracker->inside[3]) {
+        tracker->changed = 0;
+        STATS_END(OLC_API_TRACKER_UPDATE, 1);
         return 0;
     }
-    if (!size || size > kMaximumDigitCount) {
-        size = kMaximumDigitCount;
+    int64_t lat = latitude_to_steps(location->lat);
+    int64_t lon = longitude_to_steps(location->lon);
+
+    // Cells nest, so going from the cell of the code to coarser ones, the
+    // first that still holds the location is the last one that did not
+    // change.  Usually that is the first one tried.
+    size_t levels = tracker->levels;
+    while (levels > 0) {
+        int64_t lat_size;
+        int64_t lon_size;
+        level_size(levels - 1, &lat_size, &lon_size);
+        int64_t dlat = lat - tracker->lat[levels - 1];
+        int64_t dlon = lon - tracker->lon[levels - 1];
+        if (dlat >= 0 && dlat < lat_size && dlon >= 0 && dlon < lon_size) {
+            break;
+        }
+        --levels;
     }
 
-    info->code = code;
-    info->size = size;
-    info->sep_first = -1;
-    info->sep_last = -1;
-    info->pad_first = -1;
-    info->pad_last = -1;
-    int j = 0;
-    for (j = 0; j < size && code[j] != '\0'; ++j) {
-        int ok = 0;
+    tracker->changed = 0;
+    if (levels < (size_t) tracker->levels || !tracker->levels) {
+        tracker_digits(tracker, lat, lon, levels);
+        tracker->changed = length_of_level(levels);
+    }
+    STATS_END(OLC_API_TRACKER_UPDATE, 1);
+    return tracker->changed;
+}
 
-        // if this is a padding character, remember it
-        if (!ok && code[j] == kPaddingCharacter) {
-            if (info->pad_first < 0) {
-                info->pad_first = j;
-            }
-            info->pad_last = j;
-            ok = 1;
-        }
+int OLC_TrackerChanged(const OLC_Tracker* tracker, size_t code_length)
+{
+    return tracker->changed && tracker->changed <= (int) encoded_digits(code_length);
+}
 
-        // if this is a separator character, remember it
-        if (!ok && code[j] == kSeparator) {
-            if (info->sep_first < 0) {
-                info->sep_first = j;
-            }
-            info->sep_last = j;
-            ok = 1;
+int OLC_TrackerCode(const OLC_Tracker* tracker, char* code, int maxlen)
+{
+    if (!tracker->levels) {
+        if (maxlen > 0) {
+            code[0] = '\0';
         }
+        return 0;
+    }
+    return format_digits(tracker->digits, tracker->length, code, maxlen);
+}
+
+// Encodes a batch, see OLC_EncodeBatch.
+static size_t encode_batch(const double* lat, const double* lon, size_t n,
+                           size_t code_length, char* out, size_t stride)
+{
+    size_t width = OLC_CodeWidth(code_length);
+    if (stride < width) {
+        return 0;
+    }
 
-        // only accept characters in the valid character set
-        if (!ok && get_alphabet_position(toupper(code[j])) >= 0) {
-            ok = 1;
+    int64_t block_lat[BATCH_BLOCK_SIZE];
+    int64_t block_lon[BATCH_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_BLOCK_SIZE) {
+        size_t count = n - base;
+        if (count > BATCH_BLOCK_SIZE) {
+            count = BATCH_BLOCK_SIZE;
         }
 
-        // didn't find anything expected => bail out
-        if (!ok) {
-            return 0;
+        // Convert the whole block into integer steps.  The conversions are
+        // branch free, so this loop can be vectorized.
+        for (size_t j = 0; j < count; ++j) {
+            block_lat[j] = latitude_to_steps(lat[base + j]);
+            block_lon[j] = longitude_to_steps(lon[base + j]);
         }
+        encode_slots(block_lat, block_lon, count, code_length, out + base * stride, stride);
     }
+    return width;
+}
 
-    // so far, code only has valid characters -- good
-    info->len = j;
-
-    // Cannot be empty
-    if (info->len <= 0) {
-        return 0;
+// Encodes n locations, given as integer steps, into slots of stride bytes,
+// which must have room for the codes.
+static void encode_slots(const int64_t* lat, const int64_t* lon, size_t n,
+                         size_t code_length, char* out, size_t stride)
+{
+    size_t width = OLC_CodeWidth(code_length);
+    char code[kMaximumDigitCount + 2];
+    for (size_t j = 0; j < n; ++j) {
+        char* slot = out + j * stride;
+        if (stride > width) {
+            // Encode in place; the NUL then becomes the first blank.
+            encode_steps(lat[j], lon[j], code_length, slot, stride);
+            memset(slot + width, ' ', stride - width);
+        } else {
+            encode_steps(lat[j], lon[j], code_length, code, sizeof(code));
+            memcpy(slot, code, width);
+        }
     }
+}
 
-    // The separator is required.
-    if (info->sep_first < 0) {
+static size_t encode_batch_e7(const int32_t* lat, const int32_t* lon, size_t n,
+                              size_t code_length, char* out, size_t stride)
+{
+    size_t width = OLC_CodeWidth(code_length);
+    if (stride < width) {
         return 0;
     }
 
-    // There can be only one... separator.
-    if (info->sep_last > info->sep_first) {
-        return 0;
+    int64_t block_lat[BATCH_BLOCK_SIZE];
+    int64_t block_lon[BATCH_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_BLOCK_SIZE) {
+        size_t count = n - base;
+        if (count > BATCH_BLOCK_SIZE) {
+            count = BATCH_BLOCK_SIZE;
+        }
+        for (size_t j = 0; j < count; ++j) {
+            block_lat[j] = latitude_e7_to_steps(lat[base + j]);
+            block_lon[j] = longitude_e7_to_steps(lon[base + j]);
+        }
+        encode_slots(block_lat, block_lon, count, code_length, out + base * stride, stride);
     }
+    return width;
+}
 
-    // separator cannot be the only character
-    if (info->len == 1) {
+static size_t encode_batch_locations(const OLC_LatLon* locations, size_t n,
+                                     size_t code_length, char* out, size_t stride)
+{
+    size_t width = OLC_CodeWidth(code_length);
+    if (stride < width) {
         return 0;
     }
 
-    // Is the separator in an illegal position?
-    if (info->sep_first > kSeparatorPosition || (info->sep_first % 2)) {
-        return 0;
+    double lat[BATCH_BLOCK_SIZE];
+    double lon[BATCH_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_BLOCK_SIZE) {
+        size_t count = n - base;
+        if (count > BATCH_BLOCK_SIZE) {
+            count = BATCH_BLOCK_SIZE;
+        }
+        for (size_t j = 0; j < count; ++j) {
+            lat[j] = locations[base + j].lat;
+            lon[j] = locations[base + j].lon;
+        }
+        encode_batch(lat, lon, count, code_length, out + base * stride, stride);
     }
+    return width;
+}
 
-    // padding cannot be at the initial position
-    if (info->pad_first == 0) {
+static size_t encode_multi_batch(const double* lat, const double* lon, size_t n,
+                                 const size_t* lengths, size_t count,
+                                 char* out, size_t stride)
+{
+    size_t width = multi_width(lengths, count);
+    if (stride < width) {
         return 0;
     }
 
-    // We can have an even number of padding characters before the separator,
-    // but then it must be the final character.
-    if (info->pad_first > 0) {
-        // The first padding character needs to be in an odd position.
-        if (info->pad_first % 2) {
-            return 0;
+    int64_t block_lat[BATCH_BLOCK_SIZE];
+    int64_t block_lon[BATCH_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += BATCH_BLOCK_SIZE) {
+        size_t block = n - base;
+        if (block > BATCH_BLOCK_SIZE) {
+            block = BATCH_BLOCK_SIZE;
         }
-
-        // With padding, the separator must be the final character
-        if (info->sep_last < info->len - 1) {
-            return 0;
+        for (size_t j = 0; j < block; ++j) {
+            block_lat[j] = latitude_to_steps(lat[base + j]);
+            block_lon[j] = longitude_to_steps(lon[base + j]);
         }
-
-        // After removing padding characters, we mustn't have anything left.
-        if (info->pad_last < info->sep_first - 1) {
-            return 0;
+        for (size_t j = 0; j < block; ++j) {
+            encode_multi(block_lat[j], block_lon[j], lengths, count,
+                         out + (base + j) * count * stride, stride, ' ');
         }
     }
+    return width;
+}
 
-    // If there are characters after the separator, make sure there isn't just
-    // one of them (not legal).
-    if (info->len - info->sep_first - 1 == 1) {
-        return 0;
-    }
+static size_t decode_batch(const char* codes, size_t stride, size_t n,
+                           double* lo_lat, double* lo_lon,
+                           double* hi_lat, double* hi_lon,
+                           uint8_t* len, uint8_t* status)
+{
+    size_t decoded = 0;
+    CodeInfo infos[ANALYSE_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += ANALYSE_BLOCK_SIZE) {
+        size_t count = n - base < ANALYSE_BLOCK_SIZE ? n - base : ANALYSE_BLOCK_SIZE;
+        analyse_batch(codes + base * stride, stride, count, infos);
+        for (size_t k = 0; k < count; ++k) {
+            const CodeInfo* info = &infos[k];
+            size_t j = base + k;
+            OLC_CodeArea area;
+            uint8_t result = OLC_STATUS_INVALID;
+            if (info->valid) {
+                result = is_full(info) ? OLC_STATUS_OK : OLC_STATUS_SHORT;
+            }
+            status[j] = result;
+            if (result != OLC_STATUS_OK) {
+                lo_lat[j] = lo_lon[j] = hi_lat[j] = hi_lon[j] = NAN;
+                len[j] = 0;
+                continue;
+            }
 
-    // Make sure the code does not have too many digits in total.
-    if (info->len - 1 > kMaximumDigitCount) {
-        return 0;
+            decode(info, &area);
+            lo_lat[j] = area.lo.lat;
+            lo_lon[j] = area.lo.lon;
+            hi_lat[j] = area.hi.lat;
+            hi_lon[j] = area.hi.lon;
+            len[j] = area.len;
+            ++decoded;
+        }
     }
+    return decoded;
+}
 
-    // Make sure the code does not have too many digits after the separator.
-    // The number of digits is the length of the code, minus the position of
-    // the separator, minus one because the separator position is zero indexed.
-    if (info->len - info->sep_first - 1 > kMaximumDigitCount - kSeparatorPosition) {
-        return 0;
-    }
+static size_t decode_batch_e7(const char* codes, size_t stride, size_t n,
+                              int32_t* lo_lat, int32_t* lo_lon,
+                              int32_t* hi_lat, int32_t* hi_lon,
+                              uint8_t* len, uint8_t* status)
+{
+    size_t decoded = 0;
+    CodeInfo infos[ANALYSE_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += ANALYSE_BLOCK_SIZE) {
+        size_t count = n - base < ANALYSE_BLOCK_SIZE ? n - base : ANALYSE_BLOCK_SIZE;
+        analyse_batch(codes + base * stride, stride, count, infos);
+        for (size_t k = 0; k < count; ++k) {
+            const CodeInfo* info = &infos[k];
+            size_t j = base + k;
+            uint8_t result = OLC_STATUS_INVALID;
+            if (info->valid) {
+                result = is_full(info) ? OLC_STATUS_OK : OLC_STATUS_SHORT;
+            }
+            status[j] = result;
+            if (result != OLC_STATUS_OK) {
+                lo_lat[j] = lo_lon[j] = hi_lat[j] = hi_lon[j] = 0;
+                len[j] = 0;
+                continue;
+            }
 
-    return info->len;
+            CellSteps cell;
+            OLC_CodeAreaE7 area;
+            digits_to_steps(info->digits, info->count, &cell);
+            steps_to_area_e7(&cell, info->count, &area);
+            lo_lat[j] = area.lo.lat;
+            lo_lon[j] = area.lo.lon;
+            hi_lat[j] = area.hi.lat;
+            hi_lon[j] = area.hi.lon;
+            len[j] = area.len;
+            ++decoded;
+        }
+    }
+    return decoded;
 }
 
-static int is_short(CodeInfo* info)
+static size_t validate_batch(const char* codes, size_t stride, size_t n, uint8_t* status)
 {
-    if (info->len <= 0) {
-        return 0;
+    size_t valid = 0;
+    CodeInfo infos[ANALYSE_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += ANALYSE_BLOCK_SIZE) {
+        size_t count = n - base < ANALYSE_BLOCK_SIZE ? n - base : ANALYSE_BLOCK_SIZE;
+        analyse_batch(codes + base * stride, stride, count, infos);
+        for (size_t k = 0; k < count; ++k) {
+            uint8_t result = OLC_STATUS_INVALID;
+            if (infos[k].valid) {
+                result = is_full(&infos[k]) ? OLC_STATUS_OK : OLC_STATUS_SHORT;
+                ++valid;
+            }
+            status[base + k] = result;
+        }
     }
+    return valid;
+}
 
-    // if there is a separator, it cannot be beyond the valid position
-    if (info->sep_first >= kSeparatorPosition) {
-        return 0;
-    }
+int OLC_GetSimd(void)
+{
+    int simd = simd_supported();
+    return simd < simd_limit ? simd : simd_limit;
+}
 
-    return 1;
+int OLC_SetSimd(int simd)
+{
+    simd_limit = simd;
+    return OLC_GetSimd();
 }
 
-// checks that the first character of latitude or longitude is valid
-static int valid_first_character(CodeInfo* info, int pos, double kMax)
+int OLC_Pack(const char* code, size_t size, OLC_Packed* packed)
 {
-    if (info->len <= pos) {
-        return 1;
+    STATS_START();
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = get_full_digits(code, size, digits);
+    int len = pack_digits(digits, count, packed);
+    STATS_END(OLC_API_PACK, 1);
+    return len;
+}
+
+int OLC_Unpack(OLC_Packed packed, char* code, int maxlen)
+{
+    STATS_START();
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = unpack_digits(packed, digits);
+    int len = 0;
+    if (count) {
+        len = format_digits(digits, count, code, maxlen);
+    } else if (maxlen > 0) {
+        code[0] = '\0';
     }
+    STATS_END(OLC_API_UNPACK, 1);
+    return len;
+}
 
-    // Work out what the first character indicates
-    size_t firstValue = get_alphabet_position(toupper(info->code[pos]));
-    firstValue *= kEncodingBase;
-    return firstValue < kMax;
+int OLC_EncodePacked(const OLC_LatLon* location, size_t code_length,
+                     OLC_Packed* packed)
+{
+    STATS_START();
+    uint8_t digits[OLC_MAX_DIGITS];
+    steps_to_digits(latitude_to_steps(location->lat),
+                    longitude_to_steps(location->lon), digits);
+    int len = pack_digits(digits, encoded_digits(code_length), packed);
+    STATS_END(OLC_API_ENCODE_PACKED, 1);
+    return len;
 }
 
-static int is_full(CodeInfo* info)
+int OLC_EncodePackedMulti(const OLC_LatLon* location, const size_t* lengths, size_t n,
+                          OLC_Packed* packed)
 {
-    if (info->len <= 0) {
-        return 0;
+    STATS_START();
+    uint8_t digits[OLC_MAX_DIGITS];
+    steps_to_digits(latitude_to_steps(location->lat),
+                    longitude_to_steps(location->lon), digits);
+    size_t levels = 0;
+    for (size_t j = 0; j < n; ++j) {
+        size_t level = level_of_length(encoded_digits(lengths[j]));
+        if (level + 1 > levels) {
+            levels = level + 1;
+        }
     }
-
-    // If there are less characters than expected before the separator.
-    if (info->sep_first < kSeparatorPosition) {
-        return 0;
+    // The packed code of a prefix is the rank pack_digits() has reached at
+    // its level, so one pass over the digits packs all of them.
+    uint64_t ranks[OLC_MAX_DIGITS];
+    if (levels) {
+        ranks[0] = (digits[0] * kFirstLonValues + digits[1]) * kPackedSpan[0];
+    }
+    for (size_t level = 1; level < levels; ++level) {
+        uint64_t value = 0;
+        if (level < kPairCodeLength / 2) {
+            value = digits[2 * level] * kEncodingBase + digits[2 * level + 1];
+        } else {
+            value = digits[level + kPairCodeLength / 2];
+        }
+        ranks[level] = ranks[level - 1] + 1 + value * kPackedSpan[level];
     }
-
-    // check first latitude character, if any
-    if (! valid_first_character(info, 0, kLatMaxDegreesT2)) {
-        return 0;
+    for (size_t j = 0; j < n; ++j) {
+        packed[j] = ranks[level_of_length(encoded_digits(lengths[j]))];
     }
+    STATS_END(OLC_API_ENCODE_PACKED_MULTI, 1);
+    return n;
+}
 
-    // check first longitude character, if any
-    if (! valid_first_character(info, 1, kLonMaxDegreesT2)) {
-        return 0;
+int OLC_DecodePacked(OLC_Packed packed, OLC_CodeArea* decoded)
+{
+    STATS_START();
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = unpack_digits(packed, digits);
+    int len = 0;
+    if (count) {
+        CellSteps cell;
+        digits_to_steps(digits, count, &cell);
+        steps_to_area(&cell, count, decoded);
+        len = decoded->len;
+    }
+    STATS_END(OLC_API_DECODE_PACKED, 1);
+    return len;
+}
+
+size_t OLC_PackedLength(OLC_Packed packed)
+{
+    uint8_t digits[OLC_MAX_DIGITS];
+    return unpack_digits(packed, digits);
+}
+
+OLC_Packed OLC_PackedLastDescendant(OLC_Packed packed)
+{
+    size_t length = OLC_PackedLength(packed);
+    if (!length) {
+        return packed;
     }
+    size_t level = length <= kPairCodeLength ? length / 2 : length - kPairCodeLength / 2;
+    return packed + kPackedSpan[level - 1] - 1;
+}
 
-    return 1;
+uint64_t OLC_PackedSpan(size_t code_length)
+{
+    return kPackedSpan[level_of_length(encoded_digits(code_length))];
 }
 
-static int decode(CodeInfo* info, OLC_CodeArea* decoded)
+size_t OLC_CoverBBox(const OLC_LatLon* lo, const OLC_LatLon* hi,
+                     size_t min_length, size_t max_length, size_t max_cells,
+                     OLC_Packed* cells)
 {
-    double resolution_degrees = kEncodingBase;
-    OLC_LatLon lo = { 0, 0 };
-    OLC_LatLon hi = { 0, 0 };
+    if (isnan(lo->lat) || isnan(lo->lon) || isnan(hi->lat) || isnan(hi->lon)) {
+        return 0;
+    }
 
-    // Up to the first 10 characters are encoded in pairs. Subsequent
-    // characters represent grid squares.
-    int top = info->len;
-    if (info->pad_first >= 0) {
-        top = info->pad_first;
+    Region region;
+    memset(&region, 0, sizeof(Region));
+    region.lat_lo = latitude_to_steps(lo->lat);
+    region.lat_hi = latitude_to_steps(hi->lat);
+    if (region.lat_hi < region.lat_lo) {
+        return 0;
+    }
+
+    double west = lo->lon < -kLonMaxDegrees ? -kLonMaxDegrees : lo->lon;
+    double east = hi->lon > kLonMaxDegrees ? kLonMaxDegrees : hi->lon;
+    region.lon_lo = degrees_to_steps(west + kLonMaxDegrees, kLonStepsPerDegree);
+    region.lon_hi = degrees_to_steps(east + kLonMaxDegrees, kLonStepsPerDegree);
+    if (region.lon_lo >= kLonSteps) {
+        region.lon_lo = kLonSteps - 1;
     }
-    if (top > kPairCodeLength) {
-        top = kPairCodeLength;
-        CORRECT_IF_SEPARATOR(top, info);
+    if (lo->lon > hi->lon) {
+        region.lon_hi += kLonSteps;
     }
-    if (top > info->size) {
-        top = info->size;
+    if (region.lon_hi >= region.lon_lo + kLonSteps || region.lon_hi < region.lon_lo) {
+        region.lon_lo = 0;
+        region.lon_hi = kLonSteps - 1;
     }
+    return cover(&region, min_length, max_length, max_cells, cells);
+}
 
-    for (size_t j = 0; j < top && info->code[j] != '\0'; ) {
-        // skip separator if necessary
-        if (j == info->sep_first) {
-            ++j;
-            continue;
-        }
+size_t OLC_CoverCircle(const OLC_LatLon* center, double radius_meters,
+                       size_t min_length, size_t max_length, size_t max_cells,
+                       OLC_Packed* cells)
+{
+    if (!(radius_meters >= 0) || isnan(center->lat) || isnan(center->lon)) {
+        return 0;
+    }
 
-        // Current character represents latitude. Retrieve it and convert to
-        // degrees (positive range).
-        lo.lat += get_alphabet_position(toupper(info->code[j])) * resolution_degrees;
-        hi.lat = lo.lat + resolution_degrees;
-        ++j;
-        if (j == top) {
-            break;
+    Region region;
+    memset(&region, 0, sizeof(Region));
+    region.circle = 1;
+    region.center.lat = center->lat;
+    region.center.lon = normalize_longitude(center->lon);
+    region.radius = radius_meters;
+
+    // Bounding rectangle of the circle; if it reaches a pole, it spans all
+    // longitudes.
+    double angle = radius_meters / kEarthRadiusMeters;
+    double dlat = angle * 180 / kPi;
+    region.lat_lo = latitude_to_steps(center->lat - dlat);
+    region.lat_hi = latitude_to_steps(center->lat + dlat);
+    region.lon_lo = 0;
+    region.lon_hi = kLonSteps - 1;
+    double ratio = sin(angle) / cos(center->lat * kPi / 180);
+    if (center->lat - dlat > -kLatMaxDegrees && center->lat + dlat < kLatMaxDegrees &&
+        angle < kPi / 2 && ratio < 1) {
+        double dlon = asin(ratio) * 180 / kPi;
+        region.lon_lo = degrees_to_steps(region.center.lon - dlon + kLonMaxDegrees, kLonStepsPerDegree);
+        region.lon_hi = degrees_to_steps(region.center.lon + dlon + kLonMaxDegrees, kLonStepsPerDegree);
+        if (region.lon_lo < 0) {
+            region.lon_lo += kLonSteps;
+            region.lon_hi += kLonSteps;
         }
-
-        // Current character represents longitude. Retrieve it and convert to
-        // degrees (positive range).
-        lo.lon += get_alphabet_position(toupper(info->code[j])) * resolution_degrees;
-        hi.lon = lo.lon + resolution_degrees;
-        ++j;
-        if (j == top) {
-            break;
+        if (region.lon_hi >= region.lon_lo + kLonSteps) {
+            region.lon_lo = 0;
+            region.lon_hi = kLonSteps - 1;
         }
-
-        resolution_degrees /= kEncodingBase;
     }
+    return cover(&region, min_length, max_length, max_cells, cells);
+}
 
-    if (info->pad_first > kPairCodeLength) {
-        // Now do any grid square characters.  Adjust the resolution back a
-        // step because we need the resolution of the entire grid, not a single
-        // grid square.
-        // resolution_degrees *= kEncodingBase;
+int OLC_Neighbors(OLC_Packed code, OLC_Packed* neighbors)
+{
+    return ring(code, 1, 1, neighbors, 8);
+}
 
-        // With a grid, the latitude and longitude resolutions are no longer
-        // equal.
-        OLC_LatLon resolution = { resolution_degrees, resolution_degrees };
+size_t OLC_KRing(OLC_Packed code, size_t k, OLC_Packed* cells, size_t maxcount)
+{
+    return ring(code, k, 0, cells, maxcount);
+}
 
-        // Decode only up to the maximum digit count.
-        top = info->len;
-        if (top > kMaximumDigitCount) {
-            top = kMaximumDigitCount;
+size_t OLC_TraversePolyline(const OLC_LatLon* points, size_t n, size_t code_length,
+                            OLC_TraverseFunc* func, void* data)
+{
+    STATS_START();
+    size_t length = encoded_digits(code_length);
+    int64_t lat_size = 0;
+    int64_t lon_size = 0;
+    level_size(level_of_length(length), &lat_size, &lon_size);
+    int64_t around = kLonSteps / lon_size;
+
+    // The walk moves from cell to cell on the lattice of the code length, in
+    // steps; the cells at the ends of a segment are those the points encode
+    // to, and the number of moves between them is fixed, so that rounding
+    // can change where the walk turns but never where it ends.
+    uint8_t digits[OLC_MAX_DIGITS];
+    OLC_Packed cell = 0;
+    int64_t row = n ? latitude_to_steps(points[0].lat) / lat_size : 0;
+    int64_t col = n ? longitude_to_steps(points[0].lon) / lon_size : 0;
+    double enter = 0;
+    size_t count = 0;
+    int stop = 0;
+    for (size_t j = 0; !stop && j + 1 < n; ++j) {
+        const OLC_LatLon* from = &points[j];
+        const OLC_LatLon* to = &points[j + 1];
+        int64_t rows = latitude_to_steps(to->lat) / lat_size - row;
+        int64_t cols = longitude_to_steps(to->lon) / lon_size - col;
+        if (cols > around / 2) {
+            cols -= around;
+        } else if (cols < -around / 2) {
+            cols += around;
         }
-        int bot = kPairCodeLength;
-        CORRECT_IF_SEPARATOR(bot, info);
-        for (size_t j = bot; j < top; ++j) {
-            // skip separator if necessary
-            if (j == info->sep_first) {
-                continue;
+        int64_t row_step = rows < 0 ? -1 : 1;
+        int64_t col_step = cols < 0 ? -1 : 1;
+        rows *= row_step;
+        cols *= col_step;
+
+        // Where the segment starts within the cell, and how far it goes, in
+        // cells.
+        double lat_from = from->lat < -kLatMaxDegrees ? -kLatMaxDegrees : from->lat;
+        double lat_to = to->lat < -kLatMaxDegrees ? -kLatMaxDegrees : to->lat;
+        lat_from = lat_from > kLatMaxDegrees ? kLatMaxDegrees : lat_from;
+        lat_to = lat_to > kLatMaxDegrees ? kLatMaxDegrees : lat_to;
+        double lon_delta = to->lon - from->lon;
+        lon_delta -= floor((lon_delta + kLonMaxDegrees) / kLonMaxDegreesT2) * kLonMaxDegreesT2;
+        double lat_offset = cell_offset((lat_from + kLatMaxDegrees) * kLatStepsPerDegree,
+                                        row, lat_size, 0);
+        double lon_offset = cell_offset((from->lon + kLonMaxDegrees) * kLonStepsPerDegree,
+                                        col, lon_size, around);
+        double lat_cells = (lat_to - lat_from) * kLatStepsPerDegree / lat_size;
+        double lon_cells = lon_delta * kLonStepsPerDegree / lon_size;
+        double row_next = next_crossing(lat_offset, lat_cells, row_step);
+        double col_next = next_crossing(lon_offset, lon_cells, col_step);
+        double row_delta = 1 / fabs(lat_cells);
+        double col_delta = 1 / fabs(lon_cells);
+
+        double last = 0;
+        while (!stop && rows + cols > 0) {
+            int by_row = cols == 0 || (rows > 0 && row_next < col_next);
+            double t = by_row ? row_next : col_next;
+            // Also catches NaN.
+            if (!(t >= last)) {
+                t = last;
             }
-
-            // Get the value of the current character and convert it to the
-            // degree value.
-            size_t value = get_alphabet_position(toupper(info->code[j]));
-            size_t row = value / kGridCols;
-            size_t col = value % kGridCols;
-
-            // Lat and lon grid sizes shouldn't underflow due to maximum code
-            // length enforcement, but a hypothetical underflow won't cause
-            // fatal errors here.
-            resolution.lat /= kGridRows;
-            resolution.lon /= kGridCols;
-            lo.lat += row * resolution.lat;
-            lo.lon += col * resolution.lon;
-            hi.lat = lo.lat + resolution.lat;
-            hi.lon = lo.lon + resolution.lon;
-        }
-    }
-    decoded->lo.lat = lo.lat - kLatMaxDegrees;
-    decoded->lo.lon = lo.lon - kLonMaxDegrees;
-    decoded->hi.lat = hi.lat - kLatMaxDegrees;
-    decoded->hi.lon = hi.lon - kLonMaxDegrees;
-    decoded->len = code_length(info);
-    return decoded->len;
+            t = t < 1 ? t : 1;
+            last = t;
+            steps_to_digits(row * lat_size, col * lon_size, digits);
+            pack_digits(digits, length, &cell);
+            ++count;
+            stop = func(data, cell, enter, j + t);
+            enter = j + t;
+            if (by_row) {
+                row += row_step;
+                row_next += row_delta;
+                --rows;
+            } else {
+                col = (col + col_step + around) % around;
+                col_next += col_delta;
+                --cols;
+            }
+        }
+    }
+    if (!stop && n) {
+        steps_to_digits(row * lat_size, col * lon_size, digits);
+        pack_digits(digits, length, &cell);
+        ++count;
+        func(data, cell, enter, n - 1);
+    }
+    STATS_END(OLC_API_TRAVERSE_POLYLINE, n);
+    return count;
 }
 
-static size_t code_length(CodeInfo* info)
+int OLC_Parent(const char* code, size_t size, size_t parent_length,
+               char* parent, int maxlen)
 {
-    int len = info->len;
-    if (info->sep_first >= 0) {
-        --len;
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = get_full_digits(code, size, digits);
+    if (!count) {
+        if (maxlen > 0) {
+            parent[0] = '\0';
+        }
+        return 0;
     }
-    if (info->pad_first >= 0) {
-        len = info->pad_first;
+    parent_length = encoded_digits(parent_length);
+    if (parent_length < count) {
+        count = parent_length;
     }
-    return len;
+    return format_digits(digits, count, parent, maxlen);
 }
 
-static void init_constants(void)
+size_t OLC_Children(const char* code, size_t size, char* children, size_t stride)
 {
-    static int inited = 0;
-    if (inited) {
-        return;
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = get_full_digits(code, size, digits);
+    if (!count || count >= kMaxCodeLength) {
+        return 0;
     }
-    inited = 1;
 
-    // Work out the encoding base exponent necessary to represent 360 degrees.
-    kInitialExponent = floor(log(kLonMaxDegreesT2) / log(kEncodingBase));
+    // Below a pair code, the children add a pair; below a grid code, a
+    // single grid digit.
+    size_t added = count < kPairCodeLength ? 2 : 1;
+    size_t width = OLC_CodeWidth(count + added);
+    if (stride < width) {
+        return 0;
+    }
 
-    // Work out the enclosing resolution (in degrees) for the grid algorithm.
-    kGridSizeDegrees = 1 / pow(kEncodingBase, kPairCodeLength / 2 - (kInitialExponent + 1));
+    // Format the first child, and then just replace its new digits, which
+    // come after the separator if they are past its position.
+    char child[kMaximumDigitCount + 2];
+    memset(digits + count, 0, added);
+    format_digits(digits, count + added, child, sizeof(child));
+    size_t pos = count < kSeparatorPosition ? count : count + 1;
+    size_t values = added == 2 ? kEncodingBase * kEncodingBase : kEncodingBase;
+    for (size_t j = 0; j < values; ++j) {
+        if (added == 2) {
+            child[pos] = kAlphabet[j / kEncodingBase];
+            child[pos + 1] = kAlphabet[j % kEncodingBase];
+        } else {
+            child[pos] = kAlphabet[j];
+        }
+        char* slot = children + j * stride;
+        memcpy(slot, child, width);
+        memset(slot + width, ' ', stride - width);
+    }
+    return values;
+}
 
-    // Work out the initial resolution
-    kInitialResolutionDegrees = pow(kEncodingBase, kInitialExponent);
+int OLC_Contains(const char* parent, size_t parent_size,
+                 const char* child, size_t child_size)
+{
+    uint8_t parent_digits[OLC_MAX_DIGITS];
+    uint8_t child_digits[OLC_MAX_DIGITS];
+    size_t parent_count = get_full_digits(parent, parent_size, parent_digits);
+    size_t child_count = get_full_digits(child, child_size, child_digits);
+    if (!parent_count || !child_count || parent_count > child_count) {
+        return 0;
+    }
+    return memcmp(parent_digits, child_digits, parent_count) == 0;
 }
 
-// Raises a number to an exponent, handling negative exponents.
-static double pow_neg(double base, double exponent)
+int OLC_PackedParent(OLC_Packed code, size_t parent_length, OLC_Packed* parent)
 {
-    if (exponent == 0) {
-        return 1;
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t count = unpack_digits(code, digits);
+    if (!count) {
+        return 0;
     }
+    parent_length = encoded_digits(parent_length);
+    if (parent_length < count) {
+        count = parent_length;
+    }
+    return pack_digits(digits, count, parent);
+}
 
-    if (exponent > 0) {
-        return pow(base, exponent);
+size_t OLC_PackedChildren(OLC_Packed code, OLC_Packed* children)
+{
+    size_t count = OLC_PackedLength(code);
+    if (!count || count >= kMaxCodeLength) {
+        return 0;
     }
 
-    return 1 / pow(base, -exponent);
+    // Children come right after their parent, each followed by its own
+    // descendants.
+    size_t level = level_of_length(count) + 1;
+    size_t values = level < kPairCodeLength / 2 ? kEncodingBase * kEncodingBase : kEncodingBase;
+    for (size_t j = 0; j < values; ++j) {
+        children[j] = code + 1 + j * kPackedSpan[level];
+    }
+    return values;
 }
 
-// Compute the latitude precision value for a given code length.  Lengths <= 10
-// have the same precision for latitude and longitude, but lengths > 10 have
-// different precisions due to the grid method having fewer columns than rows.
-static double compute_precision_for_length(int length)
+int OLC_PackedContains(OLC_Packed parent, OLC_Packed child)
 {
-    // Magic numbers!
-    if (length <= kPairCodeLength) {
-        return pow_neg(kEncodingBase, floor((length / -2) + 2));
+    if (!OLC_PackedLength(parent)) {
+        return 0;
     }
+    return child >= parent && child <= OLC_PackedLastDescendant(parent);
+}
 
-    return pow_neg(kEncodingBase, -3) / pow(5, length - kPairCodeLength);
+int OLC_Shorten(const char* code, size_t size, const OLC_LatLon* reference,
+                char* shortened, int maxlen)
+{
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(code, size, &parsed);
+    int len = OLC_ParsedShorten(&parsed, reference, shortened, maxlen);
+    STATS_END(OLC_API_SHORTEN, 1);
+    return len;
 }
 
-// Finds the position of a char in the encoding alphabet.
-static int get_alphabet_position(char c)
+size_t OLC_ShortenBatch(const char* codes, size_t stride, size_t n,
+                        const OLC_LatLon* reference,
+                        char* out, size_t out_stride, uint8_t* status)
 {
-    for (int j = 0; j < kEncodingBase; ++j) {
-        if (c == kAlphabet[j]) {
-            return j;
+    STATS_START();
+    Reference ref;
+    make_reference(reference, &ref);
+
+    size_t shortened = 0;
+    char buf[kMaximumDigitCount + 2];
+    CodeInfo infos[ANALYSE_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += ANALYSE_BLOCK_SIZE) {
+        size_t count = n - base < ANALYSE_BLOCK_SIZE ? n - base : ANALYSE_BLOCK_SIZE;
+        analyse_batch(codes + base * stride, stride, count, infos);
+        for (size_t k = 0; k < count; ++k) {
+            const CodeInfo* info = &infos[k];
+            char* slot = out + (base + k) * out_stride;
+            int len = 0;
+
+            uint8_t result = OLC_STATUS_INVALID;
+            if (info->valid) {
+                result = is_short(info) ? OLC_STATUS_SHORT : OLC_STATUS_OK;
+            }
+            if (result == OLC_STATUS_OK) {
+                len = shorten(info, &ref, buf, sizeof(buf));
+                if (len <= 0 || len > out_stride) {
+                    result = OLC_STATUS_INVALID;
+                    len = 0;
+                }
+            }
+            status[base + k] = result;
+            memcpy(slot, buf, len);
+            memset(slot + len, ' ', out_stride - len);
+            shortened += result == OLC_STATUS_OK;
         }
     }
-    return -1;
+    STATS_END(OLC_API_SHORTEN_BATCH, n);
+    return shortened;
 }
 
-// Normalize a longitude into the range -180 to 180, not including 180.
-static double normalize_longitude(double lon_degrees)
+int OLC_RecoverNearest(const char* short_code, size_t size, const OLC_LatLon* reference,
+                       char* code, int maxlen)
 {
-    while (lon_degrees < -kLonMaxDegrees) {
-        lon_degrees += kLonMaxDegreesT2;
-    }
-    while (lon_degrees >= kLonMaxDegrees) {
-        lon_degrees -= kLonMaxDegreesT2;
-    }
-    return lon_degrees;
+    STATS_START();
+    OLC_Parsed parsed;
+    analyse(short_code, size, &parsed);
+    int len = OLC_ParsedRecoverNearest(&parsed, reference, code, maxlen);
+    STATS_END(OLC_API_RECOVER_NEAREST, 1);
+    return len;
 }
 
-// Adjusts 90 degree latitude to be lower so that a legal OLC code can be
-// generated.
-static double adjust_latitude(double lat_degrees, size_t length)
+size_t OLC_RecoverNearestBatch(const char* short_codes, size_t stride, size_t n,
+                               const OLC_LatLon* reference,
+                               char* out, size_t out_stride, uint8_t* status)
 {
-    if (lat_degrees < -kLatMaxDegrees) {
-        lat_degrees = -kLatMaxDegrees;
-    }
-    if (lat_degrees >  kLatMaxDegrees) {
-        lat_degrees =  kLatMaxDegrees;
-    }
-    if (lat_degrees < kLatMaxDegrees) {
-        return lat_degrees;
+    STATS_START();
+    Reference ref;
+    make_reference(reference, &ref);
+
+    size_t recovered = 0;
+    char buf[kMaxCodeLength + 2];
+    CodeInfo infos[ANALYSE_BLOCK_SIZE];
+    for (size_t base = 0; base < n; base += ANALYSE_BLOCK_SIZE) {
+        size_t count = n - base < ANALYSE_BLOCK_SIZE ? n - base : ANALYSE_BLOCK_SIZE;
+        analyse_batch(short_codes + base * stride, stride, count, infos);
+        for (size_t k = 0; k < count; ++k) {
+            const CodeInfo* info = &infos[k];
+            char* slot = out + (base + k) * out_stride;
+            int len = 0;
+
+            uint8_t result = OLC_STATUS_INVALID;
+            if (info->valid) {
+                len = recover(info, &ref, buf, sizeof(buf));
+                if (len > 0 && len <= out_stride) {
+                    result = OLC_STATUS_OK;
+                } else {
+                    len = 0;
+                }
+            }
+            status[base + k] = result;
+            memcpy(slot, buf, len);
+            memset(slot + len, ' ', out_stride - len);
+            recovered += result == OLC_STATUS_OK;
+        }
     }
-    // Subtract half the code precision to get the latitude into the code area.
-    double precision = compute_precision_for_length(length);
-    return lat_degrees - precision / 2;
+    STATS_END(OLC_API_RECOVER_NEAREST_BATCH, n);
+    return recovered;
 }
 
-// Encodes positive range lat,lon into a sequence of OLC lat/lon pairs.  This
-// uses pairs of characters (latitude and longitude in that order) to represent
-// each step in a 20x20 grid.  Each code, therefore, has 1/400th the area of
-// the previous code.
-static int encode_pairs(double lat, double lon, size_t length, char* code, int maxlen)
+size_t OLC_ScanText(const char* text, size_t n, OLC_ScanFunc* func, void* data)
 {
-    if ((length + 1) >= maxlen) {
-        code[0] = '\0';
-        return 0;
-    }
-
-    init_constants();
+    STATS_START();
+    // Every code has a separator, which is rare in most text; only the words
+    // around one are looked at.
+    size_t (*find)(const char*, size_t, size_t) = find_separator;
+#ifdef OLC_X86_SIMD
+    int simd = OLC_GetSimd();
+    if (simd >= OLC_SIMD_AVX2) {
+        find = find_separator_avx2;
+    } else if (simd >= OLC_SIMD_SSSE3) {
+        find = find_separator_sse2;
+    }
+#endif
+
+    size_t found = 0;
+    size_t pos = 0;
+    for (size_t sep = find(text, n, pos); sep < n; sep = find(text, n, pos)) {
+        // The separator can be at most kSeparatorPosition characters into a
+        // code, so the start of a word further back is not looked for.
+        size_t begin = sep;
+        while (begin > pos && sep - begin <= kSeparatorPosition &&
+               is_word_char(text[begin - 1])) {
+            --begin;
+        }
+        size_t end = sep + 1;
+        while (end < n && is_word_char(text[end])) {
+            ++end;
+        }
 
-    int pos = 0;
-    double resolution_degrees = kInitialResolutionDegrees;
-    // Add two digits on each pass.
-    for (size_t digit_count = 0;
-         digit_count < length;
-         digit_count += 2, resolution_degrees /= kEncodingBase) {
-        size_t digit_value;
-
-        // Do the latitude - gets the digit for this place and subtracts that
-        // for the next digit.
-        digit_value = floor(lat / resolution_degrees);
-        lat -= digit_value * resolution_degrees;
-        code[pos++] = kAlphabet[digit_value];
-
-        // Do the longitude - gets the digit for this place and subtracts that
-        // for the next digit.
-        digit_value = floor(lon / resolution_degrees);
-        lon -= digit_value * resolution_degrees;
-        code[pos++] = kAlphabet[digit_value];
-
-        // Should we add a separator here?
-        if (pos == kSeparatorPosition && pos < length) {
-            code[pos++] = kSeparator;
+        // Go on after this word, whether or not it is a code.
+        pos = end;
+        if (begin > 0 && is_word_char(text[begin - 1])) {
+            continue;
+        }
+        if (end - begin > kMaximumDigitCount) {
+            continue;
+        }
+        CodeInfo info;
+        if (analyse(text + begin, end - begin, &info) <= 0) {
+            continue;
+        }
+        int full = is_full(&info);
+        if (!full && !is_short(&info)) {
+            continue;
+        }
+        ++found;
+        if (func && func(data, begin, end - begin, full)) {
+            break;
         }
     }
-    while (pos < kSeparatorPosition) {
-        code[pos++] = kPaddingCharacter;
-    }
-    if (pos == kSeparatorPosition) {
-        code[pos++] = kSeparator;
-    }
-    code[pos] = '\0';
-    return pos;
+    STATS_END(OLC_API_SCAN_TEXT, n);
+    return found;
 }
 
-// Encodes a location using the grid refinement method into an OLC string.  The
-// grid refinement method divides the area into a grid of 4x5, and uses a
-// single character to refine the area.  The grid squares use the OLC
-// characters in order to number the squares as follows:
-//
-//   R V W X
-//   J M P Q
-//   C F G H
-//   6 7 8 9
-//   2 3 4 5
-//
-// This allows default accuracy OLC codes to be refined with just a single
-// character.
-static int encode_grid(double lat, double lon, size_t length,
-                       char* code, int maxlen)
+int OLC_GetStats(OLC_Stats* stats)
 {
-    if ((length + 1) >= maxlen) {
-        code[0] = '\0';
-        return 0;
+    memset(stats, 0, sizeof(OLC_Stats));
+#if OLC_STATS
+    pthread_once(&stats_once, stats_init);
+    pthread_mutex_lock(&stats_lock);
+    stats_sum(stats);
+    uint64_t* counters = (uint64_t*) stats;
+    const uint64_t* baseline = (const uint64_t*) &stats_baseline;
+    for (size_t j = 0; j < offsetof(OLC_Stats, ns_per_tick) / sizeof(uint64_t); ++j) {
+        counters[j] -= baseline[j];
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    // The tick rate, measured since the first use of the statistics.
+    uint64_t ticks = stats_ticks() - stats_origin_ticks;
+    uint64_t ns = stats_ns() - stats_origin_ns;
+    stats->ns_per_tick = ticks > 0 ? (double) ns / ticks : 0;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+void OLC_ResetStats(void)
+{
+#if OLC_STATS
+    pthread_once(&stats_once, stats_init);
+    pthread_mutex_lock(&stats_lock);
+    stats_sum(&stats_baseline);
+    pthread_mutex_unlock(&stats_lock);
+#endif
+}
+
+const char* OLC_StatsApiName(int api)
+{
+    return api >= 0 && api < OLC_API_COUNT ? kStatsApiNames[api] : 0;
+}
+
+const char* OLC_StatsRejectName(int reject)
+{
+    return reject >= 0 && reject < OLC_REJECT_COUNT ? kStatsRejectNames[reject] : 0;
+}
+
+
+// private functions
+
+static int analyse(const char* code, size_t size, CodeInfo* info)
+{
+    memset(info, 0, sizeof(CodeInfo));
+
+    // null code is not valid
+    if (!code) {
+        return REJECT(OLC_REJECT_NULL);
+    }
+    if (!size || size > kMaximumDigitCount) {
+        size = kMaximumDigitCount;
     }
 
-    init_constants();
+    info->code = code;
+    info->size = size;
+    info->sep_first = -1;
+    info->sep_last = -1;
+    info->pad_first = -1;
+    info->pad_last = -1;
+    int j = 0;
+    for (j = 0; j < size && code[j] != '\0'; ++j) {
+        int c = kCharClass[(unsigned char) code[j]];
 
-    int pos = 0;
-    double lat_grid_size = kGridSizeDegrees;
-    double lon_grid_size = kGridSizeDegrees;
-
-    // To avoid problems with floating point, get rid of the degrees.
-    lat = fmod(lat, 1);
-    lon = fmod(lon, 1);
-    lat = fmod(lat, lat_grid_size);
-    lon = fmod(lon, lon_grid_size);
-    for (size_t i = 0; i < length; i++) {
-        // The following clause should never execute because of maximum code
-        // length enforcement in other functions, but is here to prevent
-        // division-by-zero crash from underflow.
-        if ((lat_grid_size / kGridRows) <= DBL_MIN ||
-            (lon_grid_size / kGridCols) <= DBL_MIN) {
+        // if this is a padding character, remember it
+        if (c == CHAR_PADDING) {
+            if (info->pad_first < 0) {
+                info->pad_first = j;
+            }
+            info->pad_last = j;
+            continue;
+        }
+
+        // if this is a separator character, remember it
+        if (c == CHAR_SEPARATOR) {
+            if (info->sep_first < 0) {
+                info->sep_first = j;
+            }
+            info->sep_last = j;
             continue;
         }
 
-        // Work out the row and column.
-        size_t row = floor(lat / (lat_grid_size / kGridRows));
-        size_t col = floor(lon / (lon_grid_size / kGridCols));
-        lat_grid_size /= kGridRows;
-        lon_grid_size /= kGridCols;
-        lat -= row * lat_grid_size;
-        lon -= col * lon_grid_size;
-        code[pos++] = kAlphabet[row * kGridCols + col];
+        // didn't find anything expected => bail out
+        if (c == CHAR_INVALID) {
+            return REJECT(OLC_REJECT_CHARACTER);
+        }
+
+        // keep the values of the digits (up to any padding)
+        if (info->pad_first < 0 && info->count < kMaxCodeLength) {
+            info->digits[info->count++] = c - 1;
+        }
     }
-    code[pos] = '\0';
+
+    // so far, code only has valid characters -- good
+    info->len = j;
+    return check_layout(info);
+}
+
+// Checks the positions of the separator and padding characters found by
+// analysing a code; returns the length of the code if it is valid, or 0.
+static int check_layout(CodeInfo* info)
+{
+    // Cannot be empty
+    if (info->len <= 0) {
+        return REJECT(OLC_REJECT_EMPTY);
+    }
+
+    // The separator is required.
+    if (info->sep_first < 0) {
+        return REJECT(OLC_REJECT_NO_SEPARATOR);
+    }
+
+    // There can be only one... separator.
+    if (info->sep_last > info->sep_first) {
+        return REJECT(OLC_REJECT_SEPARATORS);
+    }
+
+    // separator cannot be the only character
+    if (info->len == 1) {
+        return REJECT(OLC_REJECT_SEPARATOR_ONLY);
+    }
+
+    // Is the separator in an illegal position?
+    if (info->sep_first > kSeparatorPosition || (info->sep_first % 2)) {
+        return REJECT(OLC_REJECT_SEPARATOR_POSITION);
+    }
+
+    // padding cannot be at the initial position
+    if (info->pad_first == 0) {
+        return REJECT(OLC_REJECT_PADDING_FIRST);
+    }
+
+    // We can have an even number of padding characters before the separator,
+    // but then it must be the final character.
+    if (info->pad_first > 0) {
+        // The first padding character needs to be in an odd position.
+        if (info->pad_first % 2) {
+            return REJECT(OLC_REJECT_PADDING_POSITION);
+        }
+
+        // With padding, the separator must be the final character
+        if (info->sep_last < info->len - 1) {
+            return REJECT(OLC_REJECT_PADDING_SEPARATOR);
+        }
+
+        // After removing padding characters, we mustn't have anything left.
+        if (info->pad_last < info->sep_first - 1) {
+            return REJECT(OLC_REJECT_PADDING_GAP);
+        }
+    }
+
+    // If there are characters after the separator, make sure there isn't just
+    // one of them (not legal).
+    if (info->len - info->sep_first - 1 == 1) {
+        return REJECT(OLC_REJECT_SINGLE_DIGIT);
+    }
+
+    // Make sure the code does not have too many digits in total.
+    if (info->len - 1 > kMaximumDigitCount) {
+        return REJECT(OLC_REJECT_TOO_LONG);
+    }
+
+    // Make sure the code does not have too many digits after the separator.
+    // The number of digits is the length of the code, minus the position of
+    // the separator, minus one because the separator position is zero indexed.
+    if (info->len - info->sep_first - 1 > kMaximumDigitCount - kSeparatorPosition) {
+        return REJECT(OLC_REJECT_TOO_LONG_AFTER);
+    }
+
+    info->valid = 1;
+    STATS_LENGTH(code_length(info));
+    return info->len;
+}
+
+// Analyses a code in a fixed-width slot, which may be blank padded.
+static void analyse_slot(const char* code, size_t stride, CodeInfo* info)
+{
+    size_t size = slot_size(code, stride);
+    if (size == 0) {
+        memset(info, 0, sizeof(CodeInfo));
+        (void) REJECT(OLC_REJECT_EMPTY);
+        return;
+    }
+    analyse(code, size, info);
+}
+
+// Analyses n codes in fixed-width slots, with the best instruction set
+// available; the results are the same as those of analyse_slot().
+static void analyse_batch(const char* codes, size_t stride, size_t n, CodeInfo* infos)
+{
+    size_t j = 0;
+#ifdef OLC_X86_SIMD
+    int simd = OLC_GetSimd();
+    if (simd >= OLC_SIMD_AVX2) {
+        j = analyse_avx2(codes, stride, n, infos);
+    }
+    if (simd >= OLC_SIMD_SSSE3) {
+        j += analyse_ssse3(codes + j * stride, stride, n - j, infos + j);
+    }
+#endif
+    for (; j < n; ++j) {
+        analyse_slot(codes + j * stride, stride, &infos[j]);
+    }
+}
+
+static int simd_supported(void)
+{
+#ifdef OLC_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return OLC_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return OLC_SIMD_SSSE3;
+    }
+#endif
+    return OLC_SIMD_NONE;
+}
+
+// Checks for the characters that make up words in text: letters, digits and
+// the separator.
+static int is_word_char(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+           (c >= 'a' && c <= 'z') || c == kSeparator;
+}
+
+// Finds the first separator in text from pos on; returns n if there is none.
+static size_t find_separator(const char* text, size_t n, size_t pos)
+{
+    const char* sep = pos < n ? memchr(text + pos, kSeparator, n - pos) : 0;
+    return sep ? (size_t) (sep - text) : n;
+}
+
+#if OLC_STATS
+
+// A fast clock: the time stamp counter on x86, nanoseconds elsewhere.
+static uint64_t stats_ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return stats_ns();
+#endif
+}
+
+static uint64_t stats_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void stats_init(void)
+{
+    pthread_key_create(&stats_key, stats_thread_exit);
+    stats_origin_ticks = stats_ticks();
+    stats_origin_ns = stats_ns();
+}
+
+static void stats_thread_exit(void* arg)
+{
+    StatsBlock* block = arg;
+    pthread_mutex_lock(&stats_lock);
+    uint64_t* retired = (uint64_t*) &stats_retired;
+    const uint64_t* counters = (const uint64_t*) &block->stats;
+    for (size_t j = 0; j < offsetof(OLC_Stats, ns_per_tick) / sizeof(uint64_t); ++j) {
+        retired[j] += counters[j];
+    }
+    StatsBlock** link = &stats_threads;
+    while (*link != block) {
+        link = &(*link)->next;
+    }
+    *link = block->next;
+    pthread_mutex_unlock(&stats_lock);
+    stats_local = 0;
+    free(block);
+}
+
+// Gets the counters of the calling thread, creating them on first use.
+static StatsBlock* stats_block(void)
+{
+    if (stats_local) {
+        return stats_local;
+    }
+    pthread_once(&stats_once, stats_init);
+    StatsBlock* block = calloc(1, sizeof(StatsBlock));
+    if (!block) {
+        return 0;
+    }
+    pthread_mutex_lock(&stats_lock);
+    block->next = stats_threads;
+    stats_threads = block;
+    pthread_mutex_unlock(&stats_lock);
+    pthread_setspecific(stats_key, block);
+    stats_local = block;
+    return block;
+}
+
+static void stats_add(uint64_t* counter, uint64_t value)
+{
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value,
+                     __ATOMIC_RELAXED);
+}
+
+static void stats_call(int api, uint64_t items, uint64_t start)
+{
+    uint64_t ticks = stats_ticks() - start;
+    StatsBlock* block = stats_block();
+    if (!block) {
+        return;
+    }
+    int bucket = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    if (bucket >= OLC_STATS_BUCKETS) {
+        bucket = OLC_STATS_BUCKETS - 1;
+    }
+    stats_add(&block->stats.calls[api], 1);
+    stats_add(&block->stats.items[api], items);
+    stats_add(&block->stats.latency[api][bucket], 1);
+}
+
+static void stats_reject(int rule)
+{
+    StatsBlock* block = stats_block();
+    if (block) {
+        stats_add(&block->stats.rejects[rule], 1);
+    }
+}
+
+static void stats_length(size_t length)
+{
+    StatsBlock* block = stats_block();
+    if (block && length < OLC_STATS_LENGTHS) {
+        stats_add(&block->stats.lengths[length], 1);
+    }
+}
+
+// Adds up the counters of all threads, with stats_lock held.
+static void stats_sum(OLC_Stats* sum)
+{
+    *sum = stats_retired;
+    uint64_t* counters = (uint64_t*) sum;
+    for (const StatsBlock* block = stats_threads; block; block = block->next) {
+        const uint64_t* thread = (const uint64_t*) &block->stats;
+        for (size_t j = 0; j < offsetof(OLC_Stats, ns_per_tick) / sizeof(uint64_t); ++j) {
+            counters[j] += __atomic_load_n(&thread[j], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+#endif
+
+#ifdef OLC_X86_SIMD
+
+__attribute__((target("sse2")))
+static size_t find_separator_sse2(const char* text, size_t n, size_t pos)
+{
+    const __m128i separators = _mm_set1_epi8(kSeparator);
+    for (; pos + 16 <= n; pos += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (text + pos));
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, separators));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return find_separator(text, n, pos);
+}
+
+__attribute__((target("avx2")))
+static size_t find_separator_avx2(const char* text, size_t n, size_t pos)
+{
+    const __m256i separators = _mm256_set1_epi8(kSeparator);
+    for (; pos + 32 <= n; pos += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (text + pos));
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, separators));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return find_separator(text, n, pos);
+}
+
+// Finishes the analysis of a code from its first 16 bytes, given as the
+// digit values (class minus one) of the bytes and as bit masks of the bytes
+// that are NUL, blanks, not allowed, separators and padding.  Codes that may
+// go on past these 16 bytes are left to analyse_slot().
+static void analyse_masks(const char* code, size_t stride, const uint8_t* digits,
+                          unsigned nul, unsigned blank, unsigned bad,
+                          unsigned sep, unsigned pad, CodeInfo* info)
+{
+    // Where the code ends: at a NUL, or else before the trailing blanks of
+    // the slot, as in slot_size().
+    unsigned window = stride < 16 ? (1u << stride) - 1 : 0xFFFF;
+    int len;
+    nul &= window;
+    if (nul) {
+        len = __builtin_ctz(nul);
+    } else if (stride > 16 && code[16] == '\0') {
+        len = 16;
+    } else {
+        for (size_t j = 16; j < stride; ++j) {
+            if (code[j] != ' ') {
+                analyse_slot(code, stride, info);
+                return;
+            }
+        }
+        unsigned kept = ~blank & window;
+        len = kept ? 32 - __builtin_clz(kept) : 0;
+    }
+
+    memset(info, 0, sizeof(CodeInfo));
+    unsigned used = len < 16 ? (1u << len) - 1 : 0xFFFF;
+    if (len == 0) {
+        (void) REJECT(OLC_REJECT_EMPTY);
+        return;
+    }
+    if (bad & used) {
+        (void) REJECT(OLC_REJECT_CHARACTER);
+        return;
+    }
+    sep &= used;
+    pad &= used;
+    info->code = code;
+    info->size = len;
+    info->len = len;
+    info->sep_first = sep ? __builtin_ctz(sep) : -1;
+    info->sep_last = sep ? 31 - __builtin_clz(sep) : -1;
+    info->pad_first = pad ? __builtin_ctz(pad) : -1;
+    info->pad_last = pad ? 31 - __builtin_clz(pad) : -1;
+    if (!check_layout(info)) {
+        return;
+    }
+
+    // The digits go up to any padding, around the (single) separator.
+    int end = info->pad_first >= 0 ? info->pad_first : len;
+    int before = end < info->sep_first ? end : info->sep_first;
+    memcpy(info->digits, digits, before);
+    if (end > before + 1) {
+        memcpy(info->digits + before, digits + before + 1, end - before - 1);
+    }
+    info->count = end > before ? end - 1 : end;
+}
+
+// The SIMD code classifies 16 bytes at a time: case folding sets bit 5 of
+// the letters (the bytes with bit 6 set), then the low nibble of a byte picks
+// its class from the 16 byte row of kCharClass for its high nibble.  Only the
+// rows 2, 3, 6 and 7 have valid characters.
+static const uint8_t kClassRows[] = { 2, 3, 6, 7 };
+
+__attribute__((target("ssse3")))
+static size_t analyse_ssse3(const char* codes, size_t stride, size_t n, CodeInfo* infos)
+{
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    const __m128i case_bit = _mm_set1_epi8(0x40);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i blanks = _mm_set1_epi8(' ');
+    const __m128i separators = _mm_set1_epi8(CHAR_SEPARATOR);
+    const __m128i paddings = _mm_set1_epi8(CHAR_PADDING);
+    const __m128i ones = _mm_set1_epi8(1);
+    __m128i rows[4];
+    __m128i row_nibbles[4];
+    for (int r = 0; r < 4; ++r) {
+        rows[r] = _mm_loadu_si128((const __m128i*) (kCharClass + 16 * kClassRows[r]));
+        row_nibbles[r] = _mm_set1_epi8(kClassRows[r]);
+    }
+
+    // Four codes per iteration, as long as 16 bytes can be loaded for each
+    // without reading past the last slot.
+    size_t j = 0;
+    uint8_t digits[4][16];
+    unsigned masks[4][5];
+    for (; j + 4 <= n && (n - j - 3) * stride >= 16; j += 4) {
+        for (int k = 0; k < 4; ++k) {
+            __m128i v = _mm_loadu_si128((const __m128i*) (codes + (j + k) * stride));
+            __m128i folded = _mm_or_si128(v, _mm_srli_epi16(_mm_and_si128(v, case_bit), 1));
+            __m128i lo = _mm_and_si128(folded, nibble);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(folded, 4), nibble);
+            __m128i cls = zero;
+            for (int r = 0; r < 4; ++r) {
+                __m128i match = _mm_cmpeq_epi8(hi, row_nibbles[r]);
+                cls = _mm_or_si128(cls, _mm_and_si128(match, _mm_shuffle_epi8(rows[r], lo)));
+            }
+            _mm_storeu_si128((__m128i*) digits[k], _mm_sub_epi8(cls, ones));
+            masks[k][0] = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+            masks[k][1] = _mm_movemask_epi8(_mm_cmpeq_epi8(v, blanks));
+            masks[k][2] = _mm_movemask_epi8(_mm_cmpeq_epi8(cls, zero));
+            masks[k][3] = _mm_movemask_epi8(_mm_cmpeq_epi8(cls, separators));
+            masks[k][4] = _mm_movemask_epi8(_mm_cmpeq_epi8(cls, paddings));
+        }
+        for (int k = 0; k < 4; ++k) {
+            analyse_masks(codes + (j + k) * stride, stride, digits[k],
+                          masks[k][0], masks[k][1], masks[k][2], masks[k][3], masks[k][4],
+                          &infos[j + k]);
+        }
+    }
+    return j;
+}
+
+// Same as analyse_ssse3(), with two codes in each vector and eight codes per
+// iteration.
+__attribute__((target("avx2")))
+static size_t analyse_avx2(const char* codes, size_t stride, size_t n, CodeInfo* infos)
+{
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    const __m256i case_bit = _mm256_set1_epi8(0x40);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i blanks = _mm256_set1_epi8(' ');
+    const __m256i separators = _mm256_set1_epi8(CHAR_SEPARATOR);
+    const __m256i paddings = _mm256_set1_epi8(CHAR_PADDING);
+    const __m256i ones = _mm256_set1_epi8(1);
+    __m256i rows[4];
+    __m256i row_nibbles[4];
+    for (int r = 0; r < 4; ++r) {
+        rows[r] = _mm256_broadcastsi128_si256(
+            _mm_loadu_si128((const __m128i*) (kCharClass + 16 * kClassRows[r])));
+        row_nibbles[r] = _mm256_set1_epi8(kClassRows[r]);
+    }
+
+    size_t j = 0;
+    uint8_t digits[8][16];
+    unsigned masks[8][5];
+    for (; j + 8 <= n && (n - j - 7) * stride >= 16; j += 8) {
+        for (int k = 0; k < 8; k += 2) {
+            const char* code = codes + (j + k) * stride;
+            __m256i v = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) code)),
+                _mm_loadu_si128((const __m128i*) (code + stride)), 1);
+            __m256i folded = _mm256_or_si256(
+                v, _mm256_srli_epi16(_mm256_and_si256(v, case_bit), 1));
+            __m256i lo = _mm256_and_si256(folded, nibble);
+            __m256i hi = _mm256_and_si256(_mm256_srli_epi16(folded, 4), nibble);
+            __m256i cls = zero;
+            for (int r = 0; r < 4; ++r) {
+                __m256i match = _mm256_cmpeq_epi8(hi, row_nibbles[r]);
+                cls = _mm256_or_si256(
+                    cls, _mm256_and_si256(match, _mm256_shuffle_epi8(rows[r], lo)));
+            }
+            _mm256_storeu_si256((__m256i*) digits[k], _mm256_sub_epi8(cls, ones));
+            unsigned nul = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+            unsigned blank = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, blanks));
+            unsigned bad = _mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, zero));
+            unsigned sep = _mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, separators));
+            unsigned pad = _mm256_movemask_epi8(_mm256_cmpeq_epi8(cls, paddings));
+            for (int h = 0; h < 2; ++h) {
+                masks[k + h][0] = (nul >> (16 * h)) & 0xFFFF;
+                masks[k + h][1] = (blank >> (16 * h)) & 0xFFFF;
+                masks[k + h][2] = (bad >> (16 * h)) & 0xFFFF;
+                masks[k + h][3] = (sep >> (16 * h)) & 0xFFFF;
+                masks[k + h][4] = (pad >> (16 * h)) & 0xFFFF;
+            }
+        }
+
+        // analyse_masks() is not AVX code; avoid the cost of switching.
+        _mm256_zeroupper();
+        for (int k = 0; k < 8; ++k) {
+            analyse_masks(codes + (j + k) * stride, stride, digits[k],
+                          masks[k][0], masks[k][1], masks[k][2], masks[k][3], masks[k][4],
+                          &infos[j + k]);
+        }
+    }
+    return j;
+}
+
+#endif
+
+static int is_short(const CodeInfo* info)
+{
+    if (info->len <= 0) {
+        return 0;
+    }
+
+    // if there is a separator, it cannot be beyond the valid position
+    if (info->sep_first >= kSeparatorPosition) {
+        return 0;
+    }
+
+    return 1;
+}
+
+// checks that the first character of latitude or longitude is valid
+static int valid_first_character(const CodeInfo* info, int pos, double kMax)
+{
+    if (info->len <= pos) {
+        return 1;
+    }
+
+    // Work out what the first character indicates
+    size_t firstValue = info->digits[pos];
+    firstValue *= kEncodingBase;
+    return firstValue < kMax;
+}
+
+static int is_full(const CodeInfo* info)
+{
+    if (info->len <= 0) {
+        return 0;
+    }
+
+    // If there are less characters than expected before the separator.
+    if (info->sep_first < kSeparatorPosition) {
+        return 0;
+    }
+
+    // check first latitude character, if any
+    if (! valid_first_character(info, 0, kLatMaxDegreesT2)) {
+        return 0;
+    }
+
+    // check first longitude character, if any
+    if (! valid_first_character(info, 1, kLonMaxDegreesT2)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+static int decode(const CodeInfo* info, OLC_CodeArea* decoded)
+{
+    CellSteps cell;
+    digits_to_steps(info->digits, info->count, &cell);
+    steps_to_area(&cell, info->count, decoded);
+    return decoded->len;
+}
+
+// Gets the values of the (up to OLC_MAX_DIGITS) digits of a code, skipping the
+// separator and stopping at any padding.
+static size_t get_digits(const CodeInfo* info, uint8_t* digits)
+{
+    memcpy(digits, info->digits, info->count);
+    return info->count;
+}
+
+// Gets the digits of a code, if it is a valid full code; returns their number
+// or 0.
+static size_t get_full_digits(const char* code, size_t size, uint8_t* digits)
+{
+    CodeInfo info;
+    if (analyse(code, size, &info) <= 0) {
+        return 0;
+    }
+    if (!is_full(&info)) {
+        return 0;
+    }
+    return get_digits(&info, digits);
+}
+
+// Gets the size of a code in a fixed-width slot, without trailing blanks.
+static size_t slot_size(const char* code, size_t stride)
+{
+    size_t size = stride;
+    while (size > 0 && code[size - 1] == ' ') {
+        --size;
+    }
+    return size;
+}
+
+static void make_reference(const OLC_LatLon* location, Reference* reference)
+{
+    reference->lat = location->lat;
+    if (reference->lat < -kLatMaxDegrees) {
+        reference->lat = -kLatMaxDegrees;
+    }
+    if (reference->lat > kLatMaxDegrees) {
+        reference->lat = kLatMaxDegrees;
+    }
+    reference->lon = normalize_longitude(location->lon);
+    steps_to_digits(latitude_to_steps(reference->lat),
+                    longitude_to_steps(reference->lon), reference->digits);
+}
+
+static int shorten(const CodeInfo* info, const Reference* reference,
+                   char* shortened, int maxlen)
+{
+    if (info->pad_first > 0) {
+        return 0;
+    }
+    if (!is_full(info)) {
+        return 0;
+    }
+
+    OLC_CodeArea code_area;
+    decode(info, &code_area);
+    OLC_LatLon center;
+    OLC_GetCenter(&code_area, &center);
+
+    // Ensure that latitude and longitude are valid.
+    double lat = adjust_latitude(reference->lat, info->len);
+    double lon = reference->lon;
+
+    // How close are the latitude and longitude to the code center.
+    double alat = fabs(center.lat - lat);
+    double alon = fabs(center.lon - lon);
+    double range = alat > alon ? alat : alon;
+
+    // Yes, magic numbers... sob.
+    int start = 0;
+    const double safety_factor = 0.3;
+    const int removal_lengths[3] = { 8, 6, 4 };
+    for (int j = 0; j < sizeof(removal_lengths) / sizeof(removal_lengths[0]); ++j) {
+        // Check if we're close enough to shorten. The range must be less than
+        // 1/2 the resolution to shorten at all, and we want to allow some
+        // safety, so use 0.3 instead of 0.5 as a multiplier.
+        int removal_length = removal_lengths[j];
+        double area_edge = kLatResolution[removal_length] * safety_factor;
+        if (range < area_edge) {
+            start = removal_length;
+            break;
+        }
+    }
+    if (info->len - start >= maxlen) {
+        return 0;
+    }
+    int pos = 0;
+    for (int j = start; j < info->len; ++j) {
+        shortened[pos++] = info->code[j];
+    }
+    shortened[pos] = '\0';
+    return pos;
+}
+
+// Recovers a short code by prefixing it with the leading digits of the
+// reference location, and then moving the result by one cell of the prefix
+// resolution if that gets it closer to the reference.
+static int recover(const CodeInfo* info, const Reference* reference,
+                   char* code, int maxlen)
+{
+    if (!is_short(info)) {
+        return 0;
+    }
+    int len = code_length(info);
+
+    // Compute the number of digits we need to recover.
+    size_t padding_length = kSeparatorPosition - info->sep_first;
+
+    // A reference at the pole is moved into the code area, which depends on
+    // the length of the code.
+    double lat = adjust_latitude(reference->lat, len);
+    double lon = reference->lon;
+    uint8_t adjusted[OLC_MAX_DIGITS];
+    const uint8_t* prefix = reference->digits;
+    if (lat != reference->lat) {
+        steps_to_digits(latitude_to_steps(lat), longitude_to_steps(lon), adjusted);
+        prefix = adjusted;
+    }
+
+    // The resolution (height and width) of the padded area in degrees.
+    double lat_resolution = kLatResolution[padding_length];
+    double lon_resolution = kLonResolution[padding_length];
+
+    // Decode the reference digits followed by the digits of the short code.
+    uint8_t digits[kSeparatorPosition + OLC_MAX_DIGITS];
+    memcpy(digits, prefix, padding_length);
+    size_t count = padding_length + get_digits(info, digits + padding_length);
+    if (count > kMaxCodeLength) {
+        count = kMaxCodeLength;
+    }
+    CellSteps cell;
+    OLC_CodeArea code_area;
+    digits_to_steps(digits, count, &cell);
+    steps_to_area(&cell, count, &code_area);
+    OLC_LatLon center;
+    OLC_GetCenter(&code_area, &center);
+
+    // How many degrees latitude is the code from the reference?
+    if (lat + lat_resolution / 2 < center.lat && center.lat - lat_resolution > -kLatMaxDegrees) {
+        // If the proposed code is more than half a cell north of the reference
+        // location, it's too far, and the best match will be one cell south.
+        center.lat -= lat_resolution;
+    } else if (lat - lat_resolution / 2 > center.lat && center.lat + lat_resolution < kLatMaxDegrees) {
+        // If the proposed code is more than half a cell south of the reference
+        // location, it's too far, and the best match will be one cell north.
+        center.lat += lat_resolution;
+    }
+
+    // How many degrees longitude is the code from the reference?
+    if (lon + lon_resolution / 2 < center.lon) {
+        center.lon -= lon_resolution;
+    } else if (lon - lon_resolution / 2 > center.lon) {
+        center.lon += lon_resolution;
+    }
+
+    return OLC_Encode(&center, len + padding_length, code, maxlen);
+}
+
+// Computes the cell covered by a sequence of digits.
+static void digits_to_steps(const uint8_t* digits, size_t count,
+                            CellSteps* cell)
+{
+    int64_t lat = 0;
+    int64_t lon = 0;
+    size_t lat_pairs = 0;
+    size_t lon_pairs = 0;
+    size_t grid = 0;
+
+    // Up to the first 10 digits are encoded in pairs; subsequent digits
+    // represent grid squares.  Collect them all as integer steps.
+    for (size_t j = 0; j < count; ++j) {
+        int64_t value = digits[j];
+        if (j >= kPairCodeLength) {
+            lat = lat * kGridRows + value / kGridCols;
+            lon = (lon << 2) | (value % kGridCols);
+            ++grid;
+        } else if (j % 2) {
+            lon = lon * kEncodingBase + value;
+            ++lon_pairs;
+        } else {
+            lat = lat * kEncodingBase + value;
+            ++lat_pairs;
+        }
+    }
+
+    // Scale the digits we found up to the finest resolution, and get the size
+    // of the resulting cell in steps.
+    cell->lat_size = kPairPowers[kPairCodeLength / 2 - lat_pairs] * kGridLatSteps;
+    cell->lon_size = kPairPowers[kPairCodeLength / 2 - lon_pairs] * kGridLonSteps;
+    if (grid > 0) {
+        cell->lat_size = kRowPowers[kGridCodeLength - grid];
+        cell->lon_size = 1 << (2 * (kGridCodeLength - grid));
+    }
+    cell->lat = lat * cell->lat_size;
+    cell->lon = lon * cell->lon_size;
+}
+
+// Converts a cell from integer steps into degrees.
+static void steps_to_area(const CellSteps* cell, size_t len,
+                          OLC_CodeArea* decoded)
+{
+    decoded->lo.lat = cell->lat / kLatStepsPerDegree - kLatMaxDegrees;
+    decoded->lo.lon = cell->lon / kLonStepsPerDegree - kLonMaxDegrees;
+    decoded->hi.lat = (cell->lat + cell->lat_size) / kLatStepsPerDegree - kLatMaxDegrees;
+    decoded->hi.lon = (cell->lon + cell->lon_size) / kLonStepsPerDegree - kLonMaxDegrees;
+    decoded->len = len;
+}
+
+static size_t code_length(const CodeInfo* info)
+{
+    int len = info->len;
+    if (info->sep_first >= 0) {
+        --len;
+    }
+    if (info->pad_first >= 0) {
+        len = info->pad_first;
+    }
+    return len;
+}
+
+// Normalize a longitude into the range -180 to 180, not including 180.
+static double normalize_longitude(double lon_degrees)
+{
+    while (lon_degrees < -kLonMaxDegrees) {
+        lon_degrees += kLonMaxDegreesT2;
+    }
+    while (lon_degrees >= kLonMaxDegrees) {
+        lon_degrees -= kLonMaxDegreesT2;
+    }
+    return lon_degrees;
+}
+
+// Adjusts 90 degree latitude to be lower so that a legal OLC code can be
+// generated.
+static double adjust_latitude(double lat_degrees, size_t length)
+{
+    if (lat_degrees < -kLatMaxDegrees) {
+        lat_degrees = -kLatMaxDegrees;
+    }
+    if (lat_degrees >  kLatMaxDegrees) {
+        lat_degrees =  kLatMaxDegrees;
+    }
+    if (lat_degrees < kLatMaxDegrees) {
+        return lat_degrees;
+    }
+    // Subtract half the code precision to get the latitude into the code area.
+    if (length > kMaxCodeLength) {
+        length = kMaxCodeLength;
+    }
+    return lat_degrees - kLatResolution[length] / 2;
+}
+
+// Converts degrees into steps, rounding to a millionth of a step and then
+// truncating.  The result is still a double, so that callers can clamp it
+// before converting it to an integer.
+static double degrees_to_steps(double degrees, double steps_per_degree)
+{
+    return floor(round(degrees * steps_per_degree * kStepRounding) / kStepRounding);
+}
+
+// Converts a latitude into a number of steps north of the south pole.  Out of
+// range latitudes (and NaN) are clamped, and 90 degrees is moved into the
+// topmost cell so that a legal OLC code can be generated.  This has no
+// branches, so that loops calling it can be vectorized.
+static int64_t latitude_to_steps(double lat_degrees)
+{
+    double steps = degrees_to_steps(lat_degrees, kLatStepsPerDegree);
+    steps += kLatMaxDegrees * kLatStepsPerDegree;
+    steps = steps >= 0 ? steps : 0;
+    steps = steps < kLatSteps ? steps : kLatSteps - 1;
+    return (int64_t) steps;
+}
+
+// Converts a longitude into a number of steps east of the antimeridian,
+// normalising it into the range -180 to 180 (not including 180) first.  NaN
+// and infinite longitudes end up as 0.  This has no branches either.
+static int64_t longitude_to_steps(double lon_degrees)
+{
+    double turns = floor((lon_degrees + kLonMaxDegrees) / kLonMaxDegreesT2);
+    double lon = lon_degrees - turns * kLonMaxDegreesT2;
+    double steps = degrees_to_steps(lon, kLonStepsPerDegree);
+    steps += kLonMaxDegrees * kLonStepsPerDegree;
+    steps = steps >= 0 ? steps : 0;
+    steps = steps < kLonSteps ? steps : 0;
+    return (int64_t) steps;
+}
+
+// Converts an E7 latitude into steps, as latitude_to_steps() does.  Steps
+// are exactly 5/2 E7 units, and the division of a non-negative value floors.
+static int64_t latitude_e7_to_steps(int32_t lat_e7)
+{
+    int64_t lat = lat_e7;
+    lat = lat > -kLatMaxE7 ? lat : -kLatMaxE7;
+    lat = lat < kLatMaxE7 ? lat : kLatMaxE7;
+    int64_t steps = (lat + kLatMaxE7) * 5 / 2;
+    return steps < kLatSteps ? steps : kLatSteps - 1;
+}
+
+// Converts an E7 longitude into steps, as longitude_to_steps() does.  An
+// int32_t is less than one turn away from the range, so one correction is
+// enough.
+static int64_t longitude_e7_to_steps(int32_t lon_e7)
+{
+    int64_t lon = (int64_t) lon_e7 + kLonMaxE7;
+    lon += lon < 0 ? 2 * kLonMaxE7 : 0;
+    lon -= lon >= 2 * kLonMaxE7 ? 2 * kLonMaxE7 : 0;
+    return lon * 512 / 625;
+}
+
+// Converts a cell in steps into E7 corners, each rounded up to a whole unit.
+static void steps_to_area_e7(const CellSteps* cell, size_t len,
+                             OLC_CodeAreaE7* decoded)
+{
+    decoded->lo.lat = (cell->lat * 2 + 4) / 5 - kLatMaxE7;
+    decoded->lo.lon = (cell->lon * 625 + 511) / 512 - kLonMaxE7;
+    decoded->hi.lat = ((cell->lat + cell->lat_size) * 2 + 4) / 5 - kLatMaxE7;
+    decoded->hi.lon = ((cell->lon + cell->lon_size) * 625 + 511) / 512 - kLonMaxE7;
+    decoded->len = len;
+}
+
+// Number of digits actually produced when encoding with a given code length:
+// at least one pair and at most kMaxCodeLength digits, and pairs are always
+// complete, so odd lengths up to kPairCodeLength round up.
+static size_t encoded_digits(size_t length)
+{
+    if (length < 2) {
+        length = 2;
+    }
+    if (length > kMaxCodeLength) {
+        length = kMaxCodeLength;
+    }
+    if (length < kPairCodeLength && (length % 2)) {
+        ++length;
+    }
+    return length;
+}
+
+// Encodes a location, given as integer steps, into a full OLC, using pairs
+// and then, if the requested length indicates so, grid refinement.  If the
+// code does not fit into maxlen characters (including the NUL), nothing is
+// encoded and 0 is returned.
+static int encode_steps(int64_t lat, int64_t lon, size_t length,
+                        char* code, int maxlen)
+{
+    length = encoded_digits(length);
+    size_t len = length;
+    if (len > kPairCodeLength) {
+        len = kPairCodeLength;
+    }
+    int pos = encode_pairs(lat / kGridLatSteps, lon >> kGridLonBits, len, code, maxlen);
+    // If the requested length indicates we want grid refined codes.
+    if (pos > 0 && length > kPairCodeLength) {
+        int grid = encode_grid(lat % kGridLatSteps, lon & (kGridLonSteps - 1),
+                               length - kPairCodeLength, code + pos, maxlen - pos);
+        pos = grid > 0 ? pos + grid : 0;
+    }
+    if (pos == 0 && maxlen > 0) {
+        code[0] = '\0';
+    }
+    return pos;
+}
+
+// Encodes a location, given as a number of finest pair cells in each
+// direction, into a sequence of OLC lat/lon pairs.  This uses pairs of
+// characters (latitude and longitude in that order) to represent each step in
+// a 20x20 grid.  Each code, therefore, has 1/400th the area of the previous
+// code.  The digits are generated from the last to the first, each one as
+// the remainder of an integer division.
+static int encode_pairs(int64_t lat, int64_t lon, size_t length, char* code, int maxlen)
+{
+    // We need room for the digits, any padding, the separator and a NUL.
+    int width = (length < kSeparatorPosition ? kSeparatorPosition : length) + 1;
+    if (width >= maxlen) {
+        return 0;
+    }
+
+    // Drop the pairs that were not requested.
+    size_t pairs = length / 2;
+    lat /= kPairPowers[kPairCodeLength / 2 - pairs];
+    lon /= kPairPowers[kPairCodeLength / 2 - pairs];
+
+    for (size_t j = pairs; j-- > 0; ) {
+        // Digits after the separator position are shifted by one.
+        size_t pos = 2 * j;
+        if (pos >= kSeparatorPosition) {
+            ++pos;
+        }
+        code[pos] = kAlphabet[lat % kEncodingBase];
+        code[pos + 1] = kAlphabet[lon % kEncodingBase];
+        lat /= kEncodingBase;
+        lon /= kEncodingBase;
+    }
+    for (size_t pos = length; pos < kSeparatorPosition; ++pos) {
+        code[pos] = kPaddingCharacter;
+    }
+    code[kSeparatorPosition] = kSeparator;
+    code[width] = '\0';
+    return width;
+}
+
+// Encodes a location using the grid refinement method into an OLC string.  The
+// grid refinement method divides the area into a grid of 4x5, and uses a
+// single character to refine the area.  The grid squares use the OLC
+// characters in order to number the squares as follows:
+//
+//   R V W X
+//   J M P Q
+//   C F G H
+//   6 7 8 9
+//   2 3 4 5
+//
+// This allows default accuracy OLC codes to be refined with just a single
+// character.  The location is given as steps inside the enclosing pair cell:
+// rows are base 5 digits of lat, and columns are two bit fields of lon.
+static int encode_grid(int64_t lat, int64_t lon, size_t length,
+                       char* code, int maxlen)
+{
+    if ((int) length >= maxlen) {
+        return 0;
+    }
+
+    // Drop the grid levels that were not requested.
+    lat /= kRowPowers[kGridCodeLength - length];
+    lon >>= 2 * (kGridCodeLength - length);
+
+    for (size_t j = length; j-- > 0; ) {
+        size_t row = lat % kGridRows;
+        size_t col = lon & (kGridCols - 1);
+        lat /= kGridRows;
+        lon >>= 2;
+        code[j] = kAlphabet[row * kGridCols + col];
+    }
+    code[length] = '\0';
+    return length;
+}
+
+// Computes all OLC_MAX_DIGITS digit values for a location given as integer
+// steps.
+static void steps_to_digits(int64_t lat, int64_t lon, uint8_t* digits)
+{
+    int64_t lat_grid = lat % kGridLatSteps;
+    int64_t lon_grid = lon & (kGridLonSteps - 1);
+    lat /= kGridLatSteps;
+    lon >>= kGridLonBits;
+    for (size_t j = kPairCodeLength / 2; j-- > 0; ) {
+        digits[2 * j] = lat % kEncodingBase;
+        digits[2 * j + 1] = lon % kEncodingBase;
+        lat /= kEncodingBase;
+        lon /= kEncodingBase;
+    }
+    for (size_t j = kGridCodeLength; j-- > 0; ) {
+        digits[kPairCodeLength + j] = (lat_grid % kGridRows) * kGridCols + (lon_grid & (kGridCols - 1));
+        lat_grid /= kGridRows;
+        lon_grid >>= 2;
+    }
+}
+
+// Writes a sequence of digits as an OLC, with any padding and the separator.
+static int format_digits(const uint8_t* digits, size_t count,
+                         char* code, int maxlen)
+{
+    int width = (count < kSeparatorPosition ? kSeparatorPosition : count) + 1;
+    if (width >= maxlen) {
+        if (maxlen > 0) {
+            code[0] = '\0';
+        }
+        return 0;
+    }
+    int pos = 0;
+    for (size_t j = 0; j < count; ++j) {
+        if (pos == kSeparatorPosition) {
+            code[pos++] = kSeparator;
+        }
+        code[pos++] = kAlphabet[digits[j]];
+    }
+    while (pos < kSeparatorPosition) {
+        code[pos++] = kPaddingCharacter;
+    }
+    if (pos == kSeparatorPosition) {
+        code[pos++] = kSeparator;
+    }
+    code[pos] = '\0';
     return pos;
 }
+
+// Works out the digits of a tracked location, and the corners of its cells,
+// from a level on; the cells of the coarser levels hold the location.  Each
+// digit is the offset of the location in its parent cell, in cells.
+static void tracker_digits(OLC_Tracker* tracker, int64_t lat, int64_t lon, size_t level)
+{
+    size_t levels = level_of_length(tracker->length) + 1;
+    for (; level < levels; ++level) {
+        int64_t lat_size;
+        int64_t lon_size;
+        level_size(level, &lat_size, &lon_size);
+        int64_t lat_lo = level ? tracker->lat[level - 1] : 0;
+        int64_t lon_lo = level ? tracker->lon[level - 1] : 0;
+        int64_t row = (lat - lat_lo) / lat_size;
+        int64_t col = (lon - lon_lo) / lon_size;
+        if (level < kPairCodeLength / 2) {
+            tracker->digits[2 * level] = row;
+            tracker->digits[2 * level + 1] = col;
+        } else {
+            tracker->digits[level + kPairCodeLength / 2] = row * kGridCols + col;
+        }
+        tracker->lat[level] = lat_lo + row * lat_size;
+        tracker->lon[level] = lon_lo + col * lon_size;
+        tracker->inside[0] = tracker->lat[level] + kTrackerMargin;
+        tracker->inside[1] = tracker->lat[level] + lat_size - kTrackerMargin;
+        tracker->inside[2] = tracker->lon[level] + kTrackerMargin;
+        tracker->inside[3] = tracker->lon[level] + lon_size - kTrackerMargin;
+    }
+    tracker->levels = levels;
+}
+
+// Returns the width of the longest of the codes with the given lengths.
+static size_t multi_width(const size_t* lengths, size_t count)
+{
+    size_t width = 0;
+    for (size_t j = 0; j < count; ++j) {
+        size_t code_width = OLC_CodeWidth(lengths[j]);
+        if (code_width > width) {
+            width = code_width;
+        }
+    }
+    return width;
+}
+
+// Encodes a location, given as integer steps, with several code lengths into
+// slots of stride bytes, which must have room for them.  The longest code is
+// formatted once; each of the others is a prefix of it, padded if it is
+// shorter than the separator position.  Slot bytes after each code are set to
+// fill.
+static void encode_multi(int64_t lat, int64_t lon, const size_t* lengths, size_t count,
+                         char* out, size_t stride, char fill)
+{
+    size_t longest = 0;
+    for (size_t j = 0; j < count; ++j) {
+        size_t digits = encoded_digits(lengths[j]);
+        if (digits > longest) {
+            longest = digits;
+        }
+    }
+    uint8_t digits[OLC_MAX_DIGITS];
+    char full[kMaximumDigitCount + 2];
+    steps_to_digits(lat, lon, digits);
+    format_digits(digits, longest, full, sizeof(full));
+
+    for (size_t j = 0; j < count; ++j) {
+        char* slot = out + j * stride;
+        size_t length = encoded_digits(lengths[j]);
+        size_t width = length + 1;
+        if (length < kSeparatorPosition) {
+            memcpy(slot, full, length);
+            memset(slot + length, kPaddingCharacter, kSeparatorPosition - length);
+            slot[kSeparatorPosition] = kSeparator;
+            width = kSeparatorPosition + 1;
+        } else {
+            memcpy(slot, full, width);
+        }
+        memset(slot + width, fill, stride - width);
+    }
+}
+
+// Packs the digits of a full code; returns the number of digits packed, or 0
+// if they do not make up a legal full code.
+static int pack_digits(const uint8_t* digits, size_t count, OLC_Packed* packed)
+{
+    if (count < 2 || count > kMaxCodeLength) {
+        return 0;
+    }
+    if (count < kPairCodeLength && (count % 2)) {
+        return 0;
+    }
+    if (digits[0] >= kFirstLatValues || digits[1] >= kFirstLonValues) {
+        return 0;
+    }
+
+    size_t levels = count <= kPairCodeLength ? count / 2 : count - kPairCodeLength / 2;
+    uint64_t rank = (digits[0] * kFirstLonValues + digits[1]) * kPackedSpan[0];
+    for (size_t level = 1; level < levels; ++level) {
+        uint64_t value = 0;
+        if (level < kPairCodeLength / 2) {
+            value = digits[2 * level] * kEncodingBase + digits[2 * level + 1];
+        } else {
+            value = digits[level + kPairCodeLength / 2];
+        }
+        // The one accounts for the parent code, which comes first.
+        rank += 1 + value * kPackedSpan[level];
+    }
+    *packed = rank;
+    return count;
+}
+
+// Unpacks a packed code into its digits; returns the number of digits, or 0
+// if the packed code is not valid.
+static size_t unpack_digits(OLC_Packed packed, uint8_t* digits)
+{
+    if (packed >= kFirstLatValues * kFirstLonValues * kPackedSpan[0]) {
+        return 0;
+    }
+    uint64_t value = packed / kPackedSpan[0];
+    uint64_t rest = packed % kPackedSpan[0];
+    size_t count = 0;
+    digits[count++] = value / kFirstLonValues;
+    digits[count++] = value % kFirstLonValues;
+    for (size_t level = 1; level < kPackedLevels && rest > 0; ++level) {
+        --rest;
+        value = rest / kPackedSpan[level];
+        rest %= kPackedSpan[level];
+        if (level < kPairCodeLength / 2) {
+            digits[count++] = value / kEncodingBase;
+            digits[count++] = value % kEncodingBase;
+        } else {
+            digits[count++] = value;
+        }
+    }
+    return count;
+}
+
+// Gets the level (0 for the first pair) of a code length as returned by
+// encoded_digits().
+static size_t level_of_length(size_t length)
+{
+    return length <= kPairCodeLength ? length / 2 - 1 : length - kPairCodeLength / 2 - 1;
+}
+
+// Gets the code length of a level.
+static size_t length_of_level(size_t level)
+{
+    return level < kPairCodeLength / 2 ? 2 * (level + 1) : level + kPairCodeLength / 2 + 1;
+}
+
+// Gets the size in steps of the cells at a level.
+static void level_size(size_t level, int64_t* lat_size, int64_t* lon_size)
+{
+    if (level < kPairCodeLength / 2) {
+        *lat_size = kPairPowers[kPairCodeLength / 2 - 1 - level] * kGridLatSteps;
+        *lon_size = kPairPowers[kPairCodeLength / 2 - 1 - level] * kGridLonSteps;
+    } else {
+        *lat_size = kRowPowers[kPackedLevels - 1 - level];
+        *lon_size = 1 << (2 * (kPackedLevels - 1 - level));
+    }
+}
+
+// Great circle distance between two points given in degrees.
+static double distance_meters(double lat1, double lon1, double lat2, double lon2)
+{
+    double r = kPi / 180;
+    double slat = sin((lat2 - lat1) * r / 2);
+    double slon = sin((lon2 - lon1) * r / 2);
+    double a = slat * slat + cos(lat1 * r) * cos(lat2 * r) * slon * slon;
+    return 2 * kEarthRadiusMeters * asin(sqrt(a < 1 ? a : 1));
+}
+
+// Great circle distance from a point to the nearest point of a cell, both
+// given in degrees.  If the point is within the longitudes of the cell, the
+// nearest point is straight north or south of it; otherwise it is on the
+// nearest meridian edge, as close as the edge allows to the latitude where
+// that meridian gets closest.
+static double cell_distance(double lat, double lon, double lat0, double lat1,
+                            double lon0, double lon1)
+{
+    double near_lat = lat < lat0 ? lat0 : lat > lat1 ? lat1 : lat;
+    double near_lon = lon;
+    double offset = normalize_longitude(lon - lon0) + kLonMaxDegrees;
+    if (offset > lon1 - lon0 + kLonMaxDegrees || offset < kLonMaxDegrees) {
+        double west = normalize_longitude(lon - lon0);
+        double east = normalize_longitude(lon - lon1);
+        near_lon = fabs(west) < fabs(east) ? lon0 : lon1;
+        double dlon = fabs(west) < fabs(east) ? west : east;
+        // Along the meridian, the cosine of the distance goes with the
+        // cosine of the angle from best, which is past a pole when the
+        // meridian is over 90 degrees away; off the edge, the nearer end of
+        // it in that angle is the nearest.
+        double r = kPi / 180;
+        double best = atan2(sin(lat * r), cos(lat * r) * cos(dlon * r)) / r;
+        if (best >= lat0 && best <= lat1) {
+            near_lat = best;
+        } else {
+            near_lat = cos((lat0 - best) * r) > cos((lat1 - best) * r) ? lat0 : lat1;
+        }
+    }
+    return distance_meters(lat, lon, near_lat, near_lon);
+}
+
+// Works out whether a cell is outside, partially inside or inside a region.
+static int classify(const Region* region, const CellSteps* cell)
+{
+    int64_t lat_top = cell->lat + cell->lat_size - 1;
+    if (cell->lat > region->lat_hi || lat_top < region->lat_lo) {
+        return CELL_OUTSIDE;
+    }
+
+    if (!region->circle) {
+        // Try the cell where it is, and one turn further east, for ranges
+        // that cross the antimeridian.
+        int result = CELL_OUTSIDE;
+        for (int64_t turn = 0; turn <= kLonSteps; turn += kLonSteps) {
+            int64_t lo = cell->lon + turn;
+            int64_t hi = lo + cell->lon_size - 1;
+            if (lo > region->lon_hi || hi < region->lon_lo) {
+                continue;
+            }
+            if (lo >= region->lon_lo && hi <= region->lon_hi &&
+                cell->lat >= region->lat_lo && lat_top <= region->lat_hi) {
+                return CELL_INSIDE;
+            }
+            result = CELL_PARTIAL;
+        }
+        return result;
+    }
+
+    double lat0 = cell->lat / kLatStepsPerDegree - kLatMaxDegrees;
+    double lat1 = (cell->lat + cell->lat_size) / kLatStepsPerDegree - kLatMaxDegrees;
+    double lon0 = cell->lon / kLonStepsPerDegree - kLonMaxDegrees;
+    double lon1 = (cell->lon + cell->lon_size) / kLonStepsPerDegree - kLonMaxDegrees;
+    double lat = region->center.lat;
+    double lon = region->center.lon;
+    if (cell_distance(lat, lon, lat0, lat1, lon0, lon1) > region->radius) {
+        return CELL_OUTSIDE;
+    }
+
+    // Within 90 degrees of longitude of the center, the farthest point of a
+    // cell is one of its corners.  Farther away, a meridian edge can bulge
+    // away from the center between its corners, and the farthest point is
+    // the one nearest to the antipode of the center.
+    if (fabs(normalize_longitude(lon0 - lon)) <= 90 && fabs(normalize_longitude(lon1 - lon)) <= 90) {
+        if (distance_meters(lat, lon, lat0, lon0) <= region->radius &&
+            distance_meters(lat, lon, lat0, lon1) <= region->radius &&
+            distance_meters(lat, lon, lat1, lon0) <= region->radius &&
+            distance_meters(lat, lon, lat1, lon1) <= region->radius) {
+            return CELL_INSIDE;
+        }
+    } else if (kPi * kEarthRadiusMeters - cell_distance(-lat, normalize_longitude(lon + 180),
+                                                        lat0, lat1, lon0, lon1) <= region->radius) {
+        return CELL_INSIDE;
+    }
+    return CELL_PARTIAL;
+}
+
+// Finds the children of a cell (at the given level) that intersect a region.
+// If children is not null, they are written there, packed and in order;
+// returns their number.
+static size_t expand(const Region* region, OLC_Packed parent,
+                     const CellSteps* cell, size_t level, OLC_Packed* children)
+{
+    size_t rows = kEncodingBase;
+    size_t cols = kEncodingBase;
+    if (level + 1 >= kPairCodeLength / 2) {
+        rows = kGridRows;
+        cols = kGridCols;
+    }
+
+    CellSteps child;
+    child.lat_size = cell->lat_size / rows;
+    child.lon_size = cell->lon_size / cols;
+    size_t count = 0;
+    for (size_t row = 0; row < rows; ++row) {
+        child.lat = cell->lat + row * child.lat_size;
+        for (size_t col = 0; col < cols; ++col) {
+            child.lon = cell->lon + col * child.lon_size;
+            if (classify(region, &child) == CELL_OUTSIDE) {
+                continue;
+            }
+            if (children) {
+                children[count] = parent + 1 + (row * cols + col) * kPackedSpan[level + 1];
+            }
+            ++count;
+        }
+    }
+    return count;
+}
+
+// Covers a region with cells, refining partially covered ones one level at a
+// time.  Everything happens inside the cells buffer: each refinement pass
+// decides how many cells it can afford to expand, and then rewrites the
+// buffer from the end, so that no cell is overwritten before it is read.
+static size_t cover(const Region* region, size_t min_length, size_t max_length,
+                    size_t max_cells, OLC_Packed* cells)
+{
+    size_t min_level = level_of_length(encoded_digits(min_length));
+    size_t max_level = level_of_length(encoded_digits(max_length));
+    if (max_level < min_level) {
+        max_level = min_level;
+    }
+
+    // Start with all the cells at the minimum level that intersect the
+    // bounding rectangle of the region.
+    CellSteps cell;
+    level_size(min_level, &cell.lat_size, &cell.lon_size);
+    int64_t col_lo = region->lon_lo / cell.lon_size;
+    int64_t col_hi = region->lon_hi / cell.lon_size;
+    if (col_hi - col_lo >= kLonSteps / cell.lon_size) {
+        col_hi = col_lo + kLonSteps / cell.lon_size - 1;
+    }
+    size_t count = 0;
+    uint8_t digits[OLC_MAX_DIGITS];
+    for (int64_t row = region->lat_lo / cell.lat_size; row <= region->lat_hi / cell.lat_size; ++row) {
+        for (int64_t col = col_lo; col <= col_hi; ++col) {
+            cell.lat = row * cell.lat_size;
+            cell.lon = (col * cell.lon_size) % kLonSteps;
+            if (classify(region, &cell) == CELL_OUTSIDE) {
+                continue;
+            }
+            if (count >= max_cells) {
+                return 0;
+            }
+            steps_to_digits(cell.lat, cell.lon, digits);
+            pack_digits(digits, length_of_level(min_level), &cells[count++]);
+        }
+    }
+
+    for (size_t level = min_level; level < max_level; ++level) {
+        // Decide which partial cells at this level get expanded: all of
+        // them, in order, while the covering stays within max_cells.
+        size_t total = count;
+        size_t cutoff = count;
+        size_t expanded = 0;
+        for (size_t j = 0; j < count; ++j) {
+            size_t length = unpack_digits(cells[j], digits);
+            if (level_of_length(length) != level) {
+                continue;
+            }
+            digits_to_steps(digits, length, &cell);
+            if (classify(region, &cell) != CELL_PARTIAL) {
+                continue;
+            }
+            size_t children = expand(region, cells[j], &cell, level, 0);
+            if (!children) {
+                continue;
+            }
+            if (total - 1 + children > max_cells) {
+                cutoff = j;
+                break;
+            }
+            total += children - 1;
+            ++expanded;
+        }
+        if (!expanded) {
+            break;
+        }
+
+        // Rewrite the cells from the end, expanding the chosen ones.
+        size_t write = total;
+        for (size_t j = count; j-- > 0; ) {
+            OLC_Packed packed = cells[j];
+            size_t children = 0;
+            if (j < cutoff) {
+                size_t length = unpack_digits(packed, digits);
+                digits_to_steps(digits, length, &cell);
+                if (level_of_length(length) == level &&
+                    classify(region, &cell) == CELL_PARTIAL) {
+                    children = expand(region, packed, &cell, level, 0);
+                }
+            }
+            if (children) {
+                write -= children;
+                expand(region, packed, &cell, level, cells + write);
+            } else {
+                cells[--write] = packed;
+            }
+        }
+        // If we ran out of room, the covering cannot get any better.
+        int exhausted = cutoff < count;
+        count = total;
+        if (exhausted) {
+            break;
+        }
+    }
+
+    qsort(cells, count, sizeof(OLC_Packed), compare_packed);
+    return count;
+}
+
+static int compare_packed(const void* a, const void* b)
+{
+    OLC_Packed pa = *(const OLC_Packed*) a;
+    OLC_Packed pb = *(const OLC_Packed*) b;
+    return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
+
+// Gets how far a position in steps is from the south or west edge of a cell,
+// in cells; around is the number of cells around the globe, or 0 if the
+// position does not wrap, and a wrapped one is taken on the side nearest to
+// the cell.
+static double cell_offset(double steps, int64_t cell, int64_t size, int64_t around)
+{
+    double offset = steps / size - cell;
+    if (around && offset > around / 2) {
+        offset -= around;
+    } else if (around && offset < -around / 2) {
+        offset += around;
+    }
+    return offset;
+}
+
+// Gets the fraction of a segment, starting at offset within a cell and going
+// delta cells, at which it first leaves the cell in the direction of step;
+// if it does not go that way, never.
+static double next_crossing(double offset, double delta, int64_t step)
+{
+    if (step > 0 && delta > 0) {
+        return (1 - offset) / delta;
+    }
+    if (step < 0 && delta < 0) {
+        return offset / -delta;
+    }
+    return HUGE_VAL;
+}
+
+// Gets the cells of the same length at most k cells away from a code, moving
+// directly on its integer steps: adding a multiple of the cell size carries
+// over from grid digits into pair digits, and from pair to pair.
+static size_t ring(OLC_Packed code, size_t k, int skip_center,
+                   OLC_Packed* cells, size_t maxcount)
+{
+    uint8_t digits[OLC_MAX_DIGITS];
+    size_t length = unpack_digits(code, digits);
+    if (!length) {
+        return 0;
+    }
+    CellSteps cell;
+    digits_to_steps(digits, length, &cell);
+
+    // There may be fewer than 2k+1 rows between the poles, or cells in a row
+    // around the globe.
+    int64_t span = kLatSteps / cell.lat_size;
+    if (k < (uint64_t) span) {
+        span = k;
+    }
+    int64_t cols = 2 * span + 1;
+    int64_t around = kLonSteps / cell.lon_size;
+    if (cols > around) {
+        cols = around;
+    }
+    if ((uint64_t) (2 * span + 1) * cols > maxcount + skip_center) {
+        return 0;
+    }
+
+    size_t count = 0;
+    for (int64_t row = -span; row <= span; ++row) {
+        int64_t lat = cell.lat + row * cell.lat_size;
+        if (lat < 0 || lat >= kLatSteps) {
+            continue;
+        }
+        for (int64_t col = -span; col < cols - span; ++col) {
+            if (skip_center && row == 0 && col == 0) {
+                continue;
+            }
+            int64_t lon = (cell.lon + col * cell.lon_size) % kLonSteps;
+            if (lon < 0) {
+                lon += kLonSteps;
+            }
+            steps_to_digits(lat, lon, digits);
+            pack_digits(digits, length, &cells[count++]);
+        }
+    }
+    return count;
+}
@@ -1,6 +1,18 @@
 #ifndef OLC_OPENLOCATIONCODE_H_
 #define OLC_OPENLOCATIONCODE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+// Maximum number of digits that are encoded or decoded; longer codes are
+// valid, but their extra digits are ignored
+#define OLC_MAX_DIGITS 15
+
+// Per-code status reported by the batch functions
+#define OLC_STATUS_OK      0  // code was valid and processed
+#define OLC_STATUS_INVALID 1  // code was not valid
+#define OLC_STATUS_SHORT   2  // code was valid, but short where a full one is needed
+
 // A pair of doubles representing latitude / longitude
 typedef struct OLC_LatLon {
     double lat;
@@ -14,6 +26,41 @@ typedef struct OLC_CodeArea {
     size_t len;
 } OLC_CodeArea;
 
+// A location as integer latitude and longitude in units of 1e-7 degree (E7),
+// as carried by many wire formats
+typedef struct OLC_LatLonE7 {
+    int32_t lat;
+    int32_t lon;
+} OLC_LatLonE7;
+
+// An area with E7 corners, see OLC_DecodeE7
+typedef struct OLC_CodeAreaE7 {
+    OLC_LatLonE7 lo;
+    OLC_LatLonE7 hi;
+    size_t len;
+} OLC_CodeAreaE7;
+
+// A full code packed into 64 bits.  Packed codes sort in the same order as
+// the (upper case) code strings, and a code comes right before all the codes
+// it contains, so these are a contiguous range of packed values.
+typedef uint64_t OLC_Packed;
+
+// A code parsed once by OLC_Parse, to be passed to the OLC_Parsed functions
+// instead of the string, which must outlive it.  The fields are private and
+// may change.
+typedef struct OLC_Parsed {
+    const char* code;
+    int size;
+    int len;
+    int sep_first;
+    int sep_last;
+    int pad_first;
+    int pad_last;
+    int valid;
+    int count;
+    uint8_t digits[OLC_MAX_DIGITS];
+} OLC_Parsed;
+
 // Gets the center coordinates for an area
 void OLC_GetCenter(const OLC_CodeArea* area, OLC_LatLon* center);
 
@@ -25,6 +72,21 @@ int OLC_IsValid(const char* code, size_t size);
 int OLC_IsShort(const char* code, size_t size);
 int OLC_IsFull(const char* code, size_t size);
 
+// Parse and validate a code in a single pass.  Returns 1 if the code is
+// valid, 0 otherwise; either way, the result can be passed to the functions
+// below, which give the same results as the functions taking a string.
+int OLC_Parse(const char* code, size_t size, OLC_Parsed* parsed);
+
+size_t OLC_ParsedCodeLength(const OLC_Parsed* parsed);
+int OLC_ParsedIsValid(const OLC_Parsed* parsed);
+int OLC_ParsedIsShort(const OLC_Parsed* parsed);
+int OLC_ParsedIsFull(const OLC_Parsed* parsed);
+int OLC_ParsedDecode(const OLC_Parsed* parsed, OLC_CodeArea* decoded);
+int OLC_ParsedShorten(const OLC_Parsed* parsed, const OLC_LatLon* reference,
+                      char* buf, int maxlen);
+int OLC_ParsedRecoverNearest(const OLC_Parsed* parsed, const OLC_LatLon* reference,
+                             char* code, int maxlen);
+
 // Encode a location with a given code length (which indicates precision) into
 // an OLC
 int OLC_Encode(const OLC_LatLon* location, size_t code_length,
@@ -34,9 +96,237 @@ int OLC_Encode(const OLC_LatLon* location, size_t code_length,
 int OLC_EncodeDefault(const OLC_LatLon* location,
                       char* code, int maxlen);
 
+// Get the number of characters (including padding and separator) in a code
+// encoded with a given code length
+size_t OLC_CodeWidth(size_t code_length);
+
+// Get the number of digits in a code encoded with a given code length: the
+// length is kept between 2 and OLC_MAX_DIGITS, and raised to an even number
+// within the pairs
+size_t OLC_EncodedLength(size_t code_length);
+
+// Encode n locations, given as separate latitude and longitude columns, with
+// the same code length.  Each code is written into its own fixed-width slot of
+// stride bytes, without a terminating NUL; slot bytes after the code are
+// filled with spaces.  Returns the width of each code, or 0 if it does not fit
+// into stride bytes.
+size_t OLC_EncodeBatch(const double* lat, const double* lon, size_t n,
+                       size_t code_length, char* out, size_t stride);
+
+// Same as OLC_EncodeBatch, for an array of locations
+size_t OLC_EncodeBatchLocations(const OLC_LatLon* locations, size_t n,
+                                size_t code_length, char* out, size_t stride);
+
+// Encode a location with n code lengths at once; the digits are worked out
+// once, for the longest code, and the others are cut from it.  The code for
+// lengths[j] is written NUL terminated at out + j * stride.  Returns n, or 0
+// if one of the codes does not fit into stride bytes, in which case nothing is
+// written.
+int OLC_EncodeMulti(const OLC_LatLon* location, const size_t* lengths, size_t n,
+                    char* out, size_t stride);
+
+// Same as OLC_EncodeMulti, for n locations given as separate latitude and
+// longitude columns.  The codes of location j, one per length, go into count
+// consecutive slots starting at out + j * count * stride, which are filled as
+// for OLC_EncodeBatch.  Returns the width of the longest code, or 0 if it does
+// not fit into stride bytes.
+size_t OLC_EncodeMultiBatch(const double* lat, const double* lon, size_t n,
+                            const size_t* lengths, size_t count,
+                            char* out, size_t stride);
+
 // Decode an OLC into the original location
 int OLC_Decode(const char* code, size_t size, OLC_CodeArea* decoded);
 
+// Decode n full codes, each in its own slot of stride bytes (ending at a NUL,
+// at trailing blanks or at the end of the slot), into separate columns.  A
+// code that cannot be decoded gets its status set accordingly, NaN corners
+// and a length of 0, without stopping the batch.  Returns the number of
+// codes that were decoded.
+size_t OLC_DecodeBatch(const char* codes, size_t stride, size_t n,
+                       double* lo_lat, double* lo_lon,
+                       double* hi_lat, double* hi_lon,
+                       uint8_t* len, uint8_t* status);
+
+// Validate n codes, in slots as for OLC_DecodeBatch, setting the status of
+// each to the one OLC_DecodeBatch would give it.  Returns the number of valid
+// codes, full or not.
+size_t OLC_ValidateBatch(const char* codes, size_t stride, size_t n, uint8_t* status);
+
+// Same as OLC_Encode, for a location in E7 units, using integer arithmetic
+// only.  A location on the edge between two cells goes into the cell north or
+// east of it.  Latitudes are clamped to [-90, 90], with 90 going into the
+// topmost cell, and longitudes are normalised into [-180, 180).  The result
+// is the same as that of OLC_Encode for the location in degrees.
+int OLC_EncodeE7(const OLC_LatLonE7* location, size_t code_length,
+                 char* code, int maxlen);
+
+// Same as OLC_EncodeBatch, for E7 latitude and longitude columns
+size_t OLC_EncodeBatchE7(const int32_t* lat, const int32_t* lon, size_t n,
+                         size_t code_length, char* out, size_t stride);
+
+// Same as OLC_Decode, with the corners in E7 units, using integer arithmetic
+// only.  Cell edges are not always whole E7 units; each corner is rounded up
+// to the next one, so that the E7 locations from lo (included) to hi (not
+// included) are exactly those that OLC_EncodeE7 puts into the cell.  Cells of
+// 15 digit codes are 0.4 units high, so for some of them that range is empty.
+int OLC_DecodeE7(const char* code, size_t size, OLC_CodeAreaE7* decoded);
+
+// Same as OLC_DecodeBatch, with E7 corners; a code that cannot be decoded
+// gets corners of 0.
+size_t OLC_DecodeBatchE7(const char* codes, size_t stride, size_t n,
+                         int32_t* lo_lat, int32_t* lo_lon,
+                         int32_t* hi_lat, int32_t* hi_lon,
+                         uint8_t* len, uint8_t* status);
+
+// The code of a moving location, kept up to date by OLC_TrackerUpdate.  The
+// fields are private and may change.
+typedef struct OLC_Tracker {
+    int length;                     // number of digits in the code
+    int changed;                    // length of the coarsest cell that changed
+    int levels;                     // number of cells below, 0 before the first update
+    double inside[4];               // bounds, in steps, of the inner part of the cell
+    int64_t lat[10];                // south west corners of the cells of the
+    int64_t lon[10];                // code and its parents, in steps
+    uint8_t digits[OLC_MAX_DIGITS];
+} OLC_Tracker;
+
+// Start tracking a location with codes of a given length
+void OLC_TrackerInit(OLC_Tracker* tracker, size_t code_length);
+
+// Move the tracked location.  Only the digits of the cells the location has
+// left are worked out again; while it stays in the same cell, there is no
+// digit work at all.  Returns the code length of the coarsest cell that
+// changed, or 0 if the code did not change; the first update changes them
+// all.
+int OLC_TrackerUpdate(OLC_Tracker* tracker, const OLC_LatLon* location);
+
+// Check whether the cell of a given code length, up to the length of the
+// tracker, changed with the last update
+int OLC_TrackerChanged(const OLC_Tracker* tracker, size_t code_length);
+
+// Get the current code of a tracker; returns its length, or 0 if it does not
+// fit or there has been no update yet
+int OLC_TrackerCode(const OLC_Tracker* tracker, char* code, int maxlen);
+
+// Instruction sets the batch functions can use to check and decode several
+// codes at once; the best one the CPU supports is picked at run time.
+#define OLC_SIMD_NONE  0  // portable code, one character at a time
+#define OLC_SIMD_SSSE3 1  // one code per 16 byte vector
+#define OLC_SIMD_AVX2  2  // two codes per 32 byte vector
+
+// Get the instruction set used by the batch functions
+int OLC_GetSimd(void);
+
+// Set the best instruction set the batch functions may use, for instance to
+// compare them with the portable code; returns the one they will use.  Must
+// not be called while batch functions are running on other threads.
+int OLC_SetSimd(int simd);
+
+// Pack a full code into 64 bits; returns the code length, or 0 if the code is
+// not a valid full code
+int OLC_Pack(const char* code, size_t size, OLC_Packed* packed);
+
+// Unpack a packed code into an OLC; returns the length of the string, or 0
+// if the packed code is not valid or does not fit
+int OLC_Unpack(OLC_Packed packed, char* code, int maxlen);
+
+// Encode a location with a given code length directly into a packed code;
+// returns the code length
+int OLC_EncodePacked(const OLC_LatLon* location, size_t code_length,
+                     OLC_Packed* packed);
+
+// Encode a location with n code lengths at once into packed codes, the one
+// for lengths[j] going to packed[j]; the digits are worked out once, as with
+// OLC_EncodeMulti.  Returns n.
+int OLC_EncodePackedMulti(const OLC_LatLon* location, const size_t* lengths, size_t n,
+                          OLC_Packed* packed);
+
+// Decode a packed code into the original location; returns the code length,
+// or 0 if the packed code is not valid
+int OLC_DecodePacked(OLC_Packed packed, OLC_CodeArea* decoded);
+
+// Get the length of a packed code, or 0 if it is not valid
+size_t OLC_PackedLength(OLC_Packed packed);
+
+// Get the largest packed value among all the codes contained in a packed
+// code (including itself); they range from packed to this value
+OLC_Packed OLC_PackedLastDescendant(OLC_Packed packed);
+
+// Get the number of packed values a code of a given length (rounded as
+// OLC_EncodedLength does) and the codes it contains take up
+uint64_t OLC_PackedSpan(size_t code_length);
+
+// Compute a covering of the rectangle from lo to hi (edges included; it
+// crosses the antimeridian if lo->lon > hi->lon): a set of disjoint cells,
+// between min_length and max_length digits long, that together contain all
+// of it.  Cells that are only partially covered are refined for as long as
+// the covering stays within max_cells cells.  The packed cells are written,
+// sorted, into cells, which needs room for max_cells entries; returns their
+// number, or 0 if covering at min_length already takes more than max_cells.
+size_t OLC_CoverBBox(const OLC_LatLon* lo, const OLC_LatLon* hi,
+                     size_t min_length, size_t max_length, size_t max_cells,
+                     OLC_Packed* cells);
+
+// Same as OLC_CoverBBox, for the circle of radius_meters around center
+size_t OLC_CoverCircle(const OLC_LatLon* center, double radius_meters,
+                       size_t min_length, size_t max_length, size_t max_cells,
+                       OLC_Packed* cells);
+
+// Get the cells of the same length around a packed code, row by row from
+// south-west to north-east.  Longitudes wrap around the antimeridian, and
+// rows beyond a pole are left out.  neighbors needs room for 8 entries;
+// returns the number of cells written, or 0 if the code is not valid.
+int OLC_Neighbors(OLC_Packed code, OLC_Packed* neighbors);
+
+// Get the cells of the same length that are at most k cells away from a
+// packed code (the code itself included), in the same order and with the
+// same rules as OLC_Neighbors.  Returns the number of cells written, which
+// is at most (2k+1)^2, or 0 if they do not fit into maxcount entries.
+size_t OLC_KRing(OLC_Packed code, size_t k, OLC_Packed* cells, size_t maxcount);
+
+// Called by OLC_TraversePolyline for each cell, with the positions along the
+// polyline where it enters and leaves the cell; position j + t is the point a
+// fraction t of the way from points[j] to points[j + 1].  Returning nonzero
+// stops the walk.
+typedef int (OLC_TraverseFunc)(void* data, OLC_Packed cell, double enter, double exit);
+
+// Walk the cells of a code length that a polyline of n points passes
+// through, in order, and call func for each of them.  Each step goes to a
+// cell sharing an edge with the one before, so there are no gaps; where the
+// line goes exactly through a corner, one of the two cells beside it is
+// taken.  Segments take the shorter way around, across the antimeridian if
+// need be.  A cell is reported once for each time the polyline enters it;
+// the first and last cells are those of the first and last points, as
+// OLC_EncodePacked gives them.  Returns the number of cells reported.
+size_t OLC_TraversePolyline(const OLC_LatLon* points, size_t n, size_t code_length,
+                            OLC_TraverseFunc* func, void* data);
+
+// Get the code that contains a full code at a shorter length, padded and
+// separated as needed; returns the length of the string, or 0 if the code is
+// not a valid full code or the parent does not fit
+int OLC_Parent(const char* code, size_t size, size_t parent_length,
+               char* parent, int maxlen);
+
+// Get the codes one level below a full code (400 of them below a pair code,
+// 20 below a grid code), in order, each in its own slot of stride bytes as
+// written by OLC_EncodeBatch; returns their number, or 0 if the code is not
+// a valid full code, already has OLC_MAX_DIGITS digits, or its children do
+// not fit into stride bytes
+size_t OLC_Children(const char* code, size_t size, char* children, size_t stride);
+
+// Check whether a full code is contained in (or the same as) another one
+int OLC_Contains(const char* parent, size_t parent_size,
+                 const char* child, size_t child_size);
+
+// Same as OLC_Parent, for packed codes; returns the parent length
+int OLC_PackedParent(OLC_Packed code, size_t parent_length, OLC_Packed* parent);
+
+// Same as OLC_Children, for packed codes; children needs room for 400 entries
+size_t OLC_PackedChildren(OLC_Packed code, OLC_Packed* children);
+
+// Same as OLC_Contains, for packed codes
+int OLC_PackedContains(OLC_Packed parent, OLC_Packed child);
+
 // Compute a (shorter) OLC for a given code and a reference location
 int OLC_Shorten(const char* code, size_t size, const OLC_LatLon* reference,
                 char* buf, int maxlen);
@@ -46,4 +336,107 @@ int OLC_Shorten(const char* code, size_t size, const OLC_LatLon* reference,
 int OLC_RecoverNearest(const char* short_code, size_t size, const OLC_LatLon* reference,
                        char* code, int maxlen);
 
+// Same as OLC_Shorten, for n codes in slots of stride bytes (as for
+// OLC_DecodeBatch) and the same reference location, which is prepared only
+// once.  Each result goes into its own slot of out_stride bytes, filled with
+// spaces after the code; a code that cannot be shortened, or does not fit,
+// gets a blank slot and its status set accordingly.  Returns the number of
+// codes that were shortened.
+size_t OLC_ShortenBatch(const char* codes, size_t stride, size_t n,
+                        const OLC_LatLon* reference,
+                        char* out, size_t out_stride, uint8_t* status);
+
+// Same as OLC_RecoverNearest, for n short codes and the same reference
+// location, with slots and statuses as for OLC_ShortenBatch.  Returns the
+// number of codes that were recovered.
+size_t OLC_RecoverNearestBatch(const char* short_codes, size_t stride, size_t n,
+                               const OLC_LatLon* reference,
+                               char* out, size_t out_stride, uint8_t* status);
+
+// Called by OLC_ScanText for each code found, with its offset in the text,
+// its size and whether it is a full code (or else a short one).  Returning
+// nonzero stops the scan.
+typedef int (OLC_ScanFunc)(void* data, size_t offset, size_t size, int full);
+
+// Find the valid full and short codes in n bytes of text, in a single pass.
+// A code must be a whole word, with no letter, digit or '+' right before or
+// after it.  Returns the number of codes found.
+size_t OLC_ScanText(const char* text, size_t n, OLC_ScanFunc* func, void* data);
+
+// Statistics, kept only when the library is built with OLC_STATS=1; without
+// it, they cost nothing and OLC_GetStats returns 0.  The functions counted:
+#define OLC_API_CODE_LENGTH            0
+#define OLC_API_IS_VALID               1
+#define OLC_API_IS_SHORT               2
+#define OLC_API_IS_FULL                3
+#define OLC_API_PARSE                  4
+#define OLC_API_ENCODE                 5  // and OLC_EncodeDefault
+#define OLC_API_ENCODE_BATCH           6  // and OLC_EncodeBatchLocations
+#define OLC_API_DECODE                 7
+#define OLC_API_DECODE_BATCH           8
+#define OLC_API_VALIDATE_BATCH         9
+#define OLC_API_PACK                  10
+#define OLC_API_UNPACK                11
+#define OLC_API_ENCODE_PACKED         12
+#define OLC_API_DECODE_PACKED         13
+#define OLC_API_SHORTEN               14
+#define OLC_API_SHORTEN_BATCH         15
+#define OLC_API_RECOVER_NEAREST       16
+#define OLC_API_RECOVER_NEAREST_BATCH 17
+#define OLC_API_SCAN_TEXT             18
+#define OLC_API_ENCODE_MULTI          19
+#define OLC_API_ENCODE_MULTI_BATCH    20
+#define OLC_API_ENCODE_E7             21
+#define OLC_API_ENCODE_BATCH_E7       22
+#define OLC_API_DECODE_E7             23
+#define OLC_API_DECODE_BATCH_E7       24
+#define OLC_API_TRACKER_UPDATE        25
+#define OLC_API_ENCODE_PACKED_MULTI   26
+#define OLC_API_TRAVERSE_POLYLINE     27
+#define OLC_API_COUNT                 28
+
+// The rules a code can break, in the order they are checked
+#define OLC_REJECT_NULL                0  // no code at all
+#define OLC_REJECT_CHARACTER           1  // a character not in a code
+#define OLC_REJECT_EMPTY               2  // nothing before a NUL or the end
+#define OLC_REJECT_NO_SEPARATOR        3
+#define OLC_REJECT_SEPARATORS          4  // more than one separator
+#define OLC_REJECT_SEPARATOR_ONLY      5
+#define OLC_REJECT_SEPARATOR_POSITION  6  // odd, or after the 8th character
+#define OLC_REJECT_PADDING_FIRST       7  // padding at the start
+#define OLC_REJECT_PADDING_POSITION    8  // padding at an odd position
+#define OLC_REJECT_PADDING_SEPARATOR   9  // padding not followed by a final separator
+#define OLC_REJECT_PADDING_GAP        10  // digits between padding characters
+#define OLC_REJECT_SINGLE_DIGIT       11  // a single digit after the separator
+#define OLC_REJECT_TOO_LONG           12  // too many digits in all
+#define OLC_REJECT_TOO_LONG_AFTER     13  // too many digits after the separator
+#define OLC_REJECT_COUNT              14
+
+// Latency buckets: bucket b counts the calls that took from 2^(b-1) to 2^b
+// ticks (bucket 0, less than one).
+#define OLC_STATS_BUCKETS 32
+
+// Code lengths are counted up to this
+#define OLC_STATS_LENGTHS 33
+
+// Statistics summed over all threads since the last OLC_ResetStats
+typedef struct OLC_Stats {
+    uint64_t calls[OLC_API_COUNT];
+    uint64_t items[OLC_API_COUNT];     // codes, locations or bytes of text
+    uint64_t latency[OLC_API_COUNT][OLC_STATS_BUCKETS];
+    uint64_t rejects[OLC_REJECT_COUNT];
+    uint64_t lengths[OLC_STATS_LENGTHS]; // valid codes by OLC_CodeLength
+    double ns_per_tick;
+} OLC_Stats;
+
+// Get the statistics; returns 0 (and all zeros) if they are not kept
+int OLC_GetStats(OLC_Stats* stats);
+
+// Start counting again from zero
+void OLC_ResetStats(void);
+
+// Get the names of the counted functions and rules, for reports
+const char* OLC_StatsApiName(int api);
+const char* OLC_StatsRejectName(int reject);
+
 #endif
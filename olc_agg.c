@@ -0,0 +1,164 @@
+#include <stdlib.h>
+#include <string.h>
+#include "olc_agg.h"
+#include "olc_internal.h"
+
+// Locations encoded before their cells are updated; the slots of a whole
+// chunk are fetched ahead, so that the cache misses overlap.
+#define AGG_CHUNK 64
+
+#if defined(__GNUC__)
+#define AGG_PREFETCH(p) __builtin_prefetch(p, 1)
+#else
+#define AGG_PREFETCH(p) ((void) 0)
+#endif
+
+struct OLC_Aggregator {
+    size_t lengths[OLC_MAX_DIGITS];
+    size_t count;           // of lengths
+    OlcTable cells;         // of OLC_CellStats
+};
+
+static OLC_CellStats* find_cell(OLC_Aggregator* agg, size_t slot, OLC_Packed code);
+static int compare_cells(const void* a, const void* b);
+
+OLC_Aggregator* OLC_AggregatorCreate(const size_t* lengths, size_t n)
+{
+    OLC_Aggregator* agg = n ? calloc(1, sizeof(OLC_Aggregator)) : 0;
+    if (!agg) {
+        return 0;
+    }
+    for (size_t j = 0; j < n; ++j) {
+        size_t length = OLC_EncodedLength(lengths[j]);
+        size_t k = 0;
+        while (k < agg->count && agg->lengths[k] != length) {
+            ++k;
+        }
+        if (k == agg->count) {
+            agg->lengths[agg->count++] = length;
+        }
+    }
+    if (!olc_table_init(&agg->cells, sizeof(OLC_CellStats))) {
+        free(agg);
+        return 0;
+    }
+    return agg;
+}
+
+void OLC_AggregatorDestroy(OLC_Aggregator* agg)
+{
+    if (agg) {
+        olc_table_free(&agg->cells);
+        free(agg);
+    }
+}
+
+int OLC_AggregatorAdd(OLC_Aggregator* agg, const double* lat, const double* lon,
+                      const double* weights, size_t n)
+{
+    OLC_Packed codes[AGG_CHUNK * OLC_MAX_DIGITS];
+    size_t slots[AGG_CHUNK * OLC_MAX_DIGITS];
+    for (size_t start = 0; start < n; start += AGG_CHUNK) {
+        size_t m = n - start < AGG_CHUNK ? n - start : AGG_CHUNK;
+        // Room for a whole chunk of new cells, so that the slots stay put.
+        if (!olc_table_reserve(&agg->cells, agg->cells.size + m * agg->count)) {
+            return 0;
+        }
+        for (size_t j = 0; j < m; ++j) {
+            OLC_LatLon location = { lat[start + j], lon[start + j] };
+            OLC_EncodePackedMulti(&location, agg->lengths, agg->count,
+                                  codes + j * agg->count);
+        }
+        size_t total = m * agg->count;
+        const OLC_CellStats* cells = agg->cells.entries;
+        for (size_t k = 0; k < total; ++k) {
+            slots[k] = olc_table_slot(&agg->cells, codes[k]);
+            AGG_PREFETCH(&cells[slots[k]]);
+        }
+        for (size_t k = 0; k < total; ++k) {
+            double weight = weights ? weights[start + k / agg->count] : 1;
+            OLC_CellStats* cell = find_cell(agg, slots[k], codes[k]);
+            ++cell->count;
+            cell->sum += weight;
+            if (cell->count == 1 || weight < cell->min) {
+                cell->min = weight;
+            }
+            if (cell->count == 1 || weight > cell->max) {
+                cell->max = weight;
+            }
+        }
+    }
+    return 1;
+}
+
+int OLC_AggregatorMerge(OLC_Aggregator* into, const OLC_Aggregator* from)
+{
+    if (!olc_table_reserve(&into->cells, into->cells.size + from->cells.size)) {
+        return 0;
+    }
+    const OLC_CellStats* others = from->cells.entries;
+    for (size_t j = 0; j < from->cells.capacity; ++j) {
+        const OLC_CellStats* other = &others[j];
+        if (other->code == OLC_TABLE_EMPTY) {
+            continue;
+        }
+        OLC_CellStats* cell = find_cell(into, olc_table_slot(&into->cells, other->code),
+                                        other->code);
+        if (cell->count == 0 || other->min < cell->min) {
+            cell->min = other->min;
+        }
+        if (cell->count == 0 || other->max > cell->max) {
+            cell->max = other->max;
+        }
+        cell->count += other->count;
+        cell->sum += other->sum;
+    }
+    return 1;
+}
+
+size_t OLC_AggregatorSize(const OLC_Aggregator* agg)
+{
+    return agg->cells.size;
+}
+
+size_t OLC_AggregatorCells(const OLC_Aggregator* agg, OLC_CellStats* cells,
+                           size_t maxcount)
+{
+    if (agg->cells.size > maxcount) {
+        return 0;
+    }
+    const OLC_CellStats* entries = agg->cells.entries;
+    size_t count = 0;
+    for (size_t j = 0; j < agg->cells.capacity; ++j) {
+        if (entries[j].code != OLC_TABLE_EMPTY) {
+            cells[count++] = entries[j];
+        }
+    }
+    qsort(cells, count, sizeof(OLC_CellStats), compare_cells);
+    return count;
+}
+
+// Finds the cell of a code, starting at its slot, or adds an empty one.
+static OLC_CellStats* find_cell(OLC_Aggregator* agg, size_t slot, OLC_Packed code)
+{
+    OLC_CellStats* cells = agg->cells.entries;
+    OLC_CellStats* cell = &cells[slot];
+    while (cell->code != code) {
+        if (cell->code == OLC_TABLE_EMPTY) {
+            memset(cell, 0, sizeof(OLC_CellStats));
+            cell->code = code;
+            ++agg->cells.size;
+            break;
+        }
+        slot = (slot + 1) & (agg->cells.capacity - 1);
+        cell = &cells[slot];
+    }
+    return cell;
+}
+
+static int compare_cells(const void* a, const void* b)
+{
+    OLC_Packed ca = ((const OLC_CellStats*) a)->code;
+    OLC_Packed cb = ((const OLC_CellStats*) b)->code;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+#ifndef OLC_AGG_H_
+#define OLC_AGG_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "olc.h"
+
+// The totals of a cell: how many locations fell into it, and the sum,
+// smallest and largest of their weights.
+typedef struct OLC_CellStats {
+    OLC_Packed code;
+    uint64_t count;
+    double sum;
+    double min;
+    double max;
+} OLC_CellStats;
+
+// Totals per cell for streams of locations, at one or more code lengths at
+// once.  Cells are kept in a hash table keyed by packed code; the packed
+// codes of different lengths never collide, so all lengths share the table.
+typedef struct OLC_Aggregator OLC_Aggregator;
+
+// Create an aggregator for n code lengths; lengths are rounded as
+// OLC_EncodePacked does, and lengths that round to the same one are kept
+// once.  Returns 0 on failure.
+OLC_Aggregator* OLC_AggregatorCreate(const size_t* lengths, size_t n);
+
+// Free an aggregator
+void OLC_AggregatorDestroy(OLC_Aggregator* agg);
+
+// Add n locations given as separate latitude and longitude columns, with
+// their weights, or weight 1 if weights is 0.  Every location counts once
+// in its cell of each length.  Returns 0 if memory runs out, in which case
+// only some of the locations may have been added.
+int OLC_AggregatorAdd(OLC_Aggregator* agg, const double* lat, const double* lon,
+                      const double* weights, size_t n);
+
+// Add the cells of one aggregator to another, as if all locations had been
+// added to the latter; aggregators filled by different threads are merged
+// this way.  Returns 0 if memory runs out.
+int OLC_AggregatorMerge(OLC_Aggregator* into, const OLC_Aggregator* from);
+
+// Get the number of cells in an aggregator
+size_t OLC_AggregatorSize(const OLC_Aggregator* agg);
+
+// Copy the cells of an aggregator into cells, sorted by packed code, so that
+// a cell comes right before the cells it contains.  Returns the number of
+// cells, or 0 if they do not fit into maxcount entries.
+size_t OLC_AggregatorCells(const OLC_Aggregator* agg, OLC_CellStats* cells,
+                           size_t maxcount);
+
+#endif
@@ -0,0 +1,632 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "olc.h"
+#include "olc_index.h"
+
+// Amount of input each thread gets per window.
+#define CHUNK_SIZE (16 * 1024 * 1024)
+
+// Largest field we look at; longer ones are invalid anyway.
+#define FIELD_SIZE 64
+
+// Largest number of fields we look at in a line.
+#define MAX_FIELDS 8
+
+typedef struct Output {
+    char* data;
+    size_t len;
+    size_t cap;
+} Output;
+
+typedef struct Config Config;
+
+typedef void (CommandFunc)(const Config* config, char* fields[], int count,
+                           Output* out);
+
+struct Config {
+    CommandFunc* func;
+    int scan;
+    char delimiter;
+    size_t length;
+};
+
+typedef struct Chunk {
+    const Config* config;
+    const char* begin;
+    const char* end;
+    size_t offset;
+    Output out;
+} Chunk;
+
+static void command_encode(const Config* config, char* fields[], int count,
+                           Output* out);
+static void command_decode(const Config* config, char* fields[], int count,
+                           Output* out);
+static void command_shorten(const Config* config, char* fields[], int count,
+                            Output* out);
+static void command_recover(const Config* config, char* fields[], int count,
+                            Output* out);
+
+static int scan_found(void* data, size_t offset, size_t size, int full);
+
+static int process_input(const Config* config, int fd, int threads);
+static const char* scan_window_end(const char* buf, size_t len);
+static int build_index(const Config* config, int fd, const char* output);
+static size_t process_window(const Config* config, Chunk* chunks, int threads,
+                             const char* begin, const char* end, size_t offset);
+static void* process_chunk(void* arg);
+static void process_line(const Config* config, const char* line, size_t len,
+                         Output* out);
+
+static int reserve(Output* out, size_t len);
+static void append(Output* out, const char* data, size_t len);
+static void append_char(Output* out, char c);
+static void append_double(Output* out, double value);
+static void append_size(Output* out, size_t value);
+static int write_all(int fd, const char* data, size_t len);
+static int parse_latlon(char* lat, char* lon, OLC_LatLon* location);
+static void usage(void);
+
+int main(int argc, char* argv[])
+{
+    struct Command {
+        const char* name;
+        CommandFunc* func;
+        int scan;
+        int index;
+    } commands[] = {
+        { "encode" , command_encode , 0, 0 },
+        { "decode" , command_decode , 0, 0 },
+        { "shorten", command_shorten, 0, 0 },
+        { "recover", command_recover, 0, 0 },
+        { "scan"   , 0              , 1, 0 },
+        { "index"  , 0              , 0, 1 },
+    };
+
+    Config config = { 0, 0, ',', 10 };
+    int threads = 1;
+    int index = 0;
+    const char* file = 0;
+    const char* output = 0;
+    int j = 1;
+    for (; j < argc && argv[j][0] == '-' && argv[j][1] != '\0'; ++j) {
+        if (strcmp(argv[j], "-t") == 0 || strcmp(argv[j], "--tsv") == 0) {
+            config.delimiter = '\t';
+        } else if ((strcmp(argv[j], "-l") == 0 || strcmp(argv[j], "--length") == 0) && j + 1 < argc) {
+            config.length = strtoul(argv[++j], 0, 10);
+        } else if ((strcmp(argv[j], "-j") == 0 || strcmp(argv[j], "--threads") == 0) && j + 1 < argc) {
+            threads = atoi(argv[++j]);
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (j >= argc) {
+        usage();
+        return 1;
+    }
+    for (int k = 0; k < sizeof(commands) / sizeof(commands[0]); ++k) {
+        if (strcmp(argv[j], commands[k].name) == 0) {
+            config.func = commands[k].func;
+            config.scan = commands[k].scan;
+            index = commands[k].index;
+        }
+    }
+    if (!config.func && !config.scan && !index) {
+        usage();
+        return 1;
+    }
+    if (++j < argc && strcmp(argv[j], "-") != 0) {
+        file = argv[j];
+    }
+    if (index) {
+        if (j + 1 >= argc) {
+            usage();
+            return 1;
+        }
+        output = argv[j + 1];
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    int fd = STDIN_FILENO;
+    if (file) {
+        fd = open(file, O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Could not open [%s]\n", file);
+            return 1;
+        }
+    }
+    int ok = index ? build_index(&config, fd, output) : process_input(&config, fd, threads);
+    if (file) {
+        close(fd);
+    }
+    return ok ? 0 : 1;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: olc [options] command [file]\n"
+            "       olc [options] index file|- index_file\n"
+            "\n"
+            "Reads CSV rows from file (mapped into memory) or stdin, and writes\n"
+            "one output row per input row to stdout.  The scan command reads any\n"
+            "text, and writes one row per code found in it.  The index command\n"
+            "writes the rows, sorted by code, to an index file for olc_index.h.\n"
+            "\n"
+            "commands:\n"
+            "  encode    lat,lon[,length]  => code\n"
+            "  decode    code              => lo_lat,lo_lon,hi_lat,hi_lon,lat,lon,length\n"
+            "  shorten   code,lat,lon      => short code\n"
+            "  recover   code,lat,lon      => full code\n"
+            "  scan      text              => offset,code,full|short\n"
+            "  index     code,payload      => index file\n"
+            "\n"
+            "options:\n"
+            "  -t, --tsv          read and write tab separated rows\n"
+            "  -l, --length N     code length for encode (default 10)\n"
+            "  -j, --threads N    split the input among N threads; the output\n"
+            "                     keeps the input order\n");
+}
+
+static void command_encode(const Config* config, char* fields[], int count,
+                           Output* out)
+{
+    OLC_LatLon location;
+    if (count < 2 || !parse_latlon(fields[0], fields[1], &location)) {
+        return;
+    }
+    size_t length = config->length;
+    if (count > 2 && fields[2][0] != '\0') {
+        length = strtoul(fields[2], 0, 10);
+    }
+    if (reserve(out, OLC_MAX_DIGITS + 2)) {
+        out->len += OLC_Encode(&location, length, out->data + out->len, OLC_MAX_DIGITS + 2);
+    }
+}
+
+static void command_decode(const Config* config, char* fields[], int count,
+                           Output* out)
+{
+    OLC_Parsed parsed;
+    OLC_CodeArea area;
+    if (count < 1 || !OLC_Parse(fields[0], 0, &parsed) ||
+        !OLC_ParsedIsFull(&parsed) || !OLC_ParsedDecode(&parsed, &area)) {
+        return;
+    }
+    OLC_LatLon center;
+    OLC_GetCenter(&area, &center);
+    double values[] = { area.lo.lat, area.lo.lon, area.hi.lat, area.hi.lon, center.lat, center.lon };
+    for (int j = 0; j < sizeof(values) / sizeof(values[0]); ++j) {
+        append_double(out, values[j]);
+        append_char(out, config->delimiter);
+    }
+    append_size(out, area.len);
+}
+
+static void command_shorten(const Config* config, char* fields[], int count,
+                            Output* out)
+{
+    OLC_LatLon reference;
+    if (count < 3 || !parse_latlon(fields[1], fields[2], &reference)) {
+        return;
+    }
+    char code[FIELD_SIZE];
+    append(out, code, OLC_Shorten(fields[0], 0, &reference, code, FIELD_SIZE));
+}
+
+static void command_recover(const Config* config, char* fields[], int count,
+                            Output* out)
+{
+    OLC_LatLon reference;
+    if (count < 3 || !parse_latlon(fields[1], fields[2], &reference)) {
+        return;
+    }
+    char code[FIELD_SIZE];
+    append(out, code, OLC_RecoverNearest(fields[0], 0, &reference, code, FIELD_SIZE));
+}
+
+// Writes a row for a code found by the scan command, with its offset in the
+// whole input.
+static int scan_found(void* data, size_t offset, size_t size, int full)
+{
+    Chunk* chunk = data;
+    char delimiter = chunk->config->delimiter;
+    append_size(&chunk->out, chunk->offset + offset);
+    append_char(&chunk->out, delimiter);
+    append(&chunk->out, chunk->begin + offset, size);
+    append_char(&chunk->out, delimiter);
+    append(&chunk->out, full ? "full\n" : "short\n", full ? 5 : 6);
+    return 0;
+}
+
+// Processes the whole input in windows of one chunk per thread.  A mapped
+// file is used in place; otherwise the window is read into a buffer, and any
+// partial line at its end is carried over to the next one.  A line that
+// fills the whole buffer is still scanned, but the other commands drop it.
+static int process_input(const Config* config, int fd, int threads)
+{
+    Chunk* chunks = calloc(threads, sizeof(Chunk));
+    if (!chunks) {
+        return 0;
+    }
+
+    int ok = 1;
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map != MAP_FAILED) {
+        const char* data = map;
+        size_t size = st.st_size;
+        posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+        for (size_t pos = 0; ok && pos < size; ) {
+            size_t used = process_window(config, chunks, threads, data + pos, data + size, pos);
+            for (int j = 0; ok && j < threads; ++j) {
+                ok = write_all(STDOUT_FILENO, chunks[j].out.data, chunks[j].out.len);
+            }
+            pos += used;
+        }
+        munmap(map, size);
+    } else {
+        size_t cap = (size_t) threads * CHUNK_SIZE;
+        char* buf = malloc(cap);
+        size_t len = 0;
+        size_t offset = 0;
+        int eof = !buf;
+        int skip = 0;
+        ok = !!buf;
+        while (ok && (!eof || len > 0)) {
+            while (!eof && len < cap) {
+                ssize_t got = read(fd, buf + len, cap - len);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    if (got < 0) {
+                        fprintf(stderr, "Could not read the input\n");
+                        ok = 0;
+                    }
+                    eof = 1;
+                    break;
+                }
+                len += got;
+            }
+
+            // Without a newline in a full buffer, the line is too long to
+            // be valid input; drop it, up to and including its newline.
+            if (skip) {
+                const char* eol = memchr(buf, '\n', len);
+                size_t dropped = eol ? (size_t) (eol - buf) + 1 : len;
+                skip = !eol;
+                memmove(buf, buf + dropped, len - dropped);
+                len -= dropped;
+                offset += dropped;
+                continue;
+            }
+            const char* end = buf + len;
+            if (!eof) {
+                while (end > buf && end[-1] != '\n') {
+                    --end;
+                }
+                if (end == buf && config->scan) {
+                    end = scan_window_end(buf, len);
+                } else if (end == buf) {
+                    fprintf(stderr, "Dropped the line at offset %lu, longer than %lu bytes\n",
+                            (unsigned long) offset, (unsigned long) cap);
+                    skip = 1;
+                    continue;
+                }
+            }
+            size_t used = process_window(config, chunks, threads, buf, end, offset);
+            for (int j = 0; ok && j < threads; ++j) {
+                ok = write_all(STDOUT_FILENO, chunks[j].out.data, chunks[j].out.len);
+            }
+            memmove(buf, buf + used, len - used);
+            len -= used;
+            offset += used;
+        }
+        free(buf);
+    }
+
+    for (int j = 0; j < threads; ++j) {
+        free(chunks[j].out.data);
+    }
+    free(chunks);
+    return ok;
+}
+
+// Finds where to end a window of scanned text that has no newline in it, so
+// that no word is split in a way that makes a code of its part.  This is
+// after the last character that cannot be in a code, if there is one near
+// the end; otherwise the text ends in a word too long to be a code, and it
+// is split with FIELD_SIZE characters of it on both sides.
+static const char* scan_window_end(const char* buf, size_t len)
+{
+    const char* end = buf + len;
+    for (size_t j = 0; j < 2 * FIELD_SIZE && j < len; ++j) {
+        char c = buf[len - 1 - j];
+        if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') ||
+              (c >= 'a' && c <= 'z') || c == '+')) {
+            return end - j;
+        }
+    }
+    return end - FIELD_SIZE;
+}
+
+// Writes an index file for the code,payload rows of the whole input, which
+// is used in place if it is a mapped file, or else read into memory.
+static int build_index(const Config* config, int fd, const char* output)
+{
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    int ok = 1;
+    char* buf = 0;
+    const char* text = map;
+    size_t size = 0;
+    if (map != MAP_FAILED) {
+        size = st.st_size;
+        posix_madvise(map, size, POSIX_MADV_SEQUENTIAL);
+    } else {
+        size_t cap = 0;
+        for (;;) {
+            if (size == cap) {
+                size_t cap_new = cap ? cap * 2 : CHUNK_SIZE;
+                char* buf_new = realloc(buf, cap_new);
+                if (!buf_new) {
+                    fprintf(stderr, "Out of memory reading the input\n");
+                    ok = 0;
+                    break;
+                }
+                buf = buf_new;
+                cap = cap_new;
+            }
+            ssize_t got = read(fd, buf + size, cap - size);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got <= 0) {
+                if (got < 0) {
+                    fprintf(stderr, "Could not read the input\n");
+                    ok = 0;
+                }
+                break;
+            }
+            size += got;
+        }
+        text = buf;
+    }
+
+    size_t records = 0;
+    size_t skipped = 0;
+    if (ok && OLC_IndexBuild(output, text, size, config->delimiter, &records, &skipped)) {
+        fprintf(stderr, "Wrote %lu records to [%s], skipped %lu lines\n",
+                (unsigned long) records, output, (unsigned long) skipped);
+    } else if (ok) {
+        fprintf(stderr, "Could not write [%s]\n", output);
+        ok = 0;
+    }
+    if (map != MAP_FAILED) {
+        munmap(map, size);
+    }
+    free(buf);
+    return ok;
+}
+
+// Splits up to one chunk per thread of input, at line boundaries, and
+// processes the chunks in parallel into their own output buffers.  Offset is
+// the position of the window in the input.  Returns the number of input
+// bytes used.
+static size_t process_window(const Config* config, Chunk* chunks, int threads,
+                             const char* begin, const char* end, size_t offset)
+{
+    const char* pos = begin;
+    for (int j = 0; j < threads; ++j) {
+        const char* stop = end;
+        if ((size_t) (end - pos) > CHUNK_SIZE) {
+            stop = pos + CHUNK_SIZE;
+            while (stop < end && stop[-1] != '\n') {
+                ++stop;
+            }
+        }
+        chunks[j].config = config;
+        chunks[j].begin = pos;
+        chunks[j].end = stop;
+        chunks[j].offset = offset + (pos - begin);
+        chunks[j].out.len = 0;
+        pos = stop;
+    }
+
+    pthread_t* tids = threads > 1 ? calloc(threads, sizeof(pthread_t)) : 0;
+    int started = 0;
+    for (; tids && started < threads; ++started) {
+        if (pthread_create(&tids[started], 0, process_chunk, &chunks[started]) != 0) {
+            break;
+        }
+    }
+    for (int j = started; j < threads; ++j) {
+        process_chunk(&chunks[j]);
+    }
+    for (int j = 0; j < started; ++j) {
+        pthread_join(tids[j], 0);
+    }
+    free(tids);
+    return pos - begin;
+}
+
+static void* process_chunk(void* arg)
+{
+    Chunk* chunk = arg;
+    if (chunk->config->scan) {
+        // Codes never span lines, so chunks can be scanned on their own.
+        OLC_ScanText(chunk->begin, chunk->end - chunk->begin, scan_found, chunk);
+        return 0;
+    }
+    const char* pos = chunk->begin;
+    while (pos < chunk->end) {
+        const char* eol = memchr(pos, '\n', chunk->end - pos);
+        const char* next = eol ? eol + 1 : chunk->end;
+        size_t len = (eol ? eol : chunk->end) - pos;
+        if (len > 0 && pos[len - 1] == '\r') {
+            --len;
+        }
+        process_line(chunk->config, pos, len, &chunk->out);
+        pos = next;
+    }
+    return 0;
+}
+
+// Splits a line into fields, copied with a terminating NUL into a buffer on
+// the stack, and runs the command on them.  Blank lines and comments are
+// skipped; any other line gets exactly one output line.
+static void process_line(const Config* config, const char* line, size_t len,
+                         Output* out)
+{
+    if (len == 0 || line[0] == '#') {
+        return;
+    }
+
+    char buf[MAX_FIELDS * FIELD_SIZE];
+    char* fields[MAX_FIELDS];
+    int count = 0;
+    size_t pos = 0;
+    while (count < MAX_FIELDS) {
+        const char* sep = memchr(line + pos, config->delimiter, len - pos);
+        size_t flen = (sep ? (size_t) (sep - line) : len) - pos;
+        char* field = buf + count * FIELD_SIZE;
+        if (flen >= FIELD_SIZE) {
+            flen = FIELD_SIZE - 1;
+        }
+        memcpy(field, line + pos, flen);
+        field[flen] = '\0';
+        fields[count++] = field;
+        if (!sep) {
+            break;
+        }
+        pos = sep - line + 1;
+    }
+
+    config->func(config, fields, count, out);
+    append_char(out, '\n');
+}
+
+static int parse_latlon(char* lat, char* lon, OLC_LatLon* location)
+{
+    char* end;
+    location->lat = strtod(lat, &end);
+    if (end == lat) {
+        return 0;
+    }
+    location->lon = strtod(lon, &end);
+    if (end == lon) {
+        return 0;
+    }
+    return 1;
+}
+
+// Makes sure there is room for len more bytes in an output buffer, which
+// grows geometrically.
+static int reserve(Output* out, size_t len)
+{
+    if (out->len + len <= out->cap) {
+        return 1;
+    }
+    size_t cap = out->cap ? out->cap : 64 * 1024;
+    while (cap < out->len + len) {
+        cap *= 2;
+    }
+    char* data = realloc(out->data, cap);
+    if (!data) {
+        return 0;
+    }
+    out->data = data;
+    out->cap = cap;
+    return 1;
+}
+
+static void append(Output* out, const char* data, size_t len)
+{
+    if (reserve(out, len)) {
+        memcpy(out->data + out->len, data, len);
+        out->len += len;
+    }
+}
+
+static void append_char(Output* out, char c)
+{
+    if (reserve(out, 1)) {
+        out->data[out->len++] = c;
+    }
+}
+
+// Appends a number of degrees with up to ten decimals, which is more than
+// the finest resolution of a code, without trailing zeros.
+static void append_double(Output* out, double value)
+{
+    char buf[32];
+    int pos = sizeof(buf);
+    int negative = value < 0;
+    long long scaled = (long long) ((negative ? -value : value) * 1e10 + 0.5);
+    long long whole = scaled / 10000000000LL;
+    long long frac = scaled % 10000000000LL;
+
+    int digits = 10;
+    while (digits > 0 && frac % 10 == 0) {
+        frac /= 10;
+        --digits;
+    }
+    for (int j = 0; j < digits; ++j) {
+        buf[--pos] = '0' + frac % 10;
+        frac /= 10;
+    }
+    if (digits > 0) {
+        buf[--pos] = '.';
+    }
+    do {
+        buf[--pos] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole > 0);
+    if (negative && scaled > 0) {
+        buf[--pos] = '-';
+    }
+    append(out, buf + pos, sizeof(buf) - pos);
+}
+
+static void append_size(Output* out, size_t value)
+{
+    char buf[32];
+    int pos = sizeof(buf);
+    do {
+        buf[--pos] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    append(out, buf + pos, sizeof(buf) - pos);
+}
+
+static int write_all(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t wrote = write(fd, data, len);
+        if (wrote <= 0) {
+            return 0;
+        }
+        data += wrote;
+        len -= wrote;
+    }
+    return 1;
+}
@@ -0,0 +1,384 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "olc_column.h"
+#include "olc_internal.h"
+
+#define COLUMN_MAGIC "OLCCOLMN"
+#define COLUMN_VERSION 2
+
+// Magic, version and number of codes per block.
+#define COLUMN_FILE_HEADER_SIZE 16
+
+// Differences of up to 4 bytes hold a number of cells below 1 << 28, and a
+// correction from -COLUMN_REST_BIAS up to 15 - COLUMN_REST_BIAS in their low
+// 4 bits.
+#define COLUMN_REST_BIAS 4
+
+// The codes whose lengths are looked at for the longest length in a block,
+// spread evenly over it, the first and last code included.
+#define COLUMN_LENGTH_SAMPLES 64
+
+// A difference is read with a single 8 byte load, masked to its size, which
+// needs the bytes to land in the word in order.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define COLUMN_WORD_LOAD 1
+#endif
+
+struct OLC_ColumnWriter {
+    FILE* fp;
+    int ok;
+    int started;
+    OLC_Packed last;
+    size_t count;
+    OLC_Packed codes[OLC_COLUMN_BLOCK_CODES];
+    uint8_t block[OLC_COLUMN_BLOCK_SIZE];
+};
+
+struct OLC_ColumnReader {
+    FILE* fp;
+    int unread;             // the data of the current block are still ahead
+    OLC_ColumnBlock current;
+    uint8_t block[OLC_COLUMN_BLOCK_SIZE];
+};
+
+// Sizes of the differences for each 2 bit tag, and the masks for them.
+static const size_t   kDeltaSizes[4] = { 1, 2, 4, 8 };
+static const uint64_t kDeltaMasks[4] = {
+    0xffULL, 0xffffULL, 0xffffffffULL, 0xffffffffffffffffULL,
+};
+
+static int read_header(const uint8_t* block, OLC_ColumnBlock* info);
+static uint64_t shorter_ratio(size_t length);
+static size_t decode_data(const OLC_ColumnBlock* info, const uint8_t* data, OLC_Packed* codes);
+static int flush_block(OLC_ColumnWriter* writer);
+static size_t tags_size(size_t count);
+static void put_u32(uint8_t* pos, uint32_t value);
+static void put_u64(uint8_t* pos, uint64_t value);
+static uint32_t get_u32(const uint8_t* pos);
+static uint64_t get_u64(const uint8_t* pos);
+
+size_t OLC_ColumnEncodeBlock(const OLC_Packed* codes, size_t n, uint8_t* block)
+{
+    if (n == 0 || n > OLC_COLUMN_BLOCK_CODES) {
+        return 0;
+    }
+    for (size_t j = 1; j < n; ++j) {
+        if (codes[j] < codes[j - 1]) {
+            return 0;
+        }
+    }
+    // Working out the length of every code would take longer than the rest;
+    // a code longer than those sampled only costs a plain difference or two.
+    size_t length = 2;
+    for (size_t j = 0; j < COLUMN_LENGTH_SAMPLES; ++j) {
+        size_t code_length = OLC_PackedLength(codes[j * (n - 1) / (COLUMN_LENGTH_SAMPLES - 1)]);
+        length = code_length > length ? code_length : length;
+    }
+
+    // For each cell of the longest length a difference spans, it passes about
+    // ratio / 2^32 shorter codes.
+    uint64_t span = OLC_PackedSpan(length);
+    uint64_t ratio = shorter_ratio(length);
+    uint8_t* tags = block + OLC_COLUMN_HEADER_SIZE;
+    uint8_t* pos = tags + tags_size(n);
+    memset(tags, 0, tags_size(n));
+    for (size_t j = 1; j < n; ++j) {
+        uint64_t delta = codes[j] - codes[j - 1];
+        int tag = 3;
+        // The same as delta / span < 1 << 28, without the division.
+        if ((delta >> 28) < span) {
+            uint64_t cells = delta / span;
+            int64_t rest = (int64_t) (delta % span) - (int64_t) ((cells * ratio) >> 32);
+            if (rest >= -COLUMN_REST_BIAS && rest < 16 - COLUMN_REST_BIAS) {
+                delta = cells << 4 | (uint64_t) (rest + COLUMN_REST_BIAS);
+                tag = delta > 0xffff ? 2 : delta > 0xff ? 1 : 0;
+            }
+        }
+        tags[(j - 1) / 4] |= tag << (2 * ((j - 1) % 4));
+        for (size_t k = 0; k < kDeltaSizes[tag]; ++k) {
+            *pos++ = (uint8_t) (delta >> (8 * k));
+        }
+    }
+    size_t size = pos - block;
+    put_u32(block, n | length << 16);
+    put_u32(block + 4, size - OLC_COLUMN_HEADER_SIZE);
+    put_u64(block + 8, codes[0]);
+    put_u64(block + 16, codes[n - 1]);
+    return size;
+}
+
+int OLC_ColumnBlockInfo(const uint8_t* block, size_t size, OLC_ColumnBlock* info)
+{
+    return size >= OLC_COLUMN_HEADER_SIZE && read_header(block, info) && info->size <= size;
+}
+
+size_t OLC_ColumnDecodeBlock(const uint8_t* block, size_t size, OLC_Packed* codes)
+{
+    OLC_ColumnBlock info;
+    if (!OLC_ColumnBlockInfo(block, size, &info)) {
+        return 0;
+    }
+    return decode_data(&info, block + OLC_COLUMN_HEADER_SIZE, codes);
+}
+
+OLC_ColumnWriter* OLC_ColumnWriterOpen(const char* file)
+{
+    OLC_ColumnWriter* writer = malloc(sizeof(OLC_ColumnWriter));
+    if (!writer) {
+        return 0;
+    }
+    writer->fp = fopen(file, "wb");
+    writer->ok = writer->fp != 0;
+    writer->started = 0;
+    writer->last = 0;
+    writer->count = 0;
+
+    uint8_t header[COLUMN_FILE_HEADER_SIZE];
+    memcpy(header, COLUMN_MAGIC, 8);
+    put_u32(header + 8, COLUMN_VERSION);
+    put_u32(header + 12, OLC_COLUMN_BLOCK_CODES);
+    if (!writer->ok || fwrite(header, sizeof(header), 1, writer->fp) != 1) {
+        if (writer->fp) {
+            fclose(writer->fp);
+        }
+        free(writer);
+        return 0;
+    }
+    return writer;
+}
+
+int OLC_ColumnWrite(OLC_ColumnWriter* writer, OLC_Packed* codes, size_t n)
+{
+    if (!writer->ok || n == 0) {
+        return writer->ok;
+    }
+    OLC_Packed* tmp = malloc(n * sizeof(OLC_Packed));
+    if (!tmp) {
+        return 0;
+    }
+    olc_sort_packed(codes, tmp, n, sizeof(OLC_Packed));
+    free(tmp);
+    if (writer->started && codes[0] < writer->last) {
+        return 0;
+    }
+    writer->started = 1;
+    writer->last = codes[n - 1];
+
+    for (size_t j = 0; writer->ok && j < n; ) {
+        size_t take = OLC_COLUMN_BLOCK_CODES - writer->count;
+        if (take > n - j) {
+            take = n - j;
+        }
+        memcpy(writer->codes + writer->count, codes + j, take * sizeof(OLC_Packed));
+        writer->count += take;
+        j += take;
+        if (writer->count == OLC_COLUMN_BLOCK_CODES) {
+            writer->ok = flush_block(writer);
+        }
+    }
+    return writer->ok;
+}
+
+int OLC_ColumnWriterClose(OLC_ColumnWriter* writer)
+{
+    if (!writer) {
+        return 0;
+    }
+    int ok = writer->ok && flush_block(writer);
+    if (fclose(writer->fp) != 0) {
+        ok = 0;
+    }
+    free(writer);
+    return ok;
+}
+
+OLC_ColumnReader* OLC_ColumnReaderOpen(const char* file)
+{
+    FILE* fp = fopen(file, "rb");
+    if (!fp) {
+        return 0;
+    }
+    uint8_t header[COLUMN_FILE_HEADER_SIZE];
+    OLC_ColumnReader* reader = 0;
+    if (fread(header, sizeof(header), 1, fp) == 1 &&
+        memcmp(header, COLUMN_MAGIC, 8) == 0 && get_u32(header + 8) == COLUMN_VERSION &&
+        get_u32(header + 12) <= OLC_COLUMN_BLOCK_CODES) {
+        reader = malloc(sizeof(OLC_ColumnReader));
+    }
+    if (!reader) {
+        fclose(fp);
+        return 0;
+    }
+    reader->fp = fp;
+    reader->unread = 0;
+    memset(&reader->current, 0, sizeof(OLC_ColumnBlock));
+    return reader;
+}
+
+void OLC_ColumnReaderClose(OLC_ColumnReader* reader)
+{
+    if (!reader) {
+        return;
+    }
+    fclose(reader->fp);
+    free(reader);
+}
+
+int OLC_ColumnNextBlock(OLC_ColumnReader* reader, OLC_ColumnBlock* info)
+{
+    if (reader->unread &&
+        fseek(reader->fp, reader->current.size - OLC_COLUMN_HEADER_SIZE, SEEK_CUR) != 0) {
+        return 0;
+    }
+    reader->unread = 0;
+    if (fread(reader->block, OLC_COLUMN_HEADER_SIZE, 1, reader->fp) != 1 ||
+        !read_header(reader->block, &reader->current)) {
+        return 0;
+    }
+    reader->unread = 1;
+    if (info) {
+        *info = reader->current;
+    }
+    return 1;
+}
+
+size_t OLC_ColumnReadBlock(OLC_ColumnReader* reader, OLC_Packed* codes)
+{
+    if (!reader->unread) {
+        return 0;
+    }
+    reader->unread = 0;
+    size_t size = reader->current.size - OLC_COLUMN_HEADER_SIZE;
+    uint8_t* data = reader->block + OLC_COLUMN_HEADER_SIZE;
+    if (fread(data, 1, size, reader->fp) != size) {
+        return 0;
+    }
+    return decode_data(&reader->current, data, codes);
+}
+
+// Reads a block header, and checks that its numbers are possible.  The
+// first word holds the count in its low 16 bits and the length in the next
+// 8; the top 8 are 0.
+static int read_header(const uint8_t* block, OLC_ColumnBlock* info)
+{
+    uint32_t word = get_u32(block);
+    uint32_t count = word & 0xffff;
+    uint32_t size = get_u32(block + 4);
+    info->count = count;
+    info->length = (word >> 16) & 0xff;
+    info->size = OLC_COLUMN_HEADER_SIZE + (size_t) size;
+    info->min = get_u64(block + 8);
+    info->max = get_u64(block + 16);
+    return count > 0 && count <= OLC_COLUMN_BLOCK_CODES && (word >> 24) == 0 &&
+           info->length == OLC_EncodedLength(info->length) &&
+           size >= tags_size(count) + count - 1 && size <= tags_size(count) + 8 * (count - 1) &&
+           info->min <= info->max;
+}
+
+// Adds up the differences after the first code.  Their sizes come from the
+// tags, not from the data before them, so that the loads do not wait on
+// each other.  While 8 bytes are left, a difference is a single masked load.
+// The data must end right after the last difference, at the largest code.
+static size_t decode_data(const OLC_ColumnBlock* info, const uint8_t* data, OLC_Packed* codes)
+{
+    uint64_t span = OLC_PackedSpan(info->length);
+    uint64_t ratio = shorter_ratio(info->length);
+    const uint8_t* tags = data;
+    const uint8_t* pos = data + tags_size(info->count);
+    const uint8_t* end = data + (info->size - OLC_COLUMN_HEADER_SIZE);
+    OLC_Packed value = info->min;
+    codes[0] = value;
+    for (size_t j = 1; j < info->count; ++j) {
+        int tag = (tags[(j - 1) / 4] >> (2 * ((j - 1) % 4))) & 3;
+        uint64_t delta = 0;
+#ifdef COLUMN_WORD_LOAD
+        if (end - pos >= 8) {
+            memcpy(&delta, pos, sizeof(delta));
+            delta &= kDeltaMasks[tag];
+        } else
+#endif
+        {
+            if ((size_t) (end - pos) < kDeltaSizes[tag]) {
+                return 0;
+            }
+            for (size_t k = 0; k < kDeltaSizes[tag]; ++k) {
+                delta |= (uint64_t) pos[k] << (8 * k);
+            }
+        }
+        pos += kDeltaSizes[tag];
+        uint64_t cells = delta >> 4;
+        uint64_t scaled = cells * span + ((cells * ratio) >> 32) + (delta & 15) - COLUMN_REST_BIAS;
+        uint64_t plain = -(uint64_t) (tag == 3);
+        value += (delta & plain) | (scaled & ~plain);
+        codes[j] = value;
+    }
+    return pos == end && value == info->max ? info->count : 0;
+}
+
+static int flush_block(OLC_ColumnWriter* writer)
+{
+    if (writer->count == 0) {
+        return 1;
+    }
+    size_t size = OLC_ColumnEncodeBlock(writer->codes, writer->count, writer->block);
+    writer->count = 0;
+    return size && fwrite(writer->block, 1, size, writer->fp) == size;
+}
+
+// Gets the number of shorter codes per code of a length, in units of 2^-32.
+// A shorter code comes once for all the codes of the length it contains.
+static uint64_t shorter_ratio(size_t length)
+{
+    uint64_t span = OLC_PackedSpan(length);
+    uint64_t inside = 1;
+    uint64_t ratio = 0;
+    for (size_t shorter = length - 1; shorter >= 2; --shorter) {
+        uint64_t parent = OLC_PackedSpan(shorter);
+        if (parent == span) {
+            continue;   // not a length of its own
+        }
+        inside *= (parent - 1) / span;
+        ratio += (((uint64_t) 1 << 32) + inside / 2) / inside;
+        span = parent;
+    }
+    return ratio;
+}
+
+// Gets the size of the tags of the differences in a block of count codes.
+static size_t tags_size(size_t count)
+{
+    return (count + 2) / 4;
+}
+
+static void put_u32(uint8_t* pos, uint32_t value)
+{
+    for (int j = 0; j < 4; ++j) {
+        pos[j] = (uint8_t) (value >> (8 * j));
+    }
+}
+
+static void put_u64(uint8_t* pos, uint64_t value)
+{
+    for (int j = 0; j < 8; ++j) {
+        pos[j] = (uint8_t) (value >> (8 * j));
+    }
+}
+
+static uint32_t get_u32(const uint8_t* pos)
+{
+    uint32_t value = 0;
+    for (int j = 0; j < 4; ++j) {
+        value |= (uint32_t) pos[j] << (8 * j);
+    }
+    return value;
+}
+
+static uint64_t get_u64(const uint8_t* pos)
+{
+    uint64_t value = 0;
+    for (int j = 0; j < 8; ++j) {
+        value |= (uint64_t) pos[j] << (8 * j);
+    }
+    return value;
+}
@@ -0,0 +1,86 @@
+#ifndef OLC_COLUMN_H_
+#define OLC_COLUMN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "olc.h"
+
+// Largest number of codes in a block
+#define OLC_COLUMN_BLOCK_CODES 4096
+
+// Size of the header in front of every block
+#define OLC_COLUMN_HEADER_SIZE 24
+
+// Largest size of an encoded block, for a buffer that any block fits in
+#define OLC_COLUMN_BLOCK_SIZE \
+    (OLC_COLUMN_HEADER_SIZE + OLC_COLUMN_BLOCK_CODES / 4 + 8 * OLC_COLUMN_BLOCK_CODES)
+
+// Sorted packed codes, stored in blocks.  A block has a header with the
+// number of codes, the length of the longest one, the size of its data and
+// its smallest and largest code, so that readers can skip it.  Its data are
+// the differences between each code and the one before, in 1, 2, 4 or 8
+// bytes, after 2 bit tags with their sizes, four to a byte.
+//
+// Packed codes leave room for all the longer codes within a code, so even
+// neighbouring cells of the longest length differ by a lot.  Differences of
+// 1, 2 or 4 bytes are therefore counted in cells of that length; the codes
+// of other lengths passed on the way follow from that count, up to a small
+// correction that goes into the low 4 bits.  Differences that do not fit
+// are stored as they are in 8 bytes.  Codes spread over a city take about
+// two bytes each.  All numbers are little endian.
+typedef struct OLC_ColumnBlock {
+    size_t count;
+    size_t length;      // of the longest code
+    size_t size;        // of the whole block, header included
+    OLC_Packed min;
+    OLC_Packed max;
+} OLC_ColumnBlock;
+
+// Encode up to OLC_COLUMN_BLOCK_CODES codes, sorted in ascending order, into
+// a block.  Returns its size, or 0 if there are no codes, too many of them,
+// or they are not sorted.
+size_t OLC_ColumnEncodeBlock(const OLC_Packed* codes, size_t n, uint8_t* block);
+
+// Read the header of a block of size bytes (or more) into info.  Returns 0
+// if the block is damaged or does not fit.
+int OLC_ColumnBlockInfo(const uint8_t* block, size_t size, OLC_ColumnBlock* info);
+
+// Decode a block of size bytes (or more) into codes, which needs room for
+// OLC_COLUMN_BLOCK_CODES entries.  Returns the number of codes, or 0 if the
+// block is damaged or does not fit.
+size_t OLC_ColumnDecodeBlock(const uint8_t* block, size_t size, OLC_Packed* codes);
+
+// A file of blocks written one after the other, after a file header.
+typedef struct OLC_ColumnWriter OLC_ColumnWriter;
+typedef struct OLC_ColumnReader OLC_ColumnReader;
+
+// Create a file to write codes to.  Returns 0 on failure.
+OLC_ColumnWriter* OLC_ColumnWriterOpen(const char* file);
+
+// Sort n codes in place and add them to the file.  None of them may be below
+// the codes added before, so that the whole file is sorted: either all codes
+// go in a single call, or calls get consecutive runs of sorted codes.
+// Returns 0 on failure or if the codes are out of order.
+int OLC_ColumnWrite(OLC_ColumnWriter* writer, OLC_Packed* codes, size_t n);
+
+// Write the last block, close the file and free the writer.  Returns 0 if
+// anything could not be written.
+int OLC_ColumnWriterClose(OLC_ColumnWriter* writer);
+
+// Open a file of codes to read.  Returns 0 if it cannot be opened or is not
+// a file of codes.
+OLC_ColumnReader* OLC_ColumnReaderOpen(const char* file);
+
+// Close a file and free the reader
+void OLC_ColumnReaderClose(OLC_ColumnReader* reader);
+
+// Move to the next block and get its header, without reading its data.
+// Returns 0 at the end of the file or if the file is damaged.
+int OLC_ColumnNextBlock(OLC_ColumnReader* reader, OLC_ColumnBlock* info);
+
+// Decode the block OLC_ColumnNextBlock moved to into codes, which needs
+// room for OLC_COLUMN_BLOCK_CODES entries; blocks that are not read are
+// skipped.  Returns the number of codes, or 0 if the block is damaged.
+size_t OLC_ColumnReadBlock(OLC_ColumnReader* reader, OLC_Packed* codes);
+
+#endif
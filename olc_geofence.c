@@ -0,0 +1,603 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "olc_geofence.h"
+#include "olc_internal.h"
+
+// A polygon starts from the cells of the longest length whose cells are as
+// large as its bounding box, at most 3 by 3 of them, or all 9 by 18 cells
+// of the first pair for the largest polygons.
+#define GEOFENCE_ROOT_CELLS 162
+
+// Cells are widened by this many degrees when checked against the edges, so
+// that rounding can only turn an interior or outside cell into a boundary
+// cell, and never the other way round.
+#define GEOFENCE_MARGIN 1e-9
+
+#if defined(__GNUC__)
+#define GEOFENCE_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define GEOFENCE_PREFETCH(p) ((void) 0)
+#endif
+
+// A cell of a fence in the table; several fences may have the same cell.
+typedef struct Entry {
+    OLC_Packed code;
+    uint32_t fence;
+    uint32_t boundary;
+} Entry;
+
+typedef struct Fence {
+    OLC_LatLon* vertices;   // 0 if there is no fence with this number
+    size_t n;
+    double lat_lo;
+    double lat_hi;
+    double lon_lo;
+    double lon_hi;
+    OLC_Packed* cells;
+    size_t cell_count;
+} Fence;
+
+struct OLC_Geofence {
+    size_t max_level;
+    size_t max_cells;
+    Fence* fences;
+    size_t fence_capacity;
+    size_t fence_count;
+    OlcTable entries;       // of Entry
+    size_t boundary;
+    size_t level_cells[OLC_LEVELS];
+    size_t lengths[OLC_LEVELS];    // of the levels with cells
+    size_t length_count;
+};
+
+// A cell to classify, with the edges of the polygon that cross it.
+typedef struct Cell {
+    OLC_Packed code;
+    size_t level;
+    double lat_lo;
+    double lat_hi;
+    double lon_lo;
+    double lon_hi;
+    size_t edges;           // offset in the edge pool
+    size_t edge_count;
+} Cell;
+
+// The state of compiling one polygon: boundary cells wait in a queue, so
+// that they are refined level by level, and the cells that are done go to
+// the output.
+typedef struct Compiler {
+    const Fence* fence;
+    uint32_t id;
+    size_t max_level;
+    Cell* queue;
+    size_t head;
+    size_t tail;
+    size_t queue_capacity;
+    uint32_t* pool;
+    size_t pool_size;
+    size_t pool_capacity;
+    Entry* out;
+    size_t out_count;
+    size_t out_capacity;
+    double* xs;             // crossings of a row, one per edge at most
+    uint32_t* row_edges;    // edges that reach into a row
+} Compiler;
+
+static int compile(Compiler* comp, size_t max_cells);
+static int refine(Compiler* comp, const Cell* cell, size_t budget, size_t* added);
+static int add_cell(Compiler* comp, const Cell* cell);
+static int add_output(Compiler* comp, OLC_Packed code, int boundary);
+static int reserve_pool(Compiler* comp, size_t size);
+static int edge_crosses(const Fence* fence, size_t edge, const Cell* cell);
+static size_t row_crossings(const Fence* fence, double lat, double* xs);
+static int point_inside(const Fence* fence, double lat, double lon);
+static void remove_fence(OLC_Geofence* fences, size_t id);
+static void insert_entry(OLC_Geofence* fences, const Entry* entry);
+static void remove_entry(OLC_Geofence* fences, OLC_Packed code, uint32_t fence);
+static void count_level(OLC_Geofence* fences, OLC_Packed code, int delta);
+
+OLC_Geofence* OLC_GeofenceCreate(size_t max_length, size_t max_cells)
+{
+    OLC_Geofence* fences = max_cells ? calloc(1, sizeof(OLC_Geofence)) : 0;
+    if (!fences) {
+        return 0;
+    }
+    fences->max_level = olc_level_of_length(OLC_EncodedLength(max_length));
+    fences->max_cells = max_cells;
+    if (!olc_table_init(&fences->entries, sizeof(Entry))) {
+        free(fences);
+        return 0;
+    }
+    return fences;
+}
+
+void OLC_GeofenceDestroy(OLC_Geofence* fences)
+{
+    if (!fences) {
+        return;
+    }
+    for (size_t j = 0; j < fences->fence_capacity; ++j) {
+        free(fences->fences[j].vertices);
+        free(fences->fences[j].cells);
+    }
+    free(fences->fences);
+    olc_table_free(&fences->entries);
+    free(fences);
+}
+
+int OLC_GeofenceSet(OLC_Geofence* fences, size_t id,
+                    const OLC_LatLon* vertices, size_t n)
+{
+    remove_fence(fences, id);
+    if (n == 0) {
+        return 1;
+    }
+    if (n < 3 || id >= UINT32_MAX) {
+        return 0;
+    }
+    if (id >= fences->fence_capacity) {
+        size_t capacity = fences->fence_capacity ? fences->fence_capacity : 16;
+        while (capacity <= id) {
+            capacity *= 2;
+        }
+        Fence* grown = realloc(fences->fences, capacity * sizeof(Fence));
+        if (!grown) {
+            return 0;
+        }
+        memset(grown + fences->fence_capacity, 0,
+               (capacity - fences->fence_capacity) * sizeof(Fence));
+        fences->fences = grown;
+        fences->fence_capacity = capacity;
+    }
+
+    Fence* fence = &fences->fences[id];
+    fence->lat_lo = fence->lon_lo = 1000;
+    fence->lat_hi = fence->lon_hi = -1000;
+    for (size_t j = 0; j < n; ++j) {
+        // Written so that NaN fails too.
+        if (!(vertices[j].lat >= -90 && vertices[j].lat <= 90 &&
+              vertices[j].lon >= -180 && vertices[j].lon <= 180)) {
+            return 0;
+        }
+        fence->lat_lo = vertices[j].lat < fence->lat_lo ? vertices[j].lat : fence->lat_lo;
+        fence->lat_hi = vertices[j].lat > fence->lat_hi ? vertices[j].lat : fence->lat_hi;
+        fence->lon_lo = vertices[j].lon < fence->lon_lo ? vertices[j].lon : fence->lon_lo;
+        fence->lon_hi = vertices[j].lon > fence->lon_hi ? vertices[j].lon : fence->lon_hi;
+    }
+    fence->vertices = malloc(n * sizeof(OLC_LatLon));
+    if (!fence->vertices) {
+        return 0;
+    }
+    memcpy(fence->vertices, vertices, n * sizeof(OLC_LatLon));
+    fence->n = n;
+
+    Compiler comp;
+    memset(&comp, 0, sizeof(comp));
+    comp.fence = fence;
+    comp.id = id;
+    comp.max_level = fences->max_level;
+    comp.xs = malloc(n * sizeof(double));
+    comp.row_edges = malloc(n * sizeof(uint32_t));
+    int ok = comp.xs && comp.row_edges && compile(&comp, fences->max_cells);
+    ok = ok && olc_table_reserve(&fences->entries, fences->entries.size + comp.out_count);
+    if (ok) {
+        // At least one element, so that a fence without cells still allocates.
+        size_t count = comp.out_count ? comp.out_count : 1;
+        fence->cells = malloc(count * sizeof(OLC_Packed));
+        ok = fence->cells != 0;
+    }
+    if (ok) {
+        for (size_t j = 0; j < comp.out_count; ++j) {
+            insert_entry(fences, &comp.out[j]);
+            fence->cells[j] = comp.out[j].code;
+        }
+        fence->cell_count = comp.out_count;
+        ++fences->fence_count;
+    } else {
+        free(fence->vertices);
+        fence->vertices = 0;
+    }
+    free(comp.row_edges);
+    free(comp.xs);
+    free(comp.out);
+    free(comp.pool);
+    free(comp.queue);
+    return ok;
+}
+
+size_t OLC_GeofenceSize(const OLC_Geofence* fences)
+{
+    return fences->fence_count;
+}
+
+size_t OLC_GeofenceCells(const OLC_Geofence* fences, size_t* boundary)
+{
+    if (boundary) {
+        *boundary = fences->boundary;
+    }
+    return fences->entries.size;
+}
+
+size_t OLC_GeofenceFind(const OLC_Geofence* fences, const OLC_LatLon* location,
+                        size_t* ids, size_t maxcount)
+{
+    OLC_Packed codes[OLC_LEVELS];
+    size_t slots[OLC_LEVELS];
+    OLC_EncodePackedMulti(location, fences->lengths, fences->length_count, codes);
+    const Entry* entries = fences->entries.entries;
+    for (size_t k = 0; k < fences->length_count; ++k) {
+        slots[k] = olc_table_slot(&fences->entries, codes[k]);
+        GEOFENCE_PREFETCH(&entries[slots[k]]);
+    }
+    size_t count = 0;
+    size_t mask = fences->entries.capacity - 1;
+    for (size_t k = 0; k < fences->length_count; ++k) {
+        for (size_t slot = slots[k]; entries[slot].code != OLC_TABLE_EMPTY;
+             slot = (slot + 1) & mask) {
+            const Entry* entry = &entries[slot];
+            if (entry->code != codes[k]) {
+                continue;
+            }
+            if (entry->boundary &&
+                !point_inside(&fences->fences[entry->fence], location->lat, location->lon)) {
+                continue;
+            }
+            if (count < maxcount) {
+                ids[count] = entry->fence;
+            }
+            ++count;
+        }
+    }
+    if (count > maxcount) {
+        return 0;
+    }
+    // The cells of a fence are disjoint, so no fence comes up twice.
+    for (size_t j = 1; j < count; ++j) {
+        size_t id = ids[j];
+        size_t k = j;
+        for (; k > 0 && ids[k - 1] > id; --k) {
+            ids[k] = ids[k - 1];
+        }
+        ids[k] = id;
+    }
+    return count;
+}
+
+// Compiles the polygon of comp->fence into cells, at most max_cells of
+// them unless the root cells alone are more.
+static int compile(Compiler* comp, size_t max_cells)
+{
+    const Fence* fence = comp->fence;
+    size_t level = olc_box_level(fence->lat_hi - fence->lat_lo, fence->lon_hi - fence->lon_lo,
+                                 comp->max_level);
+    OLC_LatLon lo = { fence->lat_lo, fence->lon_lo };
+    OLC_LatLon hi = { fence->lat_hi, fence->lon_hi };
+    OLC_Packed roots[GEOFENCE_ROOT_CELLS];
+    size_t root_count = OLC_CoverBBox(&lo, &hi, kOlcLevelLengths[level], kOlcLevelLengths[level],
+                                      GEOFENCE_ROOT_CELLS, roots);
+    if (!root_count || !reserve_pool(comp, root_count * fence->n)) {
+        return 0;
+    }
+    for (size_t j = 0; j < root_count; ++j) {
+        OLC_CodeArea area;
+        OLC_DecodePacked(roots[j], &area);
+        Cell cell = {
+            roots[j], level, area.lo.lat, area.hi.lat, area.lo.lon, area.hi.lon,
+            comp->pool_size, 0,
+        };
+        for (size_t edge = 0; edge < fence->n; ++edge) {
+            if (edge_crosses(fence, edge, &cell)) {
+                comp->pool[comp->pool_size++] = edge;
+                ++cell.edge_count;
+            }
+        }
+        if (cell.edge_count) {
+            if (!add_cell(comp, &cell)) {
+                return 0;
+            }
+        } else if (point_inside(fence, (cell.lat_lo + cell.lat_hi) / 2,
+                                (cell.lon_lo + cell.lon_hi) / 2)) {
+            if (!add_output(comp, cell.code, 0)) {
+                return 0;
+            }
+        }
+    }
+
+    // Boundary cells are refined, coarsest first, for as long as the cells
+    // stay within max_cells; the rest stay boundary cells.
+    size_t total = comp->tail + comp->out_count;
+    int full = 0;
+    while (comp->head < comp->tail) {
+        Cell cell = comp->queue[comp->head++];
+        if (!full && cell.level < comp->max_level && total <= max_cells) {
+            size_t added = 0;
+            int refined = refine(comp, &cell, max_cells - total + 1, &added);
+            if (refined < 0) {
+                return 0;
+            }
+            if (refined) {
+                total = total - 1 + added;
+                continue;
+            }
+            full = 1;
+        }
+        if (!add_output(comp, cell.code, 1)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Splits a boundary cell into its children, queueing the boundary ones and
+// adding the interior ones to the output; added is set to their number.
+// Returns 1, or 0 if that would be more than budget, in which case nothing
+// is added, and -1 if memory runs out.
+static int refine(Compiler* comp, const Cell* cell, size_t budget, size_t* added)
+{
+    const Fence* fence = comp->fence;
+    size_t level = cell->level + 1;
+    size_t rows = kOlcLevelRows[cell->level];
+    size_t columns = kOlcLevelColumns[cell->level];
+    double lat_step = (cell->lat_hi - cell->lat_lo) / rows;
+    double lon_step = (cell->lon_hi - cell->lon_lo) / columns;
+    OLC_Packed children[400];
+    OLC_PackedChildren(cell->code, children);
+
+    size_t queued = comp->tail;
+    size_t output = comp->out_count;
+    size_t pool_size = comp->pool_size;
+    size_t count = 0;
+    for (size_t row = 0; row < rows && count <= budget; ++row) {
+        // Only the edges that reach into the row can cross its cells.
+        double row_lo = cell->lat_lo + row * lat_step - GEOFENCE_MARGIN;
+        double row_hi = cell->lat_lo + (row + 1) * lat_step + GEOFENCE_MARGIN;
+        size_t row_count = 0;
+        for (size_t j = 0; j < cell->edge_count; ++j) {
+            uint32_t edge = comp->pool[cell->edges + j];
+            const OLC_LatLon* a = &fence->vertices[edge];
+            const OLC_LatLon* b = &fence->vertices[edge + 1 < fence->n ? edge + 1 : 0];
+            if ((a->lat >= row_lo || b->lat >= row_lo) && (a->lat <= row_hi || b->lat <= row_hi)) {
+                comp->row_edges[row_count++] = edge;
+            }
+        }
+        size_t crossings = 0;
+        int have_crossings = 0;
+        for (size_t column = 0; column < columns && count <= budget; ++column) {
+            Cell child = {
+                children[row * columns + column], level,
+                cell->lat_lo + row * lat_step, cell->lat_lo + (row + 1) * lat_step,
+                cell->lon_lo + column * lon_step, cell->lon_lo + (column + 1) * lon_step,
+                comp->pool_size, 0,
+            };
+            if (!reserve_pool(comp, comp->pool_size + row_count)) {
+                return -1;
+            }
+            for (size_t j = 0; j < row_count; ++j) {
+                uint32_t edge = comp->row_edges[j];
+                if (edge_crosses(fence, edge, &child)) {
+                    comp->pool[comp->pool_size++] = edge;
+                    ++child.edge_count;
+                }
+            }
+            if (child.edge_count) {
+                if (!add_cell(comp, &child)) {
+                    return -1;
+                }
+                ++count;
+                continue;
+            }
+            // Cells no edge crosses are inside if their center is; one pass
+            // over the edges finds where they cross the row of centers.
+            double lat = (child.lat_lo + child.lat_hi) / 2;
+            double lon = (child.lon_lo + child.lon_hi) / 2;
+            if (!have_crossings) {
+                crossings = row_crossings(fence, lat, comp->xs);
+                have_crossings = 1;
+            }
+            int inside = 0;
+            for (size_t j = 0; j < crossings; ++j) {
+                inside ^= lon < comp->xs[j];
+            }
+            if (inside) {
+                if (!add_output(comp, child.code, 0)) {
+                    return -1;
+                }
+                ++count;
+            }
+        }
+    }
+    if (count > budget) {
+        comp->tail = queued;
+        comp->out_count = output;
+        comp->pool_size = pool_size;
+        return 0;
+    }
+    *added = count;
+    return 1;
+}
+
+static int add_cell(Compiler* comp, const Cell* cell)
+{
+    if (comp->tail == comp->queue_capacity) {
+        size_t capacity = comp->queue_capacity ? 2 * comp->queue_capacity : 64;
+        Cell* grown = realloc(comp->queue, capacity * sizeof(Cell));
+        if (!grown) {
+            return 0;
+        }
+        comp->queue = grown;
+        comp->queue_capacity = capacity;
+    }
+    comp->queue[comp->tail++] = *cell;
+    return 1;
+}
+
+static int add_output(Compiler* comp, OLC_Packed code, int boundary)
+{
+    if (comp->out_count == comp->out_capacity) {
+        size_t capacity = comp->out_capacity ? 2 * comp->out_capacity : 64;
+        Entry* grown = realloc(comp->out, capacity * sizeof(Entry));
+        if (!grown) {
+            return 0;
+        }
+        comp->out = grown;
+        comp->out_capacity = capacity;
+    }
+    Entry* entry = &comp->out[comp->out_count++];
+    entry->code = code;
+    entry->fence = comp->id;
+    entry->boundary = boundary;
+    return 1;
+}
+
+static int reserve_pool(Compiler* comp, size_t size)
+{
+    if (size <= comp->pool_capacity) {
+        return 1;
+    }
+    size_t capacity = comp->pool_capacity ? comp->pool_capacity : 256;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    uint32_t* grown = realloc(comp->pool, capacity * sizeof(uint32_t));
+    if (!grown) {
+        return 0;
+    }
+    comp->pool = grown;
+    comp->pool_capacity = capacity;
+    return 1;
+}
+
+// Checks whether an edge has a point in a cell, widened by GEOFENCE_MARGIN,
+// by clipping it to the cell (Liang-Barsky).
+static int edge_crosses(const Fence* fence, size_t edge, const Cell* cell)
+{
+    const OLC_LatLon* a = &fence->vertices[edge];
+    const OLC_LatLon* b = &fence->vertices[edge + 1 < fence->n ? edge + 1 : 0];
+    if ((a->lon < cell->lon_lo - GEOFENCE_MARGIN && b->lon < cell->lon_lo - GEOFENCE_MARGIN) ||
+        (a->lon > cell->lon_hi + GEOFENCE_MARGIN && b->lon > cell->lon_hi + GEOFENCE_MARGIN)) {
+        return 0;
+    }
+    double d[2] = { b->lon - a->lon, b->lat - a->lat };
+    double lo[2] = { cell->lon_lo - GEOFENCE_MARGIN - a->lon,
+                     cell->lat_lo - GEOFENCE_MARGIN - a->lat };
+    double hi[2] = { cell->lon_hi + GEOFENCE_MARGIN - a->lon,
+                     cell->lat_hi + GEOFENCE_MARGIN - a->lat };
+    double t0 = 0;
+    double t1 = 1;
+    for (int k = 0; k < 2; ++k) {
+        if (d[k] == 0) {
+            if (lo[k] > 0 || hi[k] < 0) {
+                return 0;
+            }
+            continue;
+        }
+        double ta = lo[k] / d[k];
+        double tb = hi[k] / d[k];
+        if (ta > tb) {
+            double t = ta;
+            ta = tb;
+            tb = t;
+        }
+        t0 = ta > t0 ? ta : t0;
+        t1 = tb < t1 ? tb : t1;
+        if (t0 > t1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Gets the longitudes where the edges cross the parallel at lat, counted as
+// point_inside() counts them; a point on it is inside if an odd number of
+// them are east of it.
+static size_t row_crossings(const Fence* fence, double lat, double* xs)
+{
+    size_t count = 0;
+    for (size_t j = 0, k = fence->n - 1; j < fence->n; k = j++) {
+        const OLC_LatLon* a = &fence->vertices[j];
+        const OLC_LatLon* b = &fence->vertices[k];
+        if ((a->lat > lat) != (b->lat > lat)) {
+            xs[count++] = (b->lon - a->lon) * (lat - a->lat) / (b->lat - a->lat) + a->lon;
+        }
+    }
+    return count;
+}
+
+// The crossing number test: a point is inside if a ray from it to the east
+// crosses the edges an odd number of times.
+static int point_inside(const Fence* fence, double lat, double lon)
+{
+    if (lat < fence->lat_lo || lat > fence->lat_hi ||
+        lon < fence->lon_lo || lon > fence->lon_hi) {
+        return 0;
+    }
+    int inside = 0;
+    for (size_t j = 0, k = fence->n - 1; j < fence->n; k = j++) {
+        const OLC_LatLon* a = &fence->vertices[j];
+        const OLC_LatLon* b = &fence->vertices[k];
+        if ((a->lat > lat) != (b->lat > lat) &&
+            lon < (b->lon - a->lon) * (lat - a->lat) / (b->lat - a->lat) + a->lon) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+static void remove_fence(OLC_Geofence* fences, size_t id)
+{
+    if (id >= fences->fence_capacity || !fences->fences[id].vertices) {
+        return;
+    }
+    Fence* fence = &fences->fences[id];
+    for (size_t j = 0; j < fence->cell_count; ++j) {
+        remove_entry(fences, fence->cells[j], id);
+    }
+    free(fence->vertices);
+    free(fence->cells);
+    memset(fence, 0, sizeof(Fence));
+    --fences->fence_count;
+}
+
+// Adds an entry; the table must have room for it.
+static void insert_entry(OLC_Geofence* fences, const Entry* entry)
+{
+    olc_table_insert(&fences->entries, entry);
+    fences->boundary += entry->boundary;
+    count_level(fences, entry->code, 1);
+}
+
+// Removes the entry of a fence for a cell.
+static void remove_entry(OLC_Geofence* fences, OLC_Packed code, uint32_t fence)
+{
+    const Entry* entries = fences->entries.entries;
+    size_t mask = fences->entries.capacity - 1;
+    size_t slot = olc_table_slot(&fences->entries, code);
+    while (entries[slot].code != code || entries[slot].fence != fence) {
+        if (entries[slot].code == OLC_TABLE_EMPTY) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    fences->boundary -= entries[slot].boundary;
+    olc_table_remove(&fences->entries, slot);
+    count_level(fences, code, -1);
+}
+
+// Keeps the number of cells at each level, and the lengths of the levels
+// that have any, which are those a query looks up.
+static void count_level(OLC_Geofence* fences, OLC_Packed code, int delta)
+{
+    size_t level = olc_level_of_length(OLC_PackedLength(code));
+    size_t before = fences->level_cells[level];
+    fences->level_cells[level] += delta;
+    if ((before == 0) == (fences->level_cells[level] == 0)) {
+        return;
+    }
+    fences->length_count = 0;
+    for (size_t j = 0; j < OLC_LEVELS; ++j) {
+        if (fences->level_cells[j]) {
+            fences->lengths[fences->length_count++] = kOlcLevelLengths[j];
+        }
+    }
+}
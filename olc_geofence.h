@@ -0,0 +1,51 @@
+#ifndef OLC_GEOFENCE_H_
+#define OLC_GEOFENCE_H_
+
+#include <stddef.h>
+#include "olc.h"
+
+// A set of polygon geofences, numbered by the caller, for finding all the
+// fences that contain a location.  Each polygon is compiled into disjoint
+// cells of adaptive lengths: interior cells, which lie wholly inside it, and
+// boundary cells, which its edges cross.  The cells of all fences are kept
+// in one hash table keyed by packed code.  A query encodes the location
+// once, looks up its cell at each length in use, and tests the polygon
+// exactly only for boundary cells.
+//
+// Polygons are given by their vertices, latitude and longitude taken as
+// plane coordinates; they may not cross the antimeridian.  The last vertex
+// connects back to the first.
+typedef struct OLC_Geofence OLC_Geofence;
+
+// Create an empty set of fences whose cells are at most max_length digits
+// long (rounded as OLC_EncodePacked does), with at most max_cells cells for
+// each fence; boundary cells are refined for as long as both allow.
+// Returns 0 on failure.
+OLC_Geofence* OLC_GeofenceCreate(size_t max_length, size_t max_cells);
+
+// Free a set of fences
+void OLC_GeofenceDestroy(OLC_Geofence* fences);
+
+// Set fence id to the polygon with n vertices, replacing the fence that had
+// that number; with n 0, the fence is removed.  Only the cells of this fence
+// are compiled again.  Returns 0 on failure (the polygon has fewer than
+// three vertices, a vertex is out of range, or memory runs out), in which
+// case the fence is removed.
+int OLC_GeofenceSet(OLC_Geofence* fences, size_t id,
+                    const OLC_LatLon* vertices, size_t n);
+
+// Get the number of fences in a set
+size_t OLC_GeofenceSize(const OLC_Geofence* fences);
+
+// Get the number of cells the fences were compiled into, and how many of
+// them are boundary cells; boundary may be 0.
+size_t OLC_GeofenceCells(const OLC_Geofence* fences, size_t* boundary);
+
+// Find the fences that contain a location (edges count as inside or outside
+// as the crossing number test has it) and write their numbers, in ascending
+// order, into ids.  Returns their number, or 0 if they do not fit into
+// maxcount entries.
+size_t OLC_GeofenceFind(const OLC_Geofence* fences, const OLC_LatLon* location,
+                        size_t* ids, size_t maxcount);
+
+#endif
@@ -0,0 +1,517 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "olc_index.h"
+#include "olc_internal.h"
+
+#define INDEX_MAGIC "OLCINDEX"
+
+// Also tells the byte order of the file apart.
+#define INDEX_VERSION 1
+
+// Number of records per directory entry.  A block of packed codes takes
+// 2 KB, so it never straddles a page; a lookup touches the directory and
+// then a single page of codes.
+#define INDEX_BLOCK_SIZE 256
+
+// Added to the file name while the file is written.
+#define INDEX_TEMP_SUFFIX ".tmp"
+
+// Every part of the file starts on a boundary of this many bytes.
+#define INDEX_ALIGN 4096
+
+// Longest code field looked at; longer ones are skipped.
+#define INDEX_CODE_SIZE 32
+
+// Limit on the cells OLC_IndexFindBBox covers its rectangle with.  More
+// cells cut out fewer records that are then filtered out, but each needs its
+// own lookups, and a finer covering takes longer to compute.
+#define INDEX_COVER_CELLS 16
+
+// Room for a covering of the whole world, which takes 162 of the shortest
+// cells.
+#define INDEX_MAX_CELLS 256
+
+// Sections are file offsets in bytes.
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size;
+    uint64_t count;
+    uint64_t blocks;
+    uint64_t directory;     // first packed code of every block
+    uint64_t keys;          // packed code of every record
+    uint64_t offsets;       // payload offset of every record, and the end
+    uint64_t payload;
+    uint64_t payload_size;
+} IndexHeader;
+
+struct OLC_Index {
+    void* map;
+    size_t size;
+    size_t count;
+    size_t blocks;
+    size_t block_size;
+    const OLC_Packed* directory;
+    const OLC_Packed* keys;
+    const uint64_t* offsets;
+    const char* payload;
+    size_t payload_size;
+};
+
+// A record while building, with the position of its payload in the text.
+typedef struct Entry {
+    OLC_Packed key;
+    size_t pos;
+    size_t len;
+} Entry;
+
+// The rectangle of OLC_IndexFindBBox.
+typedef struct Box {
+    double lat_lo;
+    double lat_hi;
+    double lon_lo;
+    double lon_hi;
+    int wraps;
+} Box;
+
+static int add_entry(const char* line, size_t len, size_t pos, char delimiter,
+                     Entry** entries, size_t* count, size_t* capacity);
+static int write_padding(FILE* fp, uint64_t* pos, uint64_t end);
+static uint64_t align_offset(uint64_t offset);
+static size_t search(const OLC_Packed* keys, size_t n, OLC_Packed key);
+static size_t lower_bound(const OLC_Index* index, OLC_Packed key);
+static size_t upper_bound(const OLC_Index* index, size_t first, OLC_Packed last);
+static size_t find_range(const OLC_Index* index, const char* code, size_t size,
+                         int prefix, size_t* first);
+static int center_inside(const OLC_CodeArea* area, const Box* box);
+static int area_inside(const OLC_CodeArea* area, const Box* box);
+static int report(const OLC_Index* index, size_t first, size_t end,
+                  const Box* box, int inside,
+                  OLC_IndexFunc* func, void* data, size_t* found);
+
+int OLC_IndexBuild(const char* file, const char* text, size_t size, char delimiter,
+                   size_t* records, size_t* skipped)
+{
+    Entry* entries = 0;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t lines = 0;
+    int ok = 1;
+    for (size_t pos = 0; ok && pos < size; ++lines) {
+        const char* eol = memchr(text + pos, '\n', size - pos);
+        size_t next = eol ? (size_t) (eol - text) + 1 : size;
+        size_t len = (eol ? (size_t) (eol - text) : size) - pos;
+        if (len > 0 && text[pos + len - 1] == '\r') {
+            --len;
+        }
+        ok = add_entry(text + pos, len, pos, delimiter, &entries, &count, &capacity);
+        pos = next;
+    }
+
+    // Sorting moves the entries back and forth between two arrays.
+    Entry* tmp = ok && count > 0 ? malloc(count * sizeof(Entry)) : 0;
+    ok = ok && (tmp != 0 || count == 0);
+    if (ok) {
+        olc_sort_packed(entries, tmp, count, sizeof(Entry));
+    }
+    free(tmp);
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(IndexHeader));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.block_size = INDEX_BLOCK_SIZE;
+    header.count = count;
+    header.blocks = (count + INDEX_BLOCK_SIZE - 1) / INDEX_BLOCK_SIZE;
+    header.directory = align_offset(sizeof(IndexHeader));
+    header.keys = align_offset(header.directory + header.blocks * sizeof(OLC_Packed));
+    header.offsets = align_offset(header.keys + count * sizeof(OLC_Packed));
+    header.payload = align_offset(header.offsets + (count + 1) * sizeof(uint64_t));
+    for (size_t j = 0; j < count; ++j) {
+        header.payload_size += entries[j].len + 1;
+    }
+
+    // The file is written under a temporary name and renamed when complete,
+    // so that a failed build leaves no partial file, nor replaces an index.
+    size_t name_size = strlen(file) + sizeof(INDEX_TEMP_SUFFIX);
+    char* temp = ok ? malloc(name_size) : 0;
+    if (temp) {
+        snprintf(temp, name_size, "%s%s", file, INDEX_TEMP_SUFFIX);
+    }
+    FILE* fp = temp ? fopen(temp, "wb") : 0;
+    ok = fp != 0;
+    uint64_t pos = 0;
+    if (ok) {
+        ok = fwrite(&header, sizeof(IndexHeader), 1, fp) == 1;
+        pos = sizeof(IndexHeader);
+    }
+    ok = ok && write_padding(fp, &pos, header.directory);
+    for (size_t j = 0; ok && j < count; j += INDEX_BLOCK_SIZE) {
+        ok = fwrite(&entries[j].key, sizeof(OLC_Packed), 1, fp) == 1;
+        pos += sizeof(OLC_Packed);
+    }
+    ok = ok && write_padding(fp, &pos, header.keys);
+    for (size_t j = 0; ok && j < count; ++j) {
+        ok = fwrite(&entries[j].key, sizeof(OLC_Packed), 1, fp) == 1;
+        pos += sizeof(OLC_Packed);
+    }
+    ok = ok && write_padding(fp, &pos, header.offsets);
+    uint64_t offset = 0;
+    for (size_t j = 0; ok && j <= count; ++j) {
+        ok = fwrite(&offset, sizeof(uint64_t), 1, fp) == 1;
+        pos += sizeof(uint64_t);
+        offset += j < count ? entries[j].len + 1 : 0;
+    }
+    ok = ok && write_padding(fp, &pos, header.payload);
+    for (size_t j = 0; ok && j < count; ++j) {
+        ok = fwrite(text + entries[j].pos, 1, entries[j].len, fp) == entries[j].len &&
+             fputc('\0', fp) != EOF;
+    }
+    if (fp && fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (fp) {
+        ok = ok && rename(temp, file) == 0;
+        if (!ok) {
+            remove(temp);
+        }
+    }
+    free(temp);
+    free(entries);
+
+    if (records) {
+        *records = count;
+    }
+    if (skipped) {
+        *skipped = lines - count;
+    }
+    return ok;
+}
+
+OLC_Index* OLC_IndexOpen(const char* file)
+{
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat st;
+    void* map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= (off_t) sizeof(IndexHeader)) {
+        map = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+
+    // The parts must be in order, aligned and within the file; with the
+    // counts bounded by the size first, none of the sums can overflow.
+    size_t size = st.st_size;
+    const IndexHeader* header = map;
+    const uint64_t words = size / sizeof(uint64_t);
+    int ok = memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+             header->version == INDEX_VERSION && header->block_size > 0 &&
+             header->count < words &&
+             header->blocks == (header->count + header->block_size - 1) / header->block_size &&
+             header->directory % INDEX_ALIGN == 0 && header->keys % INDEX_ALIGN == 0 &&
+             header->offsets % INDEX_ALIGN == 0 &&
+             header->directory >= sizeof(IndexHeader) && header->directory <= size &&
+             header->keys <= size && header->offsets <= size && header->payload <= size &&
+             header->directory + header->blocks * sizeof(OLC_Packed) <= header->keys &&
+             header->keys + header->count * sizeof(OLC_Packed) <= header->offsets &&
+             header->offsets + (header->count + 1) * sizeof(uint64_t) <= header->payload &&
+             header->payload_size <= size - header->payload;
+    const uint64_t* offsets = (const uint64_t*) ((const char*) map + header->offsets);
+    ok = ok && offsets[header->count] == header->payload_size;
+
+    OLC_Index* index = ok ? calloc(1, sizeof(OLC_Index)) : 0;
+    if (!index) {
+        munmap(map, size);
+        return 0;
+    }
+    index->map = map;
+    index->size = size;
+    index->count = header->count;
+    index->blocks = header->blocks;
+    index->block_size = header->block_size;
+    index->directory = (const OLC_Packed*) ((const char*) map + header->directory);
+    index->keys = (const OLC_Packed*) ((const char*) map + header->keys);
+    index->offsets = offsets;
+    index->payload = (const char*) map + header->payload;
+    index->payload_size = header->payload_size;
+
+    // Lookups jump around, so read-ahead would only waste memory; the
+    // directory is read by every lookup.
+    posix_madvise(map, size, POSIX_MADV_RANDOM);
+    posix_madvise(map, header->keys, POSIX_MADV_WILLNEED);
+    return index;
+}
+
+void OLC_IndexClose(OLC_Index* index)
+{
+    if (!index) {
+        return;
+    }
+    munmap(index->map, index->size);
+    free(index);
+}
+
+size_t OLC_IndexSize(const OLC_Index* index)
+{
+    return index ? index->count : 0;
+}
+
+int OLC_IndexGet(const OLC_Index* index, size_t record, OLC_Packed* code,
+                 const char** payload, size_t* size)
+{
+    if (!index || record >= index->count) {
+        return 0;
+    }
+    // Offsets are only checked here, so that a damaged file can never
+    // make a payload reach out of the mapping.
+    uint64_t begin = index->offsets[record];
+    uint64_t end = index->offsets[record + 1];
+    if (begin >= end || end > index->payload_size || index->payload[end - 1] != '\0') {
+        return 0;
+    }
+    if (code) {
+        *code = index->keys[record];
+    }
+    if (payload) {
+        *payload = index->payload + begin;
+    }
+    if (size) {
+        *size = end - begin - 1;
+    }
+    return 1;
+}
+
+size_t OLC_IndexFind(const OLC_Index* index, const char* code, size_t size,
+                     size_t* first)
+{
+    return find_range(index, code, size, 0, first);
+}
+
+size_t OLC_IndexFindPrefix(const OLC_Index* index, const char* code, size_t size,
+                           size_t* first)
+{
+    return find_range(index, code, size, 1, first);
+}
+
+size_t OLC_IndexFindBBox(const OLC_Index* index,
+                         const OLC_LatLon* lo, const OLC_LatLon* hi,
+                         OLC_IndexFunc* func, void* data)
+{
+    Box box = { lo->lat, hi->lat, lo->lon, hi->lon, lo->lon > hi->lon };
+    OLC_Packed cells[INDEX_MAX_CELLS];
+    size_t count = 0;
+    if (index) {
+        // Starting at cells about the size of the box keeps the covering
+        // from refining level by level down from the largest cells; only
+        // boxes that span a good part of the world need more room.
+        double width = box.lon_hi - box.lon_lo + (box.wraps ? 360 : 0);
+        size_t level = olc_box_level(box.lat_hi - box.lat_lo, width, OLC_LEVELS - 1);
+        size_t length = kOlcLevelLengths[level];
+        count = OLC_CoverBBox(lo, hi, length, OLC_MAX_DIGITS, INDEX_COVER_CELLS, cells);
+        if (!count) {
+            count = OLC_CoverBBox(lo, hi, length, OLC_MAX_DIGITS, INDEX_MAX_CELLS, cells);
+        }
+    }
+
+    // The records of a covering cell are those of the cell and all the
+    // cells it contains; those of the larger cells that contain it are
+    // found by exact lookups.  The cells are sorted, so each of these comes
+    // up for a run of cells, and comes after the records found before it.
+    OLC_Packed ancestors[OLC_LEVELS];
+    memset(ancestors, 0xff, sizeof(ancestors));
+    size_t found = 0;
+    int more = 1;
+    for (size_t j = 0; more && j < count; ++j) {
+        size_t length = OLC_PackedLength(cells[j]);
+        OLC_CodeArea area;
+        for (int level = 0; more && kOlcLevelLengths[level] < length; ++level) {
+            OLC_Packed parent;
+            OLC_PackedParent(cells[j], kOlcLevelLengths[level], &parent);
+            if (parent == ancestors[level]) {
+                continue;
+            }
+            ancestors[level] = parent;
+            OLC_DecodePacked(parent, &area);
+            if (center_inside(&area, &box)) {
+                size_t first = lower_bound(index, parent);
+                more = report(index, first, upper_bound(index, first, parent),
+                              &box, 1, func, data, &found);
+            }
+        }
+        OLC_DecodePacked(cells[j], &area);
+        size_t first = lower_bound(index, cells[j]);
+        size_t end = upper_bound(index, first, OLC_PackedLastDescendant(cells[j]));
+        more = more && report(index, first, end, &box, area_inside(&area, &box),
+                              func, data, &found);
+    }
+    return found;
+}
+
+// Parses a code,payload line and appends it to a growing array.  Returns 0
+// only when out of memory.
+static int add_entry(const char* line, size_t len, size_t pos, char delimiter,
+                     Entry** entries, size_t* count, size_t* capacity)
+{
+    const char* sep = memchr(line, delimiter, len);
+    size_t code_size = sep ? (size_t) (sep - line) : len;
+    OLC_Packed key;
+    if (code_size == 0 || code_size > INDEX_CODE_SIZE || !OLC_Pack(line, code_size, &key)) {
+        return 1;
+    }
+
+    if (*count == *capacity) {
+        size_t capacity_new = *capacity ? *capacity * 2 : 1024;
+        Entry* entries_new = realloc(*entries, capacity_new * sizeof(Entry));
+        if (!entries_new) {
+            return 0;
+        }
+        *entries = entries_new;
+        *capacity = capacity_new;
+    }
+    Entry* entry = &(*entries)[(*count)++];
+    entry->key = key;
+    entry->pos = sep ? pos + code_size + 1 : pos + len;
+    entry->len = sep ? len - code_size - 1 : 0;
+    return 1;
+}
+
+// Writes zeros up to the given file offset.
+static int write_padding(FILE* fp, uint64_t* pos, uint64_t end)
+{
+    static const char zeros[INDEX_ALIGN];
+    while (*pos < end) {
+        size_t len = end - *pos < INDEX_ALIGN ? end - *pos : INDEX_ALIGN;
+        if (fwrite(zeros, 1, len, fp) != len) {
+            return 0;
+        }
+        *pos += len;
+    }
+    return 1;
+}
+
+static uint64_t align_offset(uint64_t offset)
+{
+    return (offset + INDEX_ALIGN - 1) / INDEX_ALIGN * INDEX_ALIGN;
+}
+
+// Binary search for the first of n sorted keys that is not below key (or
+// n), with a conditional move instead of a hard to predict branch.
+static size_t search(const OLC_Packed* keys, size_t n, OLC_Packed key)
+{
+    if (n == 0) {
+        return 0;
+    }
+    const OLC_Packed* base = keys;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = base[half - 1] < key ? base + half : base;
+        n -= half;
+    }
+    return (base - keys) + (*base < key);
+}
+
+// Gets the number of the first record whose code is not below key.  The
+// directory tells the block it is in (or the start of the next one).
+static size_t lower_bound(const OLC_Index* index, OLC_Packed key)
+{
+    size_t block = search(index->directory, index->blocks, key);
+    if (block == 0) {
+        return 0;
+    }
+    size_t begin = (block - 1) * index->block_size;
+    size_t end = block * index->block_size < index->count ? block * index->block_size : index->count;
+    return begin + search(index->keys + begin, end - begin, key);
+}
+
+// Gets the number of the first record from first on whose code is above
+// last.  Ranges are mostly short, so this gallops ahead from first.
+static size_t upper_bound(const OLC_Index* index, size_t first, OLC_Packed last)
+{
+    size_t step = 1;
+    while (first + step <= index->count && index->keys[first + step - 1] <= last) {
+        first += step;
+        step *= 2;
+    }
+    size_t end = first + step < index->count ? first + step : index->count;
+    return first + search(index->keys + first, end - first, last + 1);
+}
+
+static size_t find_range(const OLC_Index* index, const char* code, size_t size,
+                         int prefix, size_t* first)
+{
+    OLC_Packed key;
+    if (!index || !OLC_Pack(code, size, &key)) {
+        return 0;
+    }
+    OLC_Packed last = prefix ? OLC_PackedLastDescendant(key) : key;
+    size_t begin = lower_bound(index, key);
+    size_t end = upper_bound(index, begin, last);
+    if (first) {
+        *first = begin;
+    }
+    return end - begin;
+}
+
+static int center_inside(const OLC_CodeArea* area, const Box* box)
+{
+    OLC_LatLon center;
+    OLC_GetCenter(area, &center);
+    if (center.lat < box->lat_lo || center.lat > box->lat_hi) {
+        return 0;
+    }
+    if (box->wraps) {
+        return center.lon >= box->lon_lo || center.lon <= box->lon_hi;
+    }
+    return center.lon >= box->lon_lo && center.lon <= box->lon_hi;
+}
+
+// Checks whether a whole cell, and so the center of every cell in it, is in
+// the box; cells never cross the antimeridian.
+static int area_inside(const OLC_CodeArea* area, const Box* box)
+{
+    if (area->lo.lat < box->lat_lo || area->hi.lat > box->lat_hi) {
+        return 0;
+    }
+    if (box->wraps) {
+        return area->lo.lon >= box->lon_lo || area->hi.lon <= box->lon_hi;
+    }
+    return area->lo.lon >= box->lon_lo && area->hi.lon <= box->lon_hi;
+}
+
+// Calls func for the records from first to end whose center is in the box,
+// or for all of them if they are known to be inside.  Returns 0 once func
+// asks to stop.
+static int report(const OLC_Index* index, size_t first, size_t end,
+                  const Box* box, int inside,
+                  OLC_IndexFunc* func, void* data, size_t* found)
+{
+    OLC_Packed previous = 0;
+    int match = 0;
+    for (size_t j = first; j < end; ++j) {
+        if (!inside && (j == first || index->keys[j] != previous)) {
+            OLC_CodeArea area;
+            previous = index->keys[j];
+            match = OLC_DecodePacked(previous, &area) && center_inside(&area, box);
+        }
+        if (inside || match) {
+            ++*found;
+            if (func && func(data, j)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,70 @@
+#ifndef OLC_INDEX_H_
+#define OLC_INDEX_H_
+
+#include <stddef.h>
+#include "olc.h"
+
+// A read-only set of records, each a full code with a payload, kept in a
+// file that is mapped into memory as it is.  The records are sorted by
+// packed code (ties keep their input order), so that the records of a cell
+// and of all the cells it contains are a contiguous range of record
+// numbers.  Opening a file only checks its header; pages are read as the
+// queries touch them.
+//
+// The file holds, each part starting on a page boundary: a header, a
+// directory with the first packed code of every block of records, the
+// packed codes, the payload offsets and the payloads, each followed by a
+// NUL.  Numbers are in the byte order of the machine that wrote the file.
+typedef struct OLC_Index OLC_Index;
+
+// Called by OLC_IndexFindBBox for each record found.  Returning nonzero
+// stops the search.
+typedef int (OLC_IndexFunc)(void* data, size_t record);
+
+// Write an index file for CSV text with one code,payload row per line
+// (delimiter separates the two; the payload is the rest of the line, and
+// may be empty).  Lines without a valid full code, such as a header,
+// comments or blank lines, are skipped.  The numbers of records written and
+// of lines skipped are stored in records and skipped if those are not 0.
+// Returns 1 on success, 0 on failure, which leaves no file behind (and an
+// existing file as it was).
+int OLC_IndexBuild(const char* file, const char* text, size_t size, char delimiter,
+                   size_t* records, size_t* skipped);
+
+// Map an index file into memory.  Returns 0 if the file cannot be mapped or
+// is not an index file.
+OLC_Index* OLC_IndexOpen(const char* file);
+
+// Unmap an index file
+void OLC_IndexClose(OLC_Index* index);
+
+// Get the number of records in an index
+size_t OLC_IndexSize(const OLC_Index* index);
+
+// Get the packed code and the payload (NUL terminated, without the line
+// end) of a record; any of them may be 0.  Returns 0 if there is no such
+// record.
+int OLC_IndexGet(const OLC_Index* index, size_t record, OLC_Packed* code,
+                 const char** payload, size_t* size);
+
+// Find the records with the same cell as a full code; first is set to the
+// number of the first one.  Returns their number, or 0 if there are none or
+// the code is not a valid full code.
+size_t OLC_IndexFind(const OLC_Index* index, const char* code, size_t size,
+                     size_t* first);
+
+// Same as OLC_IndexFind, for the records in the cell of a full code or in
+// any of the cells it contains; with "8FVC0000+", all records that start
+// with 8FVC
+size_t OLC_IndexFindPrefix(const OLC_Index* index, const char* code, size_t size,
+                           size_t* first);
+
+// Find the records whose cell center is in the rectangle from lo to hi
+// (edges included; it crosses the antimeridian if lo->lon > hi->lon), and
+// call func for each of them, in record order.  Returns the number of
+// records found.
+size_t OLC_IndexFindBBox(const OLC_Index* index,
+                         const OLC_LatLon* lo, const OLC_LatLon* hi,
+                         OLC_IndexFunc* func, void* data);
+
+#endif
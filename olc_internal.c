@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include "olc_internal.h"
+
+// The table starts with 1 << TABLE_INITIAL_BITS slots.
+#define TABLE_INITIAL_BITS 10
+
+const size_t kOlcLevelLengths[OLC_LEVELS] = { 2, 4, 6, 8, 10, 11, 12, 13, 14, 15 };
+const size_t kOlcLevelRows[OLC_LEVELS]    = { 20, 20, 20, 20, 5, 5, 5, 5, 5, 5 };
+const size_t kOlcLevelColumns[OLC_LEVELS] = { 20, 20, 20, 20, 4, 4, 4, 4, 4, 4 };
+
+static OLC_Packed* entry_at(const OlcTable* table, size_t slot);
+
+size_t olc_level_of_length(size_t length)
+{
+    size_t level = 0;
+    while (level + 1 < OLC_LEVELS && kOlcLevelLengths[level] < length) {
+        ++level;
+    }
+    return level;
+}
+
+size_t olc_box_level(double height, double width, size_t max_level)
+{
+    double lat_size = 20;
+    double lon_size = 20;
+    size_t level = 0;
+    while (level < max_level) {
+        lat_size /= kOlcLevelRows[level];
+        lon_size /= kOlcLevelColumns[level];
+        if (lat_size < height || lon_size < width) {
+            break;
+        }
+        ++level;
+    }
+    return level;
+}
+
+int olc_table_init(OlcTable* table, size_t entry_size)
+{
+    memset(table, 0, sizeof(OlcTable));
+    table->entry_size = entry_size;
+    return olc_table_reserve(table, 0);
+}
+
+void olc_table_free(OlcTable* table)
+{
+    free(table->entries);
+    table->entries = 0;
+    table->capacity = 0;
+    table->size = 0;
+}
+
+int olc_table_reserve(OlcTable* table, size_t size)
+{
+    size_t capacity = table->capacity ? table->capacity : (size_t) 1 << TABLE_INITIAL_BITS;
+    int shift = table->capacity ? table->shift : 64 - TABLE_INITIAL_BITS;
+    while (size > capacity / 2) {
+        capacity *= 2;
+        --shift;
+    }
+    if (capacity == table->capacity) {
+        return 1;
+    }
+    void* entries = malloc(capacity * table->entry_size);
+    if (!entries) {
+        return 0;
+    }
+    OlcTable old = *table;
+    table->entries = entries;
+    table->capacity = capacity;
+    table->shift = shift;
+    for (size_t j = 0; j < capacity; ++j) {
+        *entry_at(table, j) = OLC_TABLE_EMPTY;
+    }
+    for (size_t j = 0; j < old.capacity; ++j) {
+        const OLC_Packed* entry = entry_at(&old, j);
+        if (*entry != OLC_TABLE_EMPTY) {
+            size_t slot = olc_table_slot(table, *entry);
+            while (*entry_at(table, slot) != OLC_TABLE_EMPTY) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            memcpy(entry_at(table, slot), entry, table->entry_size);
+        }
+    }
+    free(old.entries);
+    return 1;
+}
+
+size_t olc_table_insert(OlcTable* table, const void* entry)
+{
+    size_t slot = olc_table_slot(table, *(const OLC_Packed*) entry);
+    while (*entry_at(table, slot) != OLC_TABLE_EMPTY) {
+        slot = (slot + 1) & (table->capacity - 1);
+    }
+    memcpy(entry_at(table, slot), entry, table->entry_size);
+    ++table->size;
+    return slot;
+}
+
+void olc_table_remove(OlcTable* table, size_t hole)
+{
+    size_t mask = table->capacity - 1;
+    --table->size;
+    for (size_t slot = (hole + 1) & mask; *entry_at(table, slot) != OLC_TABLE_EMPTY;
+         slot = (slot + 1) & mask) {
+        size_t home = olc_table_slot(table, *entry_at(table, slot));
+        if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+            memcpy(entry_at(table, hole), entry_at(table, slot), table->entry_size);
+            hole = slot;
+        }
+    }
+    *entry_at(table, hole) = OLC_TABLE_EMPTY;
+}
+
+// Radix sort, one byte of the packed code at a time from the lowest, which
+// keeps items with the same code in order.  Bytes that are the same in all
+// codes are skipped.  Items are moved a word at a time, which their sizes
+// allow, as they start with a packed code.  The result ends up in items.
+void olc_sort_packed(void* items, void* tmp, size_t n, size_t size)
+{
+    size_t words = size / sizeof(OLC_Packed);
+    size_t counts[sizeof(OLC_Packed)][256];
+    memset(counts, 0, sizeof(counts));
+    OLC_Packed* from = items;
+    OLC_Packed* to = tmp;
+    for (size_t j = 0; j < n; ++j) {
+        for (int b = 0; b < sizeof(OLC_Packed); ++b) {
+            ++counts[b][(from[j * words] >> (8 * b)) & 0xff];
+        }
+    }
+
+    for (int b = 0; b < sizeof(OLC_Packed); ++b) {
+        if (n == 0 || counts[b][(from[0] >> (8 * b)) & 0xff] == n) {
+            continue;
+        }
+        size_t start = 0;
+        for (int k = 0; k < 256; ++k) {
+            size_t c = counts[b][k];
+            counts[b][k] = start;
+            start += c;
+        }
+        for (size_t j = 0; j < n; ++j) {
+            const OLC_Packed* item = from + j * words;
+            OLC_Packed* dest = to + words * counts[b][(item[0] >> (8 * b)) & 0xff]++;
+            for (size_t w = 0; w < words; ++w) {
+                dest[w] = item[w];
+            }
+        }
+        OLC_Packed* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != items) {
+        memcpy(items, from, n * size);
+    }
+}
+
+static OLC_Packed* entry_at(const OlcTable* table, size_t slot)
+{
+    return (OLC_Packed*) ((char*) table->entries + slot * table->entry_size);
+}
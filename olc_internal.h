@@ -0,0 +1,70 @@
+#ifndef OLC_INTERNAL_H_
+#define OLC_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "olc.h"
+
+// Helpers shared by the modules built on packed codes; not part of the API.
+
+// Number of code lengths, and so of levels of cells.
+#define OLC_LEVELS 10
+
+// Never a valid packed code, so it marks the empty slots of a table.
+#define OLC_TABLE_EMPTY ((OLC_Packed) -1)
+
+// Code lengths of the levels, and the rows and columns a cell at each level
+// is split into.
+extern const size_t kOlcLevelLengths[OLC_LEVELS];
+extern const size_t kOlcLevelRows[OLC_LEVELS];
+extern const size_t kOlcLevelColumns[OLC_LEVELS];
+
+// Get the level of the shortest code length at least length long.
+size_t olc_level_of_length(size_t length);
+
+// Get the longest level, up to max_level, whose cells are at least as large
+// as a box of height by width degrees.
+size_t olc_box_level(double height, double width, size_t max_level);
+
+// A hash table keyed by packed code, with open addressing and linear
+// probing.  Each entry starts with its packed code; OLC_TABLE_EMPTY marks
+// the empty slots.  Several entries may have the same code.
+typedef struct OlcTable {
+    void* entries;
+    size_t entry_size;
+    size_t capacity;        // a power of two
+    int shift;              // 64 minus the bits of capacity
+    size_t size;
+} OlcTable;
+
+// Set up an empty table.  Returns 0 if memory runs out.
+int olc_table_init(OlcTable* table, size_t entry_size);
+
+// Free the entries of a table
+void olc_table_free(OlcTable* table);
+
+// Make sure the table stays at most half full with size entries, growing
+// and rehashing it if needed.  Returns 0 if memory runs out.
+int olc_table_reserve(OlcTable* table, size_t size);
+
+// Add an entry, which the table must have room for; returns its slot.
+size_t olc_table_insert(OlcTable* table, const void* entry);
+
+// Remove the entry in a slot, moving the entries after it back into the gap
+// where their probe sequence allows, so that no tombstones are needed.
+void olc_table_remove(OlcTable* table, size_t slot);
+
+// Fibonacci hashing: the top bits of the product mix all bits of the code,
+// and neighbouring codes land far apart.
+static inline size_t olc_table_slot(const OlcTable* table, OLC_Packed code)
+{
+    return (code * 0x9E3779B97F4A7C15ULL) >> table->shift;
+}
+
+// Sort n items of size bytes, each starting with its packed code, by code,
+// keeping items with the same code in order.  Items are moved as words of a
+// packed code, so size must be a multiple of sizeof(OLC_Packed); tmp needs
+// room for n items.
+void olc_sort_packed(void* items, void* tmp, size_t n, size_t size);
+
+#endif
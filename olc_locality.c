@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "olc_locality.h"
+
+// OLC_Shorten removes digits only when the reference is closer to the code
+// center than 0.3 times the size of a 4 digit cell (1 degree), in both
+// latitude and longitude; farther localities never help.
+#define LOCALITY_MAX_RANGE 0.3
+
+// A locality in the tree, with its position in the input.
+typedef struct Locality {
+    double lat;
+    double lon;
+    size_t id;
+} Locality;
+
+// The localities are kept as an implicit kd-tree: the node of a range is its
+// middle element, which splits the rest of the range by latitude (on even
+// depths) or longitude (on odd depths).
+struct OLC_LocalityIndex {
+    size_t n;
+    Locality* tree;
+    OLC_LatLon* locations;
+    size_t* name_offsets;
+    char* names;
+};
+
+static double split_value(const Locality* locality, int axis);
+static void select_middle(Locality* tree, size_t lo, size_t hi, size_t mid, int axis);
+static void build(Locality* tree, size_t lo, size_t hi, int axis);
+static void nearest(const Locality* tree, size_t lo, size_t hi, int axis,
+                    const OLC_LatLon* center, double* best_range, size_t* best);
+static int add_locality(const char* line, OLC_LatLon** locations, char*** names,
+                        size_t* count, size_t* capacity);
+
+OLC_LocalityIndex* OLC_LocalityIndexCreate(const OLC_LatLon* locations,
+                                           const char* const* names, size_t n)
+{
+    OLC_LocalityIndex* index = calloc(1, sizeof(OLC_LocalityIndex));
+    if (!index) {
+        return 0;
+    }
+    size_t names_size = 0;
+    for (size_t j = 0; j < n; ++j) {
+        names_size += (names && names[j] ? strlen(names[j]) : 0) + 1;
+    }
+    index->n = n;
+    // At least one element each, so that an empty index still allocates.
+    size_t slots = n ? n : 1;
+    index->tree = malloc(slots * sizeof(Locality));
+    index->locations = malloc(slots * sizeof(OLC_LatLon));
+    index->name_offsets = malloc(slots * sizeof(size_t));
+    index->names = malloc(names_size ? names_size : 1);
+    if (!index->tree || !index->locations || !index->name_offsets || !index->names) {
+        OLC_LocalityIndexDestroy(index);
+        return 0;
+    }
+
+    size_t offset = 0;
+    for (size_t j = 0; j < n; ++j) {
+        // Same normalisation as OLC_Shorten does for its reference.
+        double lat = locations[j].lat;
+        double lon = locations[j].lon;
+        lat = lat < -90 ? -90 : lat > 90 ? 90 : lat;
+        while (lon < -180) {
+            lon += 360;
+        }
+        while (lon >= 180) {
+            lon -= 360;
+        }
+        index->tree[j].lat = lat;
+        index->tree[j].lon = lon;
+        index->tree[j].id = j;
+        index->locations[j] = locations[j];
+
+        size_t len = names && names[j] ? strlen(names[j]) : 0;
+        memcpy(index->names + offset, len ? names[j] : "", len);
+        index->names[offset + len] = '\0';
+        index->name_offsets[j] = offset;
+        offset += len + 1;
+    }
+    build(index->tree, 0, n, 0);
+    return index;
+}
+
+OLC_LocalityIndex* OLC_LocalityIndexLoad(const char* file)
+{
+    FILE* fp = fopen(file, "r");
+    if (!fp) {
+        return 0;
+    }
+    OLC_LatLon* locations = 0;
+    char** names = 0;
+    size_t count = 0;
+    size_t capacity = 0;
+    int ok = 1;
+    // Lines are read whole, however long, so a long name never splits one.
+    char* line = 0;
+    size_t line_size = 0;
+    while (ok && getline(&line, &line_size, fp) != -1) {
+        ok = add_locality(line, &locations, &names, &count, &capacity);
+    }
+    ok = ok && feof(fp);
+    free(line);
+    fclose(fp);
+
+    OLC_LocalityIndex* index = 0;
+    if (ok) {
+        index = OLC_LocalityIndexCreate(locations, (const char* const*) names, count);
+    }
+    for (size_t j = 0; j < count; ++j) {
+        free(names[j]);
+    }
+    free(names);
+    free(locations);
+    return index;
+}
+
+void OLC_LocalityIndexDestroy(OLC_LocalityIndex* index)
+{
+    if (!index) {
+        return;
+    }
+    free(index->names);
+    free(index->name_offsets);
+    free(index->locations);
+    free(index->tree);
+    free(index);
+}
+
+size_t OLC_LocalityIndexSize(const OLC_LocalityIndex* index)
+{
+    return index ? index->n : 0;
+}
+
+int OLC_LocalityGet(const OLC_LocalityIndex* index, size_t locality,
+                    const char** name, OLC_LatLon* location)
+{
+    if (!index || locality >= index->n) {
+        return 0;
+    }
+    if (name) {
+        *name = index->names + index->name_offsets[locality];
+    }
+    if (location) {
+        *location = index->locations[locality];
+    }
+    return 1;
+}
+
+int OLC_ShortenBest(const char* code, size_t size,
+                    const OLC_LocalityIndex* index,
+                    char* shortened, int maxlen, size_t* locality)
+{
+    if (locality) {
+        *locality = OLC_LOCALITY_NONE;
+    }
+    OLC_Parsed parsed;
+    OLC_CodeArea area;
+    if (!index || !OLC_Parse(code, size, &parsed) ||
+        !OLC_ParsedIsFull(&parsed) || !OLC_ParsedDecode(&parsed, &area)) {
+        return 0;
+    }
+    OLC_LatLon center;
+    OLC_GetCenter(&area, &center);
+
+    // OLC_Shorten removes more digits the closer the reference is (by the
+    // larger of the latitude and longitude distances), so the best locality
+    // is the nearest one by that measure.
+    double best_range = LOCALITY_MAX_RANGE;
+    size_t best = OLC_LOCALITY_NONE;
+    nearest(index->tree, 0, index->n, 0, &center, &best_range, &best);
+
+    if (best == OLC_LOCALITY_NONE) {
+        // A reference half way around the world, so that the code is
+        // validated and copied without removing any digits.
+        OLC_LatLon far = { center.lat, center.lon + 180 };
+        return OLC_ParsedShorten(&parsed, &far, shortened, maxlen);
+    }
+    if (locality) {
+        *locality = best;
+    }
+    return OLC_ParsedShorten(&parsed, &index->locations[best], shortened, maxlen);
+}
+
+static double split_value(const Locality* locality, int axis)
+{
+    return axis ? locality->lon : locality->lat;
+}
+
+// Quickselect: puts the element that belongs at mid in sorted order there,
+// with smaller ones before it and larger ones after it.
+static void select_middle(Locality* tree, size_t lo, size_t hi, size_t mid, int axis)
+{
+    while (hi - lo > 1) {
+        Locality pivot = tree[lo + (hi - lo) / 2];
+        double value = split_value(&pivot, axis);
+        tree[lo + (hi - lo) / 2] = tree[hi - 1];
+        tree[hi - 1] = pivot;
+        size_t store = lo;
+        for (size_t j = lo; j < hi - 1; ++j) {
+            if (split_value(&tree[j], axis) < value) {
+                Locality tmp = tree[j];
+                tree[j] = tree[store];
+                tree[store++] = tmp;
+            }
+        }
+        tree[hi - 1] = tree[store];
+        tree[store] = pivot;
+        if (store == mid) {
+            return;
+        }
+        if (mid < store) {
+            hi = store;
+        } else {
+            lo = store + 1;
+        }
+    }
+}
+
+static void build(Locality* tree, size_t lo, size_t hi, int axis)
+{
+    if (hi - lo <= 1) {
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    select_middle(tree, lo, hi, mid, axis);
+    build(tree, lo, mid, !axis);
+    build(tree, mid + 1, hi, !axis);
+}
+
+// Finds the locality closest to center, if it is closer than best_range.
+// Equally close localities are resolved by their position in the input.
+static void nearest(const Locality* tree, size_t lo, size_t hi, int axis,
+                    const OLC_LatLon* center, double* best_range, size_t* best)
+{
+    if (lo >= hi) {
+        return;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    const Locality* node = &tree[mid];
+    double alat = fabs(center->lat - node->lat);
+    double alon = fabs(center->lon - node->lon);
+    double range = alat > alon ? alat : alon;
+    if (range < *best_range ||
+        (range == *best_range && *best != OLC_LOCALITY_NONE && node->id < *best)) {
+        *best_range = range;
+        *best = node->id;
+    }
+
+    double diff = (axis ? center->lon : center->lat) - split_value(node, axis);
+    if (diff < 0) {
+        nearest(tree, lo, mid, !axis, center, best_range, best);
+        if (-diff <= *best_range) {
+            nearest(tree, mid + 1, hi, !axis, center, best_range, best);
+        }
+    } else {
+        nearest(tree, mid + 1, hi, !axis, center, best_range, best);
+        if (diff <= *best_range) {
+            nearest(tree, lo, mid, !axis, center, best_range, best);
+        }
+    }
+}
+
+// Parses a name,lat,lon line and appends it to growing arrays.  Returns 0
+// only when out of memory.
+static int add_locality(const char* line, OLC_LatLon** locations, char*** names,
+                        size_t* count, size_t* capacity)
+{
+    while (*line == ' ' || *line == '\t') {
+        ++line;
+    }
+    const char* comma = strchr(line, ',');
+    if (*line == '#' || !comma) {
+        return 1;
+    }
+    char* end;
+    double lat = strtod(comma + 1, &end);
+    if (end == comma + 1 || *end != ',') {
+        return 1;
+    }
+    const char* start = end + 1;
+    double lon = strtod(start, &end);
+    if (end == start) {
+        return 1;
+    }
+
+    if (*count == *capacity) {
+        size_t capacity_new = *capacity ? *capacity * 2 : 256;
+        OLC_LatLon* locations_new = realloc(*locations, capacity_new * sizeof(OLC_LatLon));
+        if (!locations_new) {
+            return 0;
+        }
+        *locations = locations_new;
+        char** names_new = realloc(*names, capacity_new * sizeof(char*));
+        if (!names_new) {
+            return 0;
+        }
+        *names = names_new;
+        *capacity = capacity_new;
+    }
+
+    size_t len = comma - line;
+    while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t')) {
+        --len;
+    }
+    char* name = malloc(len + 1);
+    if (!name) {
+        return 0;
+    }
+    memcpy(name, line, len);
+    name[len] = '\0';
+    (*locations)[*count].lat = lat;
+    (*locations)[*count].lon = lon;
+    (*names)[*count] = name;
+    ++*count;
+    return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef OLC_LOCALITY_H_
+#define OLC_LOCALITY_H_
+
+#include <stddef.h>
+#include "olc.h"
+
+// Returned as the locality when a code could not be shortened at all
+#define OLC_LOCALITY_NONE ((size_t) -1)
+
+// A set of named reference locations, kept in a spatial index so that the
+// one nearest to a code can be found in O(log n).
+typedef struct OLC_LocalityIndex OLC_LocalityIndex;
+
+// Create an index for n localities; names may be 0.  Returns 0 on failure.
+OLC_LocalityIndex* OLC_LocalityIndexCreate(const OLC_LatLon* locations,
+                                           const char* const* names, size_t n);
+
+// Create an index from a CSV file with name,lat,lon rows; blank lines, lines
+// starting with '#' and lines without valid coordinates (such as a header)
+// are skipped.  Returns 0 on failure.
+OLC_LocalityIndex* OLC_LocalityIndexLoad(const char* file);
+
+// Free an index
+void OLC_LocalityIndexDestroy(OLC_LocalityIndex* index);
+
+// Get the number of localities in an index
+size_t OLC_LocalityIndexSize(const OLC_LocalityIndex* index);
+
+// Get the name and location of a locality, numbered in the order they were
+// given.  Returns 0 if there is no such locality.
+int OLC_LocalityGet(const OLC_LocalityIndex* index, size_t locality,
+                    const char** name, OLC_LatLon* location);
+
+// Shorten a full code relative to the nearest locality in the index, which
+// gives the shortest result OLC_Shorten can give for any of them.  Returns
+// the length of the shortened code (the full code, if no locality is close
+// enough) or 0 on error; the chosen locality, or OLC_LOCALITY_NONE, is
+// stored in locality if that is not 0.
+int OLC_ShortenBest(const char* code, size_t size,
+                    const OLC_LocalityIndex* index,
+                    char* shortened, int maxlen, size_t* locality);
+
+#endif
@@ -0,0 +1,351 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "olc_parallel.h"
+
+// Number of items handed out at a time; a chunk of codes, together with
+// their inputs and outputs, stays well within a per-core L2 cache.
+#define PARALLEL_CHUNK_SIZE 2048
+
+// Batches with fewer items than this are run on the calling thread only.
+#define PARALLEL_MIN_ITEMS (4 * PARALLEL_CHUNK_SIZE)
+
+#define PARALLEL_MAX_THREADS 256
+
+typedef struct Job Job;
+
+typedef size_t (JobFunc)(const Job* job, size_t begin, size_t end);
+
+// The arguments of one batch call.
+struct Job {
+    JobFunc* func;
+    size_t n;
+    const double* lat;
+    const double* lon;
+    size_t code_length;
+    char* out;
+    const char* codes;
+    size_t stride;
+    double* lo_lat;
+    double* lo_lon;
+    double* hi_lat;
+    double* hi_lon;
+    uint8_t* len;
+    uint8_t* status;
+};
+
+// Each thread owns a range of chunks [next, end).  It takes chunks from the
+// front of its own range and, once that is empty, steals the back half of
+// the range of another thread.  Workers are aligned to avoid false sharing.
+typedef struct Worker {
+    pthread_mutex_t lock;
+    size_t next;
+    size_t end;
+    size_t result;
+    OLC_Pool* pool;
+    int index;
+    pthread_t thread;
+} __attribute__((aligned(64))) Worker;
+
+struct OLC_Pool {
+    pthread_mutex_t call;     // held for the duration of a batch call
+    pthread_mutex_t lock;     // protects the fields below
+    pthread_cond_t start;
+    pthread_cond_t done;
+    unsigned long generation; // bumped for every new job
+    int pending;              // number of threads still running the job
+    int stop;
+    const Job* job;
+    int threads;
+    int started;
+    Worker* workers;
+};
+
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+static OLC_Pool* default_pool;
+
+static void create_default_pool(void);
+static OLC_Pool* get_pool(OLC_Pool* pool);
+static void* worker_main(void* arg);
+static void run_worker(OLC_Pool* pool, Worker* worker);
+static int take_chunk(Worker* worker, size_t* chunk);
+static int steal_chunks(OLC_Pool* pool, Worker* thief);
+static size_t run_job(OLC_Pool* pool, const Job* job);
+static size_t encode_range(const Job* job, size_t begin, size_t end);
+static size_t decode_range(const Job* job, size_t begin, size_t end);
+
+OLC_Pool* OLC_PoolCreate(int threads)
+{
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (int) cpus : 1;
+    }
+    if (threads > PARALLEL_MAX_THREADS) {
+        threads = PARALLEL_MAX_THREADS;
+    }
+
+    OLC_Pool* pool = calloc(1, sizeof(OLC_Pool));
+    if (!pool) {
+        return 0;
+    }
+    void* workers = 0;
+    if (posix_memalign(&workers, 64, threads * sizeof(Worker)) != 0) {
+        free(pool);
+        return 0;
+    }
+    pool->workers = workers;
+    pthread_mutex_init(&pool->call, 0);
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->start, 0);
+    pthread_cond_init(&pool->done, 0);
+    pool->threads = threads;
+
+    // Worker 0 is whichever thread makes the batch call.
+    for (int j = 0; j < threads; ++j) {
+        Worker* worker = &pool->workers[j];
+        pthread_mutex_init(&worker->lock, 0);
+        worker->next = worker->end = worker->result = 0;
+        worker->pool = pool;
+        worker->index = j;
+    }
+    for (pool->started = 1; pool->started < threads; ++pool->started) {
+        Worker* worker = &pool->workers[pool->started];
+        if (pthread_create(&worker->thread, 0, worker_main, worker) != 0) {
+            break;
+        }
+    }
+    // The pool makes do with the threads that did start.
+    for (int j = pool->started; j < threads; ++j) {
+        pthread_mutex_destroy(&pool->workers[j].lock);
+    }
+    pool->threads = pool->started;
+    return pool;
+}
+
+void OLC_PoolDestroy(OLC_Pool* pool)
+{
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int j = 1; j < pool->started; ++j) {
+        pthread_join(pool->workers[j].thread, 0);
+    }
+    for (int j = 0; j < pool->started; ++j) {
+        pthread_mutex_destroy(&pool->workers[j].lock);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_mutex_destroy(&pool->call);
+    free(pool->workers);
+    free(pool);
+}
+
+int OLC_PoolThreads(OLC_Pool* pool)
+{
+    pool = get_pool(pool);
+    return pool ? pool->threads : 1;
+}
+
+size_t OLC_ParallelEncodeBatch(OLC_Pool* pool,
+                               const double* lat, const double* lon, size_t n,
+                               size_t code_length, char* out, size_t stride)
+{
+    size_t width = OLC_CodeWidth(code_length);
+    if (stride < width) {
+        return 0;
+    }
+    Job job = { encode_range, n };
+    job.lat = lat;
+    job.lon = lon;
+    job.code_length = code_length;
+    job.out = out;
+    job.stride = stride;
+    run_job(get_pool(pool), &job);
+    return width;
+}
+
+size_t OLC_ParallelDecodeBatch(OLC_Pool* pool,
+                               const char* codes, size_t stride, size_t n,
+                               double* lo_lat, double* lo_lon,
+                               double* hi_lat, double* hi_lon,
+                               uint8_t* len, uint8_t* status)
+{
+    Job job = { decode_range, n };
+    job.codes = codes;
+    job.stride = stride;
+    job.lo_lat = lo_lat;
+    job.lo_lon = lo_lon;
+    job.hi_lat = hi_lat;
+    job.hi_lon = hi_lon;
+    job.len = len;
+    job.status = status;
+    return run_job(get_pool(pool), &job);
+}
+
+static void create_default_pool(void)
+{
+    default_pool = OLC_PoolCreate(0);
+}
+
+static OLC_Pool* get_pool(OLC_Pool* pool)
+{
+    if (pool) {
+        return pool;
+    }
+    pthread_once(&default_once, create_default_pool);
+    return default_pool;
+}
+
+// Splits the chunks of a job evenly among the threads, wakes them up and
+// works along with them until all chunks are done.
+static size_t run_job(OLC_Pool* pool, const Job* job)
+{
+    if (!pool || pool->threads < 2 || job->n < PARALLEL_MIN_ITEMS) {
+        return job->func(job, 0, job->n);
+    }
+
+    pthread_mutex_lock(&pool->call);
+    size_t chunks = (job->n + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+    for (int j = 0; j < pool->threads; ++j) {
+        Worker* worker = &pool->workers[j];
+        pthread_mutex_lock(&worker->lock);
+        worker->next = chunks * j / pool->threads;
+        worker->end = chunks * (j + 1) / pool->threads;
+        worker->result = 0;
+        pthread_mutex_unlock(&worker->lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->pending = pool->threads - 1;
+    ++pool->generation;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    run_worker(pool, &pool->workers[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pool->job = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    size_t result = 0;
+    for (int j = 0; j < pool->threads; ++j) {
+        result += pool->workers[j].result;
+    }
+    pthread_mutex_unlock(&pool->call);
+    return result;
+}
+
+static void* worker_main(void* arg)
+{
+    Worker* worker = arg;
+    OLC_Pool* pool = worker->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        if (pool->stop) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        run_worker(pool, worker);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+static void run_worker(OLC_Pool* pool, Worker* worker)
+{
+    const Job* job = pool->job;
+    size_t result = 0;
+    for (;;) {
+        size_t chunk;
+        if (!take_chunk(worker, &chunk)) {
+            if (!steal_chunks(pool, worker)) {
+                break;
+            }
+            continue;
+        }
+        size_t begin = chunk * PARALLEL_CHUNK_SIZE;
+        size_t end = begin + PARALLEL_CHUNK_SIZE;
+        if (end > job->n) {
+            end = job->n;
+        }
+        result += job->func(job, begin, end);
+    }
+    worker->result = result;
+}
+
+static int take_chunk(Worker* worker, size_t* chunk)
+{
+    int ok = 0;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->next < worker->end) {
+        *chunk = worker->next++;
+        ok = 1;
+    }
+    pthread_mutex_unlock(&worker->lock);
+    return ok;
+}
+
+// Moves the back half of the first non-empty range found, starting with the
+// next thread, into the (empty) range of the thief.  Chunks are only ever
+// moved, so when no range has any left, all of them have been taken.
+static int steal_chunks(OLC_Pool* pool, Worker* thief)
+{
+    for (int j = 1; j < pool->threads; ++j) {
+        Worker* victim = &pool->workers[(thief->index + j) % pool->threads];
+        pthread_mutex_lock(&victim->lock);
+        size_t left = victim->end - victim->next;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        size_t end = victim->end;
+        victim->end -= (left + 1) / 2;
+        size_t next = victim->end;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&thief->lock);
+        thief->next = next;
+        thief->end = end;
+        pthread_mutex_unlock(&thief->lock);
+        return 1;
+    }
+    return 0;
+}
+
+static size_t encode_range(const Job* job, size_t begin, size_t end)
+{
+    OLC_EncodeBatch(job->lat + begin, job->lon + begin, end - begin,
+                    job->code_length, job->out + begin * job->stride, job->stride);
+    return end - begin;
+}
+
+static size_t decode_range(const Job* job, size_t begin, size_t end)
+{
+    return OLC_DecodeBatch(job->codes + begin * job->stride, job->stride, end - begin,
+                           job->lo_lat + begin, job->lo_lon + begin,
+                           job->hi_lat + begin, job->hi_lon + begin,
+                           job->len + begin, job->status + begin);
+}
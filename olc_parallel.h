@@ -0,0 +1,38 @@
+#ifndef OLC_PARALLEL_H_
+#define OLC_PARALLEL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "olc.h"
+
+// A pool of worker threads that share the work of one batch call at a time.
+// The functions in olc.h keep no mutable state, so they can be called from
+// any number of threads without initialization.
+typedef struct OLC_Pool OLC_Pool;
+
+// Create a pool with a number of threads, counting the calling thread; 0
+// means one per online CPU.  Returns 0 on failure.
+OLC_Pool* OLC_PoolCreate(int threads);
+
+// Stop the threads in a pool and free it
+void OLC_PoolDestroy(OLC_Pool* pool);
+
+// Get the number of threads in a pool (0 means the default pool)
+int OLC_PoolThreads(OLC_Pool* pool);
+
+// Same as OLC_EncodeBatch, with the work split among the threads of a pool.
+// With a pool of 0, a default pool with one thread per CPU is created on
+// first use and kept for the life of the process.  Calls on the same pool
+// from several threads are run one after the other.
+size_t OLC_ParallelEncodeBatch(OLC_Pool* pool,
+                               const double* lat, const double* lon, size_t n,
+                               size_t code_length, char* out, size_t stride);
+
+// Same as OLC_DecodeBatch, with the work split among the threads of a pool
+size_t OLC_ParallelDecodeBatch(OLC_Pool* pool,
+                               const char* codes, size_t stride, size_t n,
+                               double* lo_lat, double* lo_lon,
+                               double* hi_lat, double* hi_lon,
+                               uint8_t* len, uint8_t* status);
+
+#endif
@@ -4,16 +4,98 @@
 #include <stdlib.h>
 #include <string.h>
 #include "olc.h"
+#include "olc_agg.h"
+#include "olc_column.h"
+#include "olc_geofence.h"
+#include "olc_index.h"
+#include "olc_locality.h"
+#include "olc_parallel.h"
 
 #define BASE_PATH "test_data"
 
+#define PARALLEL_POINTS 100000
+#define PARALLEL_STRIDE 20
+
+#define LOCALITY_COUNT 500
+#define LOCALITY_CODES 1000
+
+#define SIMD_CODES 10000
+#define SIMD_STRIDE 17
+
+#define E7_POINTS 1000
+
+#define TRACKER_FIXES 20000
+
+#define INDEX_FILE "test_index.idx"
+#define INDEX_RECORDS 5000
+#define INDEX_BOXES 200
+
+#define COLUMN_FILE "test_column.olc"
+#define COLUMN_CODES 100000
+
+#define AGG_POINTS 20000
+#define AGG_LENGTHS 4
+
+#define GEOFENCE_FENCES 300
+#define GEOFENCE_VERTICES 40
+#define GEOFENCE_POINTS 20000
+
+#define TRAVERSE_LINES 200
+#define TRAVERSE_POINTS 6
+#define TRAVERSE_SAMPLES 500
+#define TRAVERSE_CELLS 20000
+
+#define COVER_CELLS 10000
+
 typedef int (TestFunc)(char* cp[], int cn);
 
+typedef struct IndexResult {
+    size_t count;
+    size_t records[INDEX_RECORDS];
+} IndexResult;
+
+typedef struct TraverseResult {
+    size_t count;
+    size_t limit;
+    OLC_Packed cells[TRAVERSE_CELLS];
+    double enter[TRAVERSE_CELLS];
+    double exit[TRAVERSE_CELLS];
+} TraverseResult;
+
+typedef struct ScanResult {
+    const char* text;
+    char found[256];
+} ScanResult;
+
 static int test_short_code(char* cp[], int cn);
 static int test_encoding(char* cp[], int cn);
 static int test_validity(char* cp[], int cn);
 
 static int process_file(const char* file, TestFunc func);
+static double random_unit(unsigned long long* state);
+static int test_parallel(void);
+static int test_locality(void);
+static int test_simd(void);
+static int test_scan(void);
+static int test_stats(void);
+static int test_e7(void);
+static int test_tracker(void);
+static int test_index(void);
+static int index_found(void* data, size_t record);
+static int test_column(void);
+static int compare_packed(const void* a, const void* b);
+static int test_agg(void);
+static int compare_cells(const void* a, const void* b);
+static int test_geofence(void);
+static size_t make_fence(unsigned long long* state, OLC_LatLon* vertices);
+static int fence_inside(const OLC_LatLon* vertices, size_t n, const OLC_LatLon* point);
+static int test_traverse(void);
+static int test_cover(void);
+static int cover_contains(const OLC_Packed* cells, size_t count, double lat, double lon);
+static int traverse_cell(void* data, OLC_Packed cell, double enter, double exit);
+static int check_fences(const OLC_Geofence* fences, OLC_LatLon (*vertices)[GEOFENCE_VERTICES],
+                        const size_t* counts, unsigned long long* state);
+static int scan_found(void* data, size_t offset, size_t size, int full);
 
 int main(int argc, char* argv[])
 {
@@ -28,6 +110,19 @@ int main(int argc, char* argv[])
     for (int j = 0; j < sizeof(data) / sizeof(data[0]); ++j) {
         process_file(data[j].file, data[j].func);
     }
+    test_parallel();
+    test_locality();
+    test_simd();
+    test_scan();
+    test_stats();
+    test_e7();
+    test_tracker();
+    test_index();
+    test_column();
+    test_agg();
+    test_geofence();
+    test_traverse();
+    test_cover();
 
     return 0;
 }
@@ -87,6 +182,15 @@ static int process_file(const char* file, TestFunc func)
     return count;
 }
 
+// xorshift64*, returning a double in [0, 1); the state must not be 0.
+static double random_unit(unsigned long long* state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return ((*state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
 static int test_encoding(char* cp[], int cn)
 {
     if (cn != 7) {
@@ -108,6 +212,22 @@ static int test_encoding(char* cp[], int cn)
     ok = strcmp(code, encoded) == 0;
     printf("%-3.3s ENC_CODE [%s:%s] [%s] [%s]\n", ok ? "OK" : "BAD", cp[1], cp[2], encoded, code);
 
+    // The batch encoder must agree with the scalar one.
+    char slot[32];
+    size_t width = OLC_EncodeBatch(&data_pos.lat, &data_pos.lon, 1, len, slot, sizeof(slot));
+    ok = width == strlen(code) && memcmp(code, slot, width) == 0 && slot[width] == ' ';
+    printf("%-3.3s ENC_BATCH [%s:%s] [%.*s] [%s]\n", ok ? "OK" : "BAD", cp[1], cp[2], (int) width, slot, code);
+
+    // Encoding several lengths at once gives the code and its parents.
+    size_t lengths[] = { len, 2, 4, 6, 8, 10, 11 };
+    char multi[7 * 24];
+    ok = OLC_EncodeMulti(&data_pos, lengths, 7, multi, 24) == 7 && strcmp(code, multi) == 0;
+    for (int j = 1; j < 7; ++j) {
+        OLC_Encode(&data_pos, lengths[j], encoded, 256);
+        ok = ok && strcmp(encoded, multi + j * 24) == 0;
+    }
+    printf("%-3.3s ENC_MULTI [%s:%s] [%s] [%s]\n", ok ? "OK" : "BAD", cp[1], cp[2], multi, code);
+
     // Now decode the code and check we get the correct coordinates.
     OLC_CodeArea data_area = {
         { strtod(cp[3], 0), strtod(cp[4], 0) },
@@ -124,6 +244,94 @@ static int test_encoding(char* cp[], int cn)
     OLC_LatLon decoded_center;
     OLC_GetCenter(&decoded_area, &decoded_center);
 
+    // The batch decoder must agree with the scalar one.
+    double lo_lat, lo_lon, hi_lat, hi_lon;
+    uint8_t batch_len, batch_status;
+    OLC_DecodeBatch(code, strlen(code), 1, &lo_lat, &lo_lon, &hi_lat, &hi_lon, &batch_len, &batch_status);
+    ok = batch_status == OLC_STATUS_OK && batch_len == decoded_area.len &&
+         lo_lat == decoded_area.lo.lat && lo_lon == decoded_area.lo.lon &&
+         hi_lat == decoded_area.hi.lat && hi_lon == decoded_area.hi.lon;
+    printf("%-3.3s DEC_BATCH [%s]: [%f:%f] [%f:%f]\n", ok ? "OK" : "BAD", code, lo_lat, lo_lon, decoded_area.lo.lat, decoded_area.lo.lon);
+
+    // Packing must round trip, and agree with encoding and decoding.
+    OLC_Packed packed, encoded_packed;
+    char unpacked[32];
+    OLC_CodeArea packed_area;
+    OLC_Pack(code, 0, &packed);
+    OLC_EncodePacked(&data_pos, len, &encoded_packed);
+    OLC_Unpack(packed, unpacked, sizeof(unpacked));
+    OLC_DecodePacked(packed, &packed_area);
+    ok = packed == encoded_packed && strcmp(code, unpacked) == 0 &&
+         packed_area.lo.lat == decoded_area.lo.lat && packed_area.lo.lon == decoded_area.lo.lon &&
+         packed_area.hi.lat == decoded_area.hi.lat && packed_area.hi.lon == decoded_area.hi.lon;
+    printf("%-3.3s PACKED [%s]: [%s] [%llu:%llu]\n", ok ? "OK" : "BAD", code, unpacked,
+           (unsigned long long) packed, (unsigned long long) encoded_packed);
+
+    // Covering the center of the code, as a point or as a circle of radius 0,
+    // at the length of the code must give back just the code.
+    OLC_Packed cells[4];
+    size_t bbox_cells = OLC_CoverBBox(&decoded_center, &decoded_center, len, len, 4, cells);
+    ok = bbox_cells == 1 && cells[0] == packed;
+    size_t circle_cells = OLC_CoverCircle(&decoded_center, 0, len, len, 4, cells);
+    ok = ok && circle_cells == 1 && cells[0] == packed;
+    printf("%-3.3s COVER [%s]: [%lu:%lu]\n", ok ? "OK" : "BAD", code,
+           (unsigned long) bbox_cells, (unsigned long) circle_cells);
+
+    // The neighbors must be the codes of the points one cell size away from
+    // the center, and the 1-ring must be the neighbors plus the code.
+    OLC_Packed neighbors[8];
+    OLC_Packed ring[9];
+    int neighbor_count = OLC_Neighbors(packed, neighbors);
+    size_t ring_count = OLC_KRing(packed, 1, ring, 9);
+    ok = ring_count == neighbor_count + 1;
+    int pos = 0;
+    int neighbor = 0;
+    for (int dlat = -1; dlat <= 1; ++dlat) {
+        for (int dlon = -1; dlon <= 1; ++dlon) {
+            OLC_LatLon nudged = {
+                decoded_center.lat + dlat * (decoded_area.hi.lat - decoded_area.lo.lat),
+                decoded_center.lon + dlon * (decoded_area.hi.lon - decoded_area.lo.lon),
+            };
+            if (nudged.lat < -90 || nudged.lat > 90) {
+                continue;
+            }
+            OLC_Packed expected;
+            OLC_EncodePacked(&nudged, len, &expected);
+            ok = ok && ring[pos++] == expected;
+            if (dlat || dlon) {
+                ok = ok && neighbors[neighbor++] == expected;
+            }
+        }
+    }
+    printf("%-3.3s NEIGHBORS [%s]: [%d:%lu]\n", ok ? "OK" : "BAD", code, neighbor_count, (unsigned long) ring_count);
+
+    // Parents must be the shorter codes for the same location, and contain
+    // the code; the code must be one of its parent's children.
+    char parent[32];
+    char children[400 * 16];
+    ok = 1;
+    for (size_t parent_len = 2; parent_len < len; parent_len += parent_len < 10 ? 2 : 1) {
+        OLC_Parent(code, 0, parent_len, parent, sizeof(parent));
+        OLC_Encode(&data_pos, parent_len, encoded, 256);
+        ok = ok && strcmp(parent, encoded) == 0;
+        ok = ok && OLC_Contains(parent, 0, code, 0) && !OLC_Contains(code, 0, parent, 0);
+
+        size_t child_len = parent_len + (parent_len < 10 ? 2 : 1);
+        OLC_Encode(&data_pos, child_len, encoded, 256);
+        size_t child_count = OLC_Children(parent, 0, children, 16);
+        int found = 0;
+        for (size_t j = 0; j < child_count; ++j) {
+            found += strncmp(children + j * 16, encoded, strlen(encoded)) == 0;
+        }
+        ok = ok && child_count == (parent_len < 10 ? 400 : 20) && found == 1;
+
+        OLC_Packed packed_parent;
+        OLC_PackedParent(packed, parent_len, &packed_parent);
+        OLC_Pack(parent, 0, &encoded_packed);
+        ok = ok && packed_parent == encoded_packed && OLC_PackedContains(packed_parent, packed);
+    }
+    printf("%-3.3s PARENT [%s]\n", ok ? "OK" : "BAD", code);
+
     ok = fabs(data_center.lat - decoded_center.lat) < 1e-10;
     printf("%-3.3s ENC_LAT [%f:%f]\n", ok ? "OK" : "BAD", decoded_center.lat, data_center.lat);
     ok = fabs(data_center.lon - decoded_center.lon) < 1e-10;
@@ -154,6 +362,17 @@ static int test_short_code(char* cp[], int cn)
         OLC_Shorten(full_code, 0, &reference, code, 256);
         ok = strcmp(short_code, code) == 0;
         printf("%-3.3s SHORTEN [%s] [%s:%s]: [%s] [%s]\n", ok ? "OK" : "BAD", full_code, cp[1], cp[2], code, short_code);
+
+        // The batch version works on blank padded slots.
+        char slot[24];
+        char out[24];
+        uint8_t status;
+        memset(slot, ' ', sizeof(slot));
+        memcpy(slot, full_code, strlen(full_code));
+        size_t count = OLC_ShortenBatch(slot, sizeof(slot), 1, &reference, out, sizeof(out), &status);
+        size_t len = strlen(short_code);
+        ok = count == 1 && status == OLC_STATUS_OK && memcmp(out, short_code, len) == 0 && out[len] == ' ';
+        printf("%-3.3s SHORTEN_BATCH [%s] [%s:%s]: [%.*s] [%s]\n", ok ? "OK" : "BAD", full_code, cp[1], cp[2], (int) len, out, short_code);
     }
 
     // Now extend the code using the reference location and check.
@@ -161,6 +380,16 @@ static int test_short_code(char* cp[], int cn)
         OLC_RecoverNearest(short_code, 0, &reference, code, 256);
         ok = strcmp(full_code, code) == 0;
         printf("%-3.3s RECOVER [%s] [%s:%s]: [%s] [%s]\n", ok ? "OK" : "BAD", short_code, cp[1], cp[2], code, full_code);
+
+        char slot[24];
+        char out[24];
+        uint8_t status;
+        memset(slot, ' ', sizeof(slot));
+        memcpy(slot, short_code, strlen(short_code));
+        size_t count = OLC_RecoverNearestBatch(slot, sizeof(slot), 1, &reference, out, sizeof(out), &status);
+        size_t len = strlen(full_code);
+        ok = count == 1 && status == OLC_STATUS_OK && memcmp(out, full_code, len) == 0 && out[len] == ' ';
+        printf("%-3.3s RECOVER_BATCH [%s] [%s:%s]: [%.*s] [%s]\n", ok ? "OK" : "BAD", short_code, cp[1], cp[2], (int) len, out, full_code);
     }
 
     return 0;
@@ -208,5 +437,1039 @@ static int test_validity(char* cp[], int cn)
     ok = got == is_short;
     printf("%-3.3s IsShort [%s]: [%d] [%d]\n", ok ? "OK" : "BAD", code, got, is_short);
 
+    // A parsed code gives the same answers.
+    OLC_Parsed parsed;
+    got = OLC_Parse(code, 0, &parsed);
+    ok = got == is_valid && OLC_ParsedIsValid(&parsed) == is_valid &&
+         OLC_ParsedIsFull(&parsed) == is_full && OLC_ParsedIsShort(&parsed) == is_short &&
+         OLC_ParsedCodeLength(&parsed) == OLC_CodeLength(code, 0);
+    printf("%-3.3s Parse [%s]: [%d] [%d]\n", ok ? "OK" : "BAD", code, got, is_valid);
+
+    // The batch decoder reports validity through its status.
+    double lo_lat, lo_lon, hi_lat, hi_lon;
+    uint8_t len, status;
+    OLC_DecodeBatch(code, strlen(code), 1, &lo_lat, &lo_lon, &hi_lat, &hi_lon, &len, &status);
+    got = status;
+    int expected = !is_valid ? OLC_STATUS_INVALID : is_full ? OLC_STATUS_OK : OLC_STATUS_SHORT;
+    ok = got == expected;
+    printf("%-3.3s DecodeBatch [%s]: [%d] [%d]\n", ok ? "OK" : "BAD", code, got, expected);
+
+    return 0;
+}
+
+// Runs the same batches serially and on a pool of threads, with every
+// hundredth code corrupted so that chunks take uneven times, and makes sure
+// the results are identical.
+static int test_parallel(void)
+{
+    size_t n = PARALLEL_POINTS;
+    double* lat = malloc(n * sizeof(double));
+    double* lon = malloc(n * sizeof(double));
+    char* codes = malloc(n * PARALLEL_STRIDE);
+    char* parallel_codes = malloc(n * PARALLEL_STRIDE);
+    double* area[2][4];
+    uint8_t* len[2];
+    uint8_t* status[2];
+    for (int k = 0; k < 2; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            area[k][c] = malloc(n * sizeof(double));
+        }
+        len[k] = malloc(n);
+        status[k] = malloc(n);
+    }
+
+    unsigned long long state = 1;
+    for (size_t j = 0; j < n; ++j) {
+        lat[j] = random_unit(&state) * 180 - 90;
+        lon[j] = random_unit(&state) * 360 - 180;
+    }
+
+    OLC_Pool* pool = OLC_PoolCreate(4);
+    size_t width = OLC_EncodeBatch(lat, lon, n, 11, codes, PARALLEL_STRIDE);
+    size_t parallel_width = OLC_ParallelEncodeBatch(pool, lat, lon, n, 11, parallel_codes, PARALLEL_STRIDE);
+    int ok = width == parallel_width && memcmp(codes, parallel_codes, n * PARALLEL_STRIDE) == 0;
+
+    for (size_t j = 0; j < n; j += 100) {
+        codes[j * PARALLEL_STRIDE] = 'A';
+    }
+    size_t decoded = OLC_DecodeBatch(codes, PARALLEL_STRIDE, n,
+                                     area[0][0], area[0][1], area[0][2], area[0][3],
+                                     len[0], status[0]);
+    size_t parallel_decoded = OLC_ParallelDecodeBatch(pool, codes, PARALLEL_STRIDE, n,
+                                                      area[1][0], area[1][1], area[1][2], area[1][3],
+                                                      len[1], status[1]);
+    ok = ok && decoded == parallel_decoded && decoded == n - n / 100 &&
+         memcmp(len[0], len[1], n) == 0 && memcmp(status[0], status[1], n) == 0;
+    for (int c = 0; c < 4; ++c) {
+        // Compared bitwise, so that NaN corners compare equal.
+        ok = ok && memcmp(area[0][c], area[1][c], n * sizeof(double)) == 0;
+    }
+    printf("%-3.3s PARALLEL [%lu] [%d threads] [%lu] [%lu]\n", ok ? "OK" : "BAD",
+           (unsigned long) n, OLC_PoolThreads(pool), (unsigned long) decoded, (unsigned long) parallel_decoded);
+    OLC_PoolDestroy(pool);
+
+    for (int k = 0; k < 2; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            free(area[k][c]);
+        }
+        free(len[k]);
+        free(status[k]);
+    }
+    free(parallel_codes);
+    free(codes);
+    free(lon);
+    free(lat);
+    return ok;
+}
+
+// Shortens random codes against the best of a few hundred localities in a
+// small region, and makes sure the index finds a result as short as trying
+// every locality.
+static int test_locality(void)
+{
+    OLC_LatLon locations[LOCALITY_COUNT];
+    unsigned long long state = 3;
+    for (int j = 0; j < LOCALITY_COUNT; ++j) {
+        locations[j].lat = 40 + random_unit(&state) * 10;
+        locations[j].lon = random_unit(&state) * 10;
+    }
+    OLC_LocalityIndex* index = OLC_LocalityIndexCreate(locations, 0, LOCALITY_COUNT);
+
+    int ok = index != 0;
+    int found = 0;
+    for (int j = 0; ok && j < LOCALITY_CODES; ++j) {
+        OLC_LatLon location;
+        location.lat = 39 + random_unit(&state) * 12;
+        location.lon = -1 + random_unit(&state) * 12;
+        char code[32];
+        OLC_Encode(&location, 10 + j % 6, code, sizeof(code));
+
+        int shortest = 0;
+        for (int k = 0; k < LOCALITY_COUNT; ++k) {
+            char shortened[32];
+            int len = OLC_Shorten(code, 0, &locations[k], shortened, sizeof(shortened));
+            if (!shortest || len < shortest) {
+                shortest = len;
+            }
+        }
+
+        char best[32];
+        size_t locality;
+        int len = OLC_ShortenBest(code, 0, index, best, sizeof(best), &locality);
+        char expected[32];
+        if (locality != OLC_LOCALITY_NONE) {
+            OLC_Shorten(code, 0, &locations[locality], expected, sizeof(expected));
+            ++found;
+        } else {
+            strcpy(expected, code);
+        }
+        ok = len == shortest && strcmp(best, expected) == 0;
+        if (!ok) {
+            printf("BAD LOCALITY [%s]: [%s] [%d] [%d]\n", code, best, len, shortest);
+        }
+    }
+    printf("%-3.3s LOCALITY [%d localities] [%d codes] [%d shortened]\n", ok ? "OK" : "BAD",
+           LOCALITY_COUNT, LOCALITY_CODES, found);
+    OLC_LocalityIndexDestroy(index);
+    return ok;
+}
+
+// Validates and decodes codes of every length, in both cases, NUL terminated
+// or blank padded and some of them corrupted, with each instruction set the
+// CPU supports, and makes sure they all agree with the functions taking one
+// code.
+static int test_simd(void)
+{
+    size_t n = SIMD_CODES;
+    char* codes = malloc(n * SIMD_STRIDE);
+    uint8_t* expected = malloc(n);
+    double* area[2][4];
+    uint8_t* len[2];
+    uint8_t* status[2];
+    for (int k = 0; k < 2; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            area[k][c] = malloc(n * sizeof(double));
+        }
+        len[k] = malloc(n);
+        status[k] = malloc(n);
+    }
+
+    unsigned long long state = 5;
+    for (size_t j = 0; j < n; ++j) {
+        OLC_LatLon location;
+        location.lat = random_unit(&state) * 180 - 90;
+        location.lon = random_unit(&state) * 360 - 180;
+        char code[32];
+        int size = OLC_Encode(&location, 2 + j % 14, code, sizeof(code));
+        for (int k = 0; j % 3 == 0 && k < size; ++k) {
+            code[k] = tolower(code[k]);
+        }
+        if (j % 5 == 0) {
+            code[(state >> 20) % size] = "0+ aIx"[(state >> 40) % 6];
+        }
+        char* slot = codes + j * SIMD_STRIDE;
+        memset(slot, j % 2 ? '\0' : ' ', SIMD_STRIDE);
+        memcpy(slot, code, size);
+        while (j % 2 == 0 && size > 0 && code[size - 1] == ' ') {
+            // Trailing blanks are padding in a blank padded slot.
+            --size;
+        }
+        expected[j] = !OLC_IsValid(code, size) ? OLC_STATUS_INVALID :
+                      OLC_IsFull(code, size) ? OLC_STATUS_OK : OLC_STATUS_SHORT;
+    }
+
+    int ok = 1;
+    int best = OLC_GetSimd();
+    for (int simd = OLC_SIMD_NONE; simd <= best; ++simd) {
+        // The results of the portable code are the reference for the others.
+        int k = simd == OLC_SIMD_NONE ? 0 : 1;
+        OLC_SetSimd(simd);
+        size_t valid = OLC_ValidateBatch(codes, SIMD_STRIDE, n, status[k]);
+        int simd_ok = memcmp(status[k], expected, n) == 0;
+        size_t decoded = OLC_DecodeBatch(codes, SIMD_STRIDE, n,
+                                         area[k][0], area[k][1], area[k][2], area[k][3],
+                                         len[k], status[k]);
+        simd_ok = simd_ok && memcmp(status[k], expected, n) == 0;
+        for (int c = 0; k && c < 4; ++c) {
+            simd_ok = simd_ok && memcmp(area[0][c], area[1][c], n * sizeof(double)) == 0;
+        }
+        simd_ok = simd_ok && (!k || memcmp(len[0], len[1], n) == 0);
+        printf("%-3.3s SIMD [%d] [%lu] [%lu valid] [%lu decoded]\n", simd_ok ? "OK" : "BAD",
+               simd, (unsigned long) n, (unsigned long) valid, (unsigned long) decoded);
+        ok = ok && simd_ok;
+    }
+    OLC_SetSimd(OLC_SIMD_AVX2);
+
+    for (int k = 0; k < 2; ++k) {
+        for (int c = 0; c < 4; ++c) {
+            free(area[k][c]);
+        }
+        free(len[k]);
+        free(status[k]);
+    }
+    free(expected);
+    free(codes);
+    return ok;
+}
+
+// Scans a line of text with codes in and around words and punctuation, with
+// each instruction set the CPU supports.
+static int test_scan(void)
+{
+    const char* text =
+        "Meet at 8FVC9G8F+6X, or 9G8F+6X Zurich; not A8FVC9G8F+6X nor "
+        "8FVC9G8F+6X+ nor c++ nor +41 44 668 18 00, but plus.codes/8fvc9g8f+6xq "
+        "and 8FVC0000+.";
+    const char* expected = "8FVC9G8F+6X:1 9G8F+6X:0 8fvc9g8f+6xq:1 8FVC0000+:1 ";
+
+    int ok = 1;
+    int best = OLC_GetSimd();
+    for (int simd = OLC_SIMD_NONE; simd <= best; ++simd) {
+        ScanResult result = { text, "" };
+        OLC_SetSimd(simd);
+        size_t count = OLC_ScanText(text, strlen(text), scan_found, &result);
+        int scan_ok = count == 4 && strcmp(result.found, expected) == 0;
+        printf("%-3.3s SCAN [%d] [%s] [%s]\n", scan_ok ? "OK" : "BAD", simd, result.found, expected);
+        ok = ok && scan_ok;
+    }
+    OLC_SetSimd(OLC_SIMD_AVX2);
+    return ok;
+}
+
+// Appends each code found, with its full flag, to the result.
+static int scan_found(void* data, size_t offset, size_t size, int full)
+{
+    ScanResult* result = data;
+    size_t len = strlen(result->found);
+    snprintf(result->found + len, sizeof(result->found) - len, "%.*s:%d ",
+             (int) size, result->text + offset, full);
+    return 0;
+}
+
+// Checks the counters kept with OLC_STATS, or that there are none without.
+static int test_stats(void)
+{
+    OLC_Stats stats;
+    if (!OLC_GetStats(&stats)) {
+        OLC_Stats zero;
+        memset(&zero, 0, sizeof(zero));
+        int ok = memcmp(&stats, &zero, sizeof(stats)) == 0;
+        printf("%-3.3s STATS [disabled]\n", ok ? "OK" : "BAD");
+        return ok;
+    }
+
+    OLC_ResetStats();
+    OLC_IsValid("8FVC9G8F+6X", 0);
+    OLC_IsValid("8FVC9G8F", 0);
+    OLC_IsValid("8FVC9G8F+6X+", 0);
+    OLC_IsValid("8FVC9G8F+6Xa", 0);
+    OLC_IsValid(0, 0);
+    uint8_t status[2];
+    OLC_ValidateBatch("8FVC9G8F+6X 9G8F+6X     ", 12, 2, status);
+    OLC_GetStats(&stats);
+
+    int ok = stats.calls[OLC_API_IS_VALID] == 5 && stats.items[OLC_API_IS_VALID] == 5 &&
+             stats.calls[OLC_API_VALIDATE_BATCH] == 1 && stats.items[OLC_API_VALIDATE_BATCH] == 2 &&
+             stats.calls[OLC_API_PARSE] == 0 &&
+             stats.rejects[OLC_REJECT_NO_SEPARATOR] == 1 &&
+             stats.rejects[OLC_REJECT_SEPARATORS] == 1 &&
+             stats.rejects[OLC_REJECT_CHARACTER] == 1 &&
+             stats.rejects[OLC_REJECT_NULL] == 1 &&
+             stats.lengths[10] == 2 && stats.lengths[6] == 1 &&
+             stats.ns_per_tick > 0;
+    uint64_t latencies = 0;
+    for (int j = 0; j < OLC_STATS_BUCKETS; ++j) {
+        latencies += stats.latency[OLC_API_IS_VALID][j];
+    }
+    ok = ok && latencies == 5;
+    printf("%-3.3s STATS [%s %llu] [%s %llu] [%s %llu]\n", ok ? "OK" : "BAD",
+           OLC_StatsApiName(OLC_API_IS_VALID), (unsigned long long) stats.calls[OLC_API_IS_VALID],
+           OLC_StatsRejectName(OLC_REJECT_NO_SEPARATOR), (unsigned long long) stats.rejects[OLC_REJECT_NO_SEPARATOR],
+           OLC_StatsRejectName(OLC_REJECT_SEPARATORS), (unsigned long long) stats.rejects[OLC_REJECT_SEPARATORS]);
+
+    OLC_ResetStats();
+    OLC_GetStats(&stats);
+    ok = ok && stats.calls[OLC_API_IS_VALID] == 0 && stats.rejects[OLC_REJECT_NO_SEPARATOR] == 0;
+    printf("%-3.3s STATS_RESET\n", ok ? "OK" : "BAD");
+    return ok;
+}
+
+// Encodes random E7 locations of every length, and makes sure the results
+// agree with encoding them in degrees, and that the E7 corners of each code
+// are the first locations inside it and the first ones after it.
+static int test_e7(void)
+{
+    int32_t lat[E7_POINTS];
+    int32_t lon[E7_POINTS];
+    unsigned long long state = 7;
+    for (int j = 0; j < E7_POINTS; ++j) {
+        // Longitudes over the whole int32_t range, to be normalised.
+        lat[j] = (int32_t) (random_unit(&state) * 1800000001.0) - 900000000;
+        lon[j] = (int32_t) (random_unit(&state) * 4294967296.0 - 2147483648.0);
+        if (j % 4 == 0) {
+            // Round numbers are on the edges of short codes.
+            lat[j] -= lat[j] % 100000;
+            lon[j] -= lon[j] % 100000;
+        }
+    }
+
+    int ok = 1;
+    char codes[E7_POINTS * 16];
+    for (size_t length = 2; length <= OLC_MAX_DIGITS; ++length) {
+        OLC_EncodeBatchE7(lat, lon, E7_POINTS, length, codes, 16);
+        for (int j = 0; j < E7_POINTS; ++j) {
+            OLC_LatLonE7 location = { lat[j], lon[j] };
+            OLC_LatLon degrees = { lat[j] / 1e7, lon[j] / 1e7 };
+            char code[32];
+            char expected[32];
+            int len = OLC_EncodeE7(&location, length, code, sizeof(code));
+            OLC_Encode(&degrees, length, expected, sizeof(expected));
+            int e7_ok = strcmp(code, expected) == 0 && memcmp(codes + j * 16, code, len) == 0;
+
+            // Longitudes past 180 degrees wrap around.
+            long long wrapped = lon[j] < -1800000000 ? lon[j] + 3600000000LL :
+                                lon[j] >= 1800000000 ? lon[j] - 3600000000LL : lon[j];
+            OLC_CodeAreaE7 area;
+            e7_ok = e7_ok && OLC_DecodeE7(code, 0, &area) == OLC_CodeLength(code, 0);
+            e7_ok = e7_ok && area.lo.lat <= lat[j] && lat[j] < area.hi.lat &&
+                    area.lo.lon <= wrapped && wrapped < area.hi.lon;
+            OLC_LatLonE7 corners[4] = {
+                { area.lo.lat, area.lo.lon }, { area.hi.lat - 1, area.hi.lon - 1 },
+                { area.lo.lat - 1, area.lo.lon - 1 }, { area.hi.lat, area.hi.lon },
+            };
+            for (int k = 0; k < 4; ++k) {
+                char corner[32];
+                OLC_EncodeE7(&corners[k], length, corner, sizeof(corner));
+                e7_ok = e7_ok && (strcmp(corner, code) == 0) == (k < 2);
+            }
+            if (!e7_ok) {
+                printf("BAD E7 [%d:%d] [%s] [%s] [%d:%d] [%d:%d]\n", lat[j], lon[j], code, expected,
+                       area.lo.lat, area.lo.lon, area.hi.lat, area.hi.lon);
+            }
+            ok = ok && e7_ok;
+        }
+    }
+
+    int32_t lo_lat[2], lo_lon[2], hi_lat[2], hi_lon[2];
+    uint8_t len[2], status[2];
+    OLC_CodeAreaE7 area;
+    OLC_DecodeE7("8FVC9G8F+6X", 0, &area);
+    size_t decoded = OLC_DecodeBatchE7("8FVC9G8F+6X 9G8F+6X     ", 12, 2,
+                                       lo_lat, lo_lon, hi_lat, hi_lon, len, status);
+    ok = ok && decoded == 1 && status[0] == OLC_STATUS_OK && status[1] == OLC_STATUS_SHORT &&
+         lo_lat[0] == area.lo.lat && lo_lon[0] == area.lo.lon &&
+         hi_lat[0] == area.hi.lat && hi_lon[0] == area.hi.lon && len[0] == 10 &&
+         area.lo.lat == 473655000 && area.lo.lon == 85248750 &&
+         area.hi.lat == 473656250 && area.hi.lon == 85250000;
+    printf("%-3.3s E7 [%d points] [%d:%d] [%d:%d]\n", ok ? "OK" : "BAD", E7_POINTS,
+           area.lo.lat, area.lo.lon, area.hi.lat, area.hi.lon);
+    return ok;
+}
+
+// Tracks a location moving in small steps with the odd jump, and makes sure
+// the code and the coarsest changed cell agree with encoding every fix.
+static int test_tracker(void)
+{
+    int ok = 1;
+    int unchanged = 0;
+    unsigned long long state = 9;
+    for (size_t length = 4; length <= OLC_MAX_DIGITS; length += 3) {
+        OLC_Tracker tracker;
+        OLC_TrackerInit(&tracker, length);
+        char code[32];
+        char previous[32];
+        ok = ok && OLC_TrackerCode(&tracker, code, sizeof(code)) == 0;
+        OLC_LatLon location = { 47.365, 8.525 };
+        for (int j = 0; j < TRACKER_FIXES; ++j) {
+            double step = j % 1000 == 999 ? 10 : 1e-5;
+            location.lat += (random_unit(&state) - 0.5) * step;
+            location.lon += (random_unit(&state) - 0.5) * step;
+            int changed = OLC_TrackerUpdate(&tracker, &location);
+
+            char expected[32];
+            OLC_Encode(&location, length, expected, sizeof(expected));
+            OLC_TrackerCode(&tracker, code, sizeof(code));
+            int coarsest = j ? 0 : 2;
+            for (size_t k = 2; j && !coarsest && k <= strlen(expected) - 1; k += k < 10 ? 2 : 1) {
+                // The first k digits, plus the separator after 8 of them.
+                size_t size = k < 8 ? k : k + 1;
+                if (strncmp(previous, expected, size) != 0) {
+                    coarsest = k;
+                }
+            }
+            int tracker_ok = strcmp(code, expected) == 0 && changed == coarsest &&
+                             OLC_TrackerChanged(&tracker, length) == (coarsest != 0) &&
+                             OLC_TrackerChanged(&tracker, 2) == (coarsest == 2);
+            if (!tracker_ok) {
+                printf("BAD TRACKER [%s] [%s] [%d] [%d]\n", code, expected, changed, coarsest);
+            }
+            ok = ok && tracker_ok;
+            unchanged += !changed;
+            strcpy(previous, expected);
+        }
+    }
+    printf("%-3.3s TRACKER [%d fixes] [%d unchanged]\n", ok ? "OK" : "BAD", 4 * TRACKER_FIXES, unchanged);
+    return ok;
+}
+
+// Builds an index of codes of all lengths around the antimeridian, with
+// repeated codes and lines to skip, and checks every kind of query against
+// a search through all the records.
+static int test_index(void)
+{
+    static const size_t lengths[] = { 2, 4, 6, 8, 10, 11, 12, 13, 14, 15 };
+    static OLC_Packed packed[INDEX_RECORDS];
+    static OLC_LatLon centers[INDEX_RECORDS];
+    static IndexResult result;
+    char* text = malloc(INDEX_RECORDS * 32 + 64);
+    size_t size = 0;
+    int ok = text != 0;
+    unsigned long long state = 7;
+    for (int j = 0; ok && j < INDEX_RECORDS; ++j) {
+        if (j == INDEX_RECORDS / 2) {
+            size += sprintf(text + size, "code,payload\n\n# comment\n8FVC9G8F+6,bad\n");
+        }
+        char code[32];
+        if (j % 10 == 9) {
+            // The same code as a record before.
+            OLC_Unpack(packed[(size_t) (random_unit(&state) * j)], code, sizeof(code));
+        } else {
+            OLC_LatLon location;
+            location.lat = 40 + random_unit(&state) * 2;
+            location.lon = 179 + random_unit(&state) * 2;
+            OLC_Encode(&location, lengths[(size_t) (random_unit(&state) * 10)],
+                       code, sizeof(code));
+        }
+        OLC_CodeArea area;
+        OLC_Pack(code, 0, &packed[j]);
+        OLC_DecodePacked(packed[j], &area);
+        OLC_GetCenter(&area, &centers[j]);
+        size += sprintf(text + size, "%s,r%d\r\n", code, j);
+    }
+
+    size_t records = 0;
+    size_t skipped = 0;
+    ok = ok && OLC_IndexBuild(INDEX_FILE, text, size, ',', &records, &skipped) &&
+         records == INDEX_RECORDS && skipped == 4;
+    OLC_Index* index = ok ? OLC_IndexOpen(INDEX_FILE) : 0;
+    ok = index && OLC_IndexSize(index) == INDEX_RECORDS;
+
+    // Records are sorted by code, and then by input order; map them back to
+    // their input number through their payloads.
+    static size_t input[INDEX_RECORDS];
+    for (size_t j = 0; ok && j < INDEX_RECORDS; ++j) {
+        OLC_Packed code;
+        const char* payload;
+        size_t payload_size;
+        ok = OLC_IndexGet(index, j, &code, &payload, &payload_size) &&
+             payload[0] == 'r' && strlen(payload) == payload_size;
+        input[j] = ok ? strtoul(payload + 1, 0, 10) : 0;
+        ok = ok && input[j] < INDEX_RECORDS && packed[input[j]] == code &&
+             (j == 0 || code > packed[input[j - 1]] ||
+              (code == packed[input[j - 1]] && input[j] > input[j - 1]));
+        if (!ok) {
+            printf("BAD INDEX ORDER [%lu]\n", (unsigned long) j);
+        }
+    }
+    ok = ok && !OLC_IndexGet(index, INDEX_RECORDS, 0, 0, 0);
+
+    for (int j = 0; ok && j < INDEX_RECORDS; ++j) {
+        char code[32];
+        char parent[32];
+        OLC_Unpack(packed[j], code, sizeof(code));
+        OLC_Parent(code, 0, lengths[j % 10], parent, sizeof(parent));
+        OLC_Packed parent_packed;
+        OLC_Pack(parent, 0, &parent_packed);
+        size_t same = 0;
+        size_t contained = 0;
+        for (int k = 0; k < INDEX_RECORDS; ++k) {
+            same += packed[k] == packed[j];
+            contained += OLC_PackedContains(parent_packed, packed[k]);
+        }
+        size_t first = 0;
+        size_t count = OLC_IndexFind(index, code, 0, &first);
+        ok = count == same && first + count <= INDEX_RECORDS && packed[input[first]] == packed[j];
+        size_t prefix_first = 0;
+        size_t prefix_count = OLC_IndexFindPrefix(index, parent, 0, &prefix_first);
+        ok = ok && prefix_count == contained &&
+             OLC_PackedContains(parent_packed, packed[input[prefix_first]]);
+        if (!ok) {
+            printf("BAD INDEX FIND [%s] [%lu] [%lu] [%s] [%lu] [%lu]\n", code,
+                   (unsigned long) count, (unsigned long) same, parent,
+                   (unsigned long) prefix_count, (unsigned long) contained);
+        }
+    }
+    ok = ok && OLC_IndexFind(index, "8FVC9G8F+", 0, 0) == 0 &&
+         OLC_IndexFindPrefix(index, "8FVC", 0, 0) == 0;
+
+    size_t found = 0;
+    for (int j = 0; ok && j < INDEX_BOXES; ++j) {
+        double extent = j % 4 == 0 ? 1 : j % 4 == 1 ? 0.1 : 0.001;
+        OLC_LatLon lo;
+        lo.lat = 40 + random_unit(&state) * 2 - extent / 2;
+        lo.lon = 179 + random_unit(&state) * 2 - extent / 2;
+        OLC_LatLon hi = { lo.lat + extent, lo.lon + extent };
+        lo.lon -= lo.lon >= 180 ? 360 : 0;
+        hi.lon -= hi.lon >= 180 ? 360 : 0;
+        result.count = 0;
+        size_t count = OLC_IndexFindBBox(index, &lo, &hi, index_found, &result);
+        size_t expected = 0;
+        for (size_t k = 0; ok && k < INDEX_RECORDS; ++k) {
+            const OLC_LatLon* center = &centers[input[k]];
+            int inside = center->lat >= lo.lat && center->lat <= hi.lat &&
+                         (lo.lon <= hi.lon ? center->lon >= lo.lon && center->lon <= hi.lon
+                                           : center->lon >= lo.lon || center->lon <= hi.lon);
+            if (inside) {
+                ok = expected < result.count && result.records[expected] == k;
+                ++expected;
+            }
+        }
+        ok = ok && count == expected && result.count == expected;
+        if (!ok) {
+            printf("BAD INDEX BBOX [%f,%f] [%f,%f] [%lu] [%lu]\n", lo.lat, lo.lon, hi.lat, hi.lon,
+                   (unsigned long) count, (unsigned long) expected);
+        }
+        found += count;
+    }
+    OLC_LatLon world_lo = { -90, -180 };
+    OLC_LatLon world_hi = { 90, 180 };
+    ok = ok && OLC_IndexFindBBox(index, &world_lo, &world_hi, 0, 0) == INDEX_RECORDS;
+    OLC_IndexClose(index);
+
+    // Anything else is not an index file.
+    ok = ok && !OLC_IndexOpen(BASE_PATH "/encodingTests.csv") && !OLC_IndexOpen(BASE_PATH);
+
+    // A build that cannot replace its file leaves nothing behind.
+    FILE* fp = 0;
+    ok = ok && !OLC_IndexBuild(BASE_PATH, text, size, ',', 0, 0) &&
+         !(fp = fopen(BASE_PATH ".tmp", "rb"));
+    if (fp) {
+        fclose(fp);
+    }
+    remove(INDEX_FILE);
+    free(text);
+    printf("%-3.3s INDEX [%d records] [%d boxes] [%lu found]\n", ok ? "OK" : "BAD",
+           INDEX_RECORDS, INDEX_BOXES, (unsigned long) found);
+    return ok;
+}
+
+static int index_found(void* data, size_t record)
+{
+    IndexResult* result = data;
+    if (result->count < INDEX_RECORDS) {
+        result->records[result->count++] = record;
+    }
+    return 0;
+}
+
+// Writes codes around a city, most of them 11 digits long and some repeated
+// or shorter, to a file in two runs, and reads them back, skipping some of
+// the blocks.  Also makes sure damaged blocks are caught.
+static int test_column(void)
+{
+    OLC_Packed* codes = malloc(COLUMN_CODES * sizeof(OLC_Packed));
+    OLC_Packed* sorted = malloc(COLUMN_CODES * sizeof(OLC_Packed));
+    OLC_Packed* decoded = malloc(OLC_COLUMN_BLOCK_CODES * sizeof(OLC_Packed));
+    uint8_t* block = malloc(OLC_COLUMN_BLOCK_SIZE);
+    int ok = codes && sorted && decoded && block;
+    unsigned long long state = 11;
+    for (int j = 0; ok && j < COLUMN_CODES; ++j) {
+        OLC_LatLon location;
+        location.lat = 47.3 + random_unit(&state) * 0.2;
+        location.lon = 8.4 + random_unit(&state) * 0.2;
+        if (j % 50 == 49) {
+            codes[j] = codes[j - 1];
+        } else {
+            OLC_EncodePacked(&location, j % 20 == 19 ? 8 : 11, &codes[j]);
+        }
+    }
+    if (ok) {
+        memcpy(sorted, codes, COLUMN_CODES * sizeof(OLC_Packed));
+        qsort(sorted, COLUMN_CODES, sizeof(OLC_Packed), compare_packed);
+    }
+
+    // Two runs, each in reverse order.
+    size_t half = COLUMN_CODES / 2;
+    for (size_t j = 0; ok && j < half; ++j) {
+        codes[j] = sorted[half - 1 - j];
+        codes[half + j] = sorted[COLUMN_CODES - 1 - j];
+    }
+    OLC_ColumnWriter* writer = ok ? OLC_ColumnWriterOpen(COLUMN_FILE) : 0;
+    ok = writer && OLC_ColumnWrite(writer, codes, half) &&
+         OLC_ColumnWrite(writer, codes + half, COLUMN_CODES - half) &&
+         !OLC_ColumnWrite(writer, sorted, 1);
+    ok = OLC_ColumnWriterClose(writer) && ok;
+
+    // Every third block is skipped; the rest must come out as they went in.
+    OLC_ColumnReader* reader = ok ? OLC_ColumnReaderOpen(COLUMN_FILE) : 0;
+    ok = reader != 0;
+    size_t total = 0;
+    size_t bytes = 0;
+    OLC_ColumnBlock info;
+    for (int j = 0; ok && OLC_ColumnNextBlock(reader, &info); ++j) {
+        ok = info.count <= OLC_COLUMN_BLOCK_CODES && total + info.count <= COLUMN_CODES &&
+             info.min == sorted[total] && info.max == sorted[total + info.count - 1];
+        if (ok && j % 3 != 2) {
+            ok = OLC_ColumnReadBlock(reader, decoded) == info.count &&
+                 memcmp(decoded, sorted + total, info.count * sizeof(OLC_Packed)) == 0;
+        }
+        if (!ok) {
+            printf("BAD COLUMN BLOCK [%d]\n", j);
+        }
+        total += info.count;
+        bytes += info.size;
+    }
+    // The request asked for under 3 bytes per code on dense urban data.
+    ok = ok && total == COLUMN_CODES && bytes < 3 * COLUMN_CODES;
+    OLC_ColumnReaderClose(reader);
+    remove(COLUMN_FILE);
+
+    // A single block, codes far apart, unsorted codes, and damaged or cut off
+    // blocks.
+    OLC_Packed unsorted[2] = { sorted[1], sorted[0] - 1 };
+    OLC_LatLon far[3] = { { -40, -70 }, { 47.4, 8.5 }, { 60, 100 } };
+    OLC_Packed spread[3];
+    for (int j = 0; j < 3; ++j) {
+        OLC_EncodePacked(&far[j], 4 + 5 * j, &spread[j]);
+    }
+    size_t size = OLC_ColumnEncodeBlock(spread, 3, block);
+    ok = ok && size && OLC_ColumnDecodeBlock(block, size, decoded) == 3 &&
+         memcmp(decoded, spread, sizeof(spread)) == 0 &&
+         OLC_ColumnBlockInfo(block, size, &info) && info.length == 14;
+
+    size = ok ? OLC_ColumnEncodeBlock(sorted, OLC_COLUMN_BLOCK_CODES, block) : 0;
+    ok = size > OLC_COLUMN_HEADER_SIZE &&
+         OLC_ColumnDecodeBlock(block, size, decoded) == OLC_COLUMN_BLOCK_CODES &&
+         memcmp(decoded, sorted, OLC_COLUMN_BLOCK_CODES * sizeof(OLC_Packed)) == 0 &&
+         OLC_ColumnBlockInfo(block, size, &info) && info.size == size &&
+         !OLC_ColumnBlockInfo(block, size - 1, &info) &&
+         !OLC_ColumnDecodeBlock(block, size - 1, decoded) &&
+         !OLC_ColumnEncodeBlock(unsorted, 2, block) &&
+         !OLC_ColumnEncodeBlock(sorted, OLC_COLUMN_BLOCK_CODES + 1, block);
+    if (ok) {
+        block[size - 1] ^= 0x01;
+        ok = !OLC_ColumnDecodeBlock(block, size, decoded);
+        block[size - 1] |= 0x80;
+        ok = ok && !OLC_ColumnDecodeBlock(block, size, decoded);
+    }
+    ok = ok && !OLC_ColumnReaderOpen(BASE_PATH "/encodingTests.csv");
+
+    printf("%-3.3s COLUMN [%d codes] [%.2f bytes per code]\n", ok ? "OK" : "BAD",
+           COLUMN_CODES, (double) bytes / COLUMN_CODES);
+    free(block);
+    free(decoded);
+    free(sorted);
+    free(codes);
+    return ok;
+}
+
+static int compare_packed(const void* a, const void* b)
+{
+    OLC_Packed pa = *(const OLC_Packed*) a;
+    OLC_Packed pb = *(const OLC_Packed*) b;
+    return pa < pb ? -1 : pa > pb ? 1 : 0;
+}
+
+static int test_agg(void)
+{
+    // 9 rounds up to 10, and 8 comes twice: three lengths in the end.
+    static const size_t lengths[AGG_LENGTHS] = { 8, 4, 9, 8 };
+    static const size_t distinct[3] = { 8, 4, 10 };
+    double* lat = malloc(AGG_POINTS * sizeof(double));
+    double* lon = malloc(AGG_POINTS * sizeof(double));
+    double* weights = malloc(AGG_POINTS * sizeof(double));
+    OLC_CellStats* expected = malloc(3 * AGG_POINTS * sizeof(OLC_CellStats));
+    OLC_CellStats* cells = malloc(3 * AGG_POINTS * sizeof(OLC_CellStats));
+    int ok = lat && lon && weights && expected && cells;
+    unsigned long long state = 23;
+    for (int j = 0; ok && j < AGG_POINTS; ++j) {
+        lat[j] = -33.95 + random_unit(&state) * 0.3;
+        lon[j] = 18.35 + random_unit(&state) * 0.3;
+        weights[j] = (double) (j % 7) - 3;
+        OLC_LatLon location = { lat[j], lon[j] };
+        OLC_Packed multi[AGG_LENGTHS];
+        ok = OLC_EncodePackedMulti(&location, lengths, AGG_LENGTHS, multi) == AGG_LENGTHS;
+        for (int k = 0; ok && k < AGG_LENGTHS; ++k) {
+            OLC_Packed packed;
+            ok = OLC_EncodePacked(&location, lengths[k], &packed) && packed == multi[k];
+        }
+        for (int k = 0; k < 3; ++k) {
+            OLC_CellStats* cell = &expected[3 * j + k];
+            OLC_EncodePacked(&location, distinct[k], &cell->code);
+            cell->count = 1;
+            cell->sum = cell->min = cell->max = weights[j];
+        }
+    }
+
+    // The totals of each cell, by brute force.
+    size_t count = 0;
+    if (ok) {
+        qsort(expected, 3 * AGG_POINTS, sizeof(OLC_CellStats), compare_cells);
+        for (size_t j = 0; j < 3 * AGG_POINTS; ++j) {
+            OLC_CellStats* last = count ? &expected[count - 1] : 0;
+            if (last && last->code == expected[j].code) {
+                ++last->count;
+                last->sum += expected[j].sum;
+                last->min = expected[j].min < last->min ? expected[j].min : last->min;
+                last->max = expected[j].max > last->max ? expected[j].max : last->max;
+            } else {
+                expected[count++] = expected[j];
+            }
+        }
+    }
+
+    // Two halves, as two threads would add them, merged into one.
+    OLC_Aggregator* agg = ok ? OLC_AggregatorCreate(lengths, AGG_LENGTHS) : 0;
+    OLC_Aggregator* other = ok ? OLC_AggregatorCreate(lengths, AGG_LENGTHS) : 0;
+    size_t half = AGG_POINTS / 2;
+    ok = agg && other && !OLC_AggregatorCreate(lengths, 0) &&
+         OLC_AggregatorAdd(agg, lat, lon, weights, half) &&
+         OLC_AggregatorAdd(other, lat + half, lon + half, weights + half,
+                           AGG_POINTS - half) &&
+         OLC_AggregatorMerge(agg, other) &&
+         OLC_AggregatorSize(agg) == count &&
+         OLC_AggregatorCells(agg, cells, count - 1) == 0 &&
+         OLC_AggregatorCells(agg, cells, 3 * AGG_POINTS) == count;
+    for (size_t j = 0; ok && j < count; ++j) {
+        ok = cells[j].code == expected[j].code && cells[j].count == expected[j].count &&
+             cells[j].sum == expected[j].sum && cells[j].min == expected[j].min &&
+             cells[j].max == expected[j].max;
+        if (!ok) {
+            printf("BAD AGG CELL [%zu]\n", j);
+        }
+    }
+
+    // Without weights, every location weighs 1.
+    OLC_AggregatorDestroy(other);
+    other = ok ? OLC_AggregatorCreate(lengths + 1, 1) : 0;
+    ok = other && OLC_AggregatorAdd(other, lat, lon, 0, AGG_POINTS);
+    size_t total = ok ? OLC_AggregatorCells(other, cells, 3 * AGG_POINTS) : 0;
+    uint64_t points = 0;
+    for (size_t j = 0; ok && j < total; ++j) {
+        ok = cells[j].sum == cells[j].count && cells[j].min == 1 && cells[j].max == 1 &&
+             (j == 0 || cells[j - 1].code < cells[j].code);
+        points += cells[j].count;
+    }
+    ok = ok && points == AGG_POINTS;
+
+    printf("%-3.3s AGG [%d points] [%zu cells]\n", ok ? "OK" : "BAD", AGG_POINTS, count);
+    OLC_AggregatorDestroy(other);
+    OLC_AggregatorDestroy(agg);
+    free(cells);
+    free(expected);
+    free(weights);
+    free(lon);
+    free(lat);
+    return ok;
+}
+
+static int compare_cells(const void* a, const void* b)
+{
+    OLC_Packed ca = ((const OLC_CellStats*) a)->code;
+    OLC_Packed cb = ((const OLC_CellStats*) b)->code;
+    return ca < cb ? -1 : ca > cb ? 1 : 0;
+}
+
+static int test_geofence(void)
+{
+    OLC_LatLon (*vertices)[GEOFENCE_VERTICES] =
+        malloc(GEOFENCE_FENCES * sizeof(vertices[0]));
+    size_t counts[GEOFENCE_FENCES];
+    OLC_Geofence* fences = vertices ? OLC_GeofenceCreate(11, 256) : 0;
+    int ok = fences != 0;
+    unsigned long long state = 31;
+    for (int j = 0; ok && j < GEOFENCE_FENCES; ++j) {
+        counts[j] = make_fence(&state, vertices[j]);
+        ok = OLC_GeofenceSet(fences, j, vertices[j], counts[j]);
+    }
+    ok = ok && OLC_GeofenceSize(fences) == GEOFENCE_FENCES &&
+         check_fences(fences, vertices, counts, &state);
+
+    // Replace every third fence and remove every fifth one; bad polygons
+    // fail and leave no fence behind.
+    for (int j = 0; ok && j < GEOFENCE_FENCES; j += 3) {
+        counts[j] = make_fence(&state, vertices[j]);
+        ok = OLC_GeofenceSet(fences, j, vertices[j], counts[j]);
+    }
+    for (int j = 0; ok && j < GEOFENCE_FENCES; j += 5) {
+        counts[j] = 0;
+        ok = OLC_GeofenceSet(fences, j, 0, 0);
+    }
+    static const OLC_LatLon large[4] = { { -60, -170 }, { 70, -100 }, { 75, 10 }, { 0, 170 } };
+    memcpy(vertices[7], large, sizeof(large));
+    counts[7] = 4;
+    ok = ok && OLC_GeofenceSet(fences, 7, vertices[7], counts[7]);
+    if (ok) {
+        vertices[1][0].lat = 95;
+        ok = !OLC_GeofenceSet(fences, 1, vertices[1], counts[1]) &&
+             !OLC_GeofenceSet(fences, 2, vertices[2], 2);
+        counts[1] = counts[2] = 0;
+    }
+    size_t expected = 0;
+    for (int j = 0; j < GEOFENCE_FENCES; ++j) {
+        expected += counts[j] != 0;
+    }
+    ok = ok && OLC_GeofenceSize(fences) == expected &&
+         check_fences(fences, vertices, counts, &state);
+
+    size_t boundary = 0;
+    size_t cells = fences ? OLC_GeofenceCells(fences, &boundary) : 0;
+    printf("%-3.3s GEOFENCE [%d fences] [%zu cells] [%zu boundary]\n", ok ? "OK" : "BAD",
+           GEOFENCE_FENCES, cells, boundary);
+    OLC_GeofenceDestroy(fences);
+    free(vertices);
+    return ok;
+}
+
+// A star shaped polygon, from a few meters to tens of kilometers across,
+// around New York; some are very thin.
+static size_t make_fence(unsigned long long* state, OLC_LatLon* vertices)
+{
+    double unit[4];
+    for (int k = 0; k < 4; ++k) {
+        unit[k] = random_unit(state);
+    }
+    size_t n = 3 + (size_t) (unit[0] * (GEOFENCE_VERTICES - 3));
+    double lat = 40.5 + unit[1] * 0.4;
+    double lon = -74.2 + unit[2] * 0.4;
+    double radius = pow(10, -4.5 + 4 * unit[3]);
+    double squash = n % 4 == 0 ? 0.05 : 1;
+    for (size_t j = 0; j < n; ++j) {
+        double r = radius * (0.3 + 0.7 * random_unit(state));
+        double angle = 8 * atan(1) * j / n;
+        vertices[j].lat = lat + r * sin(angle) * squash;
+        vertices[j].lon = lon + r * cos(angle);
+    }
+    return n;
+}
+
+static int fence_inside(const OLC_LatLon* vertices, size_t n, const OLC_LatLon* point)
+{
+    int inside = 0;
+    for (size_t j = 0, k = n - 1; j < n; k = j++) {
+        const OLC_LatLon* a = &vertices[j];
+        const OLC_LatLon* b = &vertices[k];
+        if ((a->lat > point->lat) != (b->lat > point->lat) &&
+            point->lon < (b->lon - a->lon) * (point->lat - a->lat) / (b->lat - a->lat) + a->lon) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// Points around the fences, half of them right next to a vertex, must find
+// exactly the fences a brute force test finds.
+static int check_fences(const OLC_Geofence* fences, OLC_LatLon (*vertices)[GEOFENCE_VERTICES],
+                        const size_t* counts, unsigned long long* state)
+{
+    int ok = 1;
+    size_t hits = 0;
+    for (int j = 0; ok && j < GEOFENCE_POINTS; ++j) {
+        double unit[3];
+        for (int k = 0; k < 3; ++k) {
+            unit[k] = random_unit(state);
+        }
+        OLC_LatLon point = { 40.4 + unit[0] * 0.6, -74.3 + unit[1] * 0.6 };
+        size_t fence = (size_t) (unit[2] * GEOFENCE_FENCES);
+        if (j % 2 && counts[fence]) {
+            point = vertices[fence][j % counts[fence]];
+            point.lat += (unit[0] - 0.5) * 1e-4;
+            point.lon += (unit[1] - 0.5) * 1e-4;
+        }
+        size_t expected[GEOFENCE_FENCES];
+        size_t count = 0;
+        for (int k = 0; k < GEOFENCE_FENCES; ++k) {
+            if (counts[k] && fence_inside(vertices[k], counts[k], &point)) {
+                expected[count++] = k;
+            }
+        }
+        size_t ids[GEOFENCE_FENCES];
+        size_t found = OLC_GeofenceFind(fences, &point, ids, GEOFENCE_FENCES);
+        ok = found == count && memcmp(ids, expected, count * sizeof(size_t)) == 0 &&
+             (count == 0 || OLC_GeofenceFind(fences, &point, ids, count - 1) == 0);
+        if (!ok) {
+            printf("BAD GEOFENCE [%.9f,%.9f] [%zu] [%zu]\n", point.lat, point.lon, found, count);
+        }
+        hits += count;
+    }
+    return ok && hits > 0;
+}
+
+static int test_traverse(void)
+{
+    static const size_t lengths[] = { 4, 6, 8, 10, 11, 12 };
+    TraverseResult* result = malloc(sizeof(TraverseResult));
+    int ok = result != 0;
+    unsigned long long state = 41;
+    size_t total = 0;
+    for (int j = 0; ok && j < TRAVERSE_LINES; ++j) {
+        // Polylines of about 20 cells a segment, some across the
+        // antimeridian, and some going back and forth.
+        size_t length = lengths[j % 6];
+        OLC_CodeArea area;
+        OLC_LatLon points[TRAVERSE_POINTS];
+        double unit[2 * TRAVERSE_POINTS];
+        for (int k = 0; k < 2 * TRAVERSE_POINTS; ++k) {
+            unit[k] = random_unit(&state) - 0.5;
+        }
+        OLC_LatLon start = { 60 * unit[0], j % 3 ? 300 * unit[1] : 179.9 + unit[1] * 1e-6 };
+        OLC_Packed first;
+        OLC_EncodePacked(&start, length, &first);
+        OLC_DecodePacked(first, &area);
+        double lat_size = area.hi.lat - area.lo.lat;
+        double lon_size = area.hi.lon - area.lo.lon;
+        points[0] = start;
+        for (int k = 1; k < TRAVERSE_POINTS; ++k) {
+            points[k].lat = points[k - 1].lat + 40 * unit[2 * k] * lat_size;
+            points[k].lon = points[k - 1].lon + 40 * unit[2 * k + 1] * lon_size;
+            if (points[k].lon >= 180) {
+                points[k].lon -= 360;
+            }
+        }
+        result->count = 0;
+        result->limit = TRAVERSE_CELLS;
+        size_t count = OLC_TraversePolyline(points, TRAVERSE_POINTS, length,
+                                            traverse_cell, result);
+        ok = count == result->count && count > 0 && count < TRAVERSE_CELLS &&
+             result->enter[0] == 0 && result->exit[count - 1] == TRAVERSE_POINTS - 1;
+        total += count;
+
+        // Consecutive cells are different neighbors and hand over where
+        // one is left.
+        for (size_t k = 1; ok && k < count; ++k) {
+            OLC_Packed neighbors[8];
+            int found = OLC_Neighbors(result->cells[k - 1], neighbors);
+            ok = result->enter[k] == result->exit[k - 1] &&
+                 result->enter[k] <= result->exit[k];
+            int adjacent = 0;
+            for (int m = 0; m < found; ++m) {
+                adjacent |= neighbors[m] == result->cells[k];
+            }
+            ok = ok && adjacent;
+        }
+
+        // Points sampled along the polyline fall into the cells in order,
+        // each at about the position where the walk was in its cell.
+        size_t at = 0;
+        for (int k = 0; ok && k + 1 < TRAVERSE_POINTS; ++k) {
+            for (int m = 0; ok && m <= TRAVERSE_SAMPLES; ++m) {
+                double t = (double) m / TRAVERSE_SAMPLES;
+                double lon_delta = points[k + 1].lon - points[k].lon;
+                lon_delta += lon_delta > 180 ? -360 : lon_delta < -180 ? 360 : 0;
+                OLC_LatLon sample = {
+                    points[k].lat + t * (points[k + 1].lat - points[k].lat),
+                    points[k].lon + t * lon_delta,
+                };
+                OLC_Packed packed;
+                OLC_EncodePacked(&sample, length, &packed);
+                while (at < count && (result->cells[at] != packed ||
+                                      result->exit[at] < k + t - 1e-6)) {
+                    ++at;
+                }
+                ok = at < count && result->enter[at] <= k + t + 1e-6;
+            }
+        }
+        if (!ok) {
+            printf("BAD TRAVERSE [%d] [length %zu] [%zu cells]\n", j, length, count);
+        }
+    }
+
+    // A single point, and a walk stopped early.
+    OLC_LatLon points[2] = { { 47.365590, 8.524997 }, { 47.365590, 8.534997 } };
+    if (ok) {
+        result->count = 0;
+        result->limit = 3;
+        OLC_Packed packed;
+        OLC_EncodePacked(&points[0], 10, &packed);
+        ok = OLC_TraversePolyline(points, 1, 10, traverse_cell, result) == 1 &&
+             result->cells[0] == packed && result->enter[0] == 0 && result->exit[0] == 0 &&
+             OLC_TraversePolyline(points, 2, 10, traverse_cell, result) == 2 &&
+             OLC_TraversePolyline(points, 0, 10, traverse_cell, result) == 0;
+    }
+
+    printf("%-3.3s TRAVERSE [%d polylines] [%zu cells]\n", ok ? "OK" : "BAD",
+           TRAVERSE_LINES, total);
+    free(result);
+    return ok;
+}
+
+static int traverse_cell(void* data, OLC_Packed cell, double enter, double exit)
+{
+    TraverseResult* result = data;
+    if (result->count < TRAVERSE_CELLS) {
+        result->cells[result->count] = cell;
+        result->enter[result->count] = enter;
+        result->exit[result->count] = exit;
+    }
+    return ++result->count >= result->limit;
+}
+
+// A circle around (0,0) reaching 175 degrees of arc.  The corners of the
+// cell from 160 to 180 degrees of longitude are within 170 degrees, but its
+// eastern edge goes through the antipode, so the cell must not be taken as
+// inside.
+static int test_cover(void)
+{
+    OLC_LatLon center = { 0, 0 };
+    double radius = 175 * 3.14159265358979323846 / 180 * 6371008.8;
+    OLC_Packed* cells = malloc(COVER_CELLS * sizeof(OLC_Packed));
+    size_t count = cells ? OLC_CoverCircle(&center, radius, 2, 4, COVER_CELLS, cells) : 0;
+    int ok = count > 0 && count < COVER_CELLS &&
+             cover_contains(cells, count, 0.5, 170.5) && cover_contains(cells, count, 9.5, 160.5) &&
+             !cover_contains(cells, count, 0.5, 179.5) && !cover_contains(cells, count, -0.5, -179.5);
+    free(cells);
+    printf("%-3.3s COVER CIRCLE [%lu cells]\n", ok ? "OK" : "BAD", (unsigned long) count);
+    return ok;
+}
+
+static int cover_contains(const OLC_Packed* cells, size_t count, double lat, double lon)
+{
+    for (size_t j = 0; j < count; ++j) {
+        OLC_CodeArea area;
+        OLC_DecodePacked(cells[j], &area);
+        if (lat >= area.lo.lat && lat < area.hi.lat && lon >= area.lo.lon && lon < area.hi.lon) {
+            return 1;
+        }
+    }
     return 0;
 }